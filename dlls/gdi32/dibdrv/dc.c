@@ -22,6 +22,7 @@
 
 #include "gdi_private.h"
 #include "dibdrv.h"
+#include "winreg.h"
 
 #include "wine/wgl.h"
 #include "wine/wgl_driver.h"
@@ -320,6 +321,189 @@ void add_clipped_bounds( dibdrv_physdev *dev, const RECT *rect, HRGN clip )
     add_bounds_rect( dev->bounds, &rc );
 }
 
+/* large operations are split into horizontal tiles executed on the thread pool */
+#define TILE_MIN_PIXELS  (512 * 512)  /* don't bother splitting smaller operations */
+#define TILES_PER_THREAD 4
+
+static INIT_ONCE tile_init_once = INIT_ONCE_STATIC_INIT;
+static DWORD tile_threads;  /* number of threads used for large operations, disabled if less than 2 */
+
+struct tile_job
+{
+    const dib_info *dib;
+    const RECT     *tiles;
+    LONG            count;
+    LONG            next;  /* next tile to process */
+    void          (*func)( const dib_info *dib, const RECT *rect, const void *params );
+    const void     *params;
+};
+
+struct pattern_params
+{
+    const POINT         *origin;
+    const dib_info      *brush;
+    const rop_mask_bits *bits;
+};
+
+struct blend_params
+{
+    const dib_info *src;
+    const POINT    *offset;
+    BLENDFUNCTION   blend;
+};
+
+static BOOL WINAPI init_tile_threads( INIT_ONCE *once, void *param, void **context )
+{
+    SYSTEM_INFO info;
+    WCHAR buffer[12];
+    DWORD type, count = sizeof(buffer), val = 0;
+    HKEY key;
+
+    /* this is opt-in, through HKCU\Software\Wine\Gdi\DibThreads */
+    if (!RegOpenKeyW( HKEY_CURRENT_USER, L"Software\\Wine\\Gdi", &key ))
+    {
+        if (!RegQueryValueExW( key, L"DibThreads", NULL, &type, (BYTE *)buffer, &count ))
+        {
+            if (type == REG_DWORD) memcpy( &val, buffer, sizeof(val) );
+            else val = wcstol( buffer, NULL, 10 );
+        }
+        RegCloseKey( key );
+    }
+    GetSystemInfo( &info );
+    tile_threads = min( val, info.dwNumberOfProcessors );
+    if (tile_threads > 1) TRACE( "using %u threads\n", tile_threads );
+    return TRUE;
+}
+
+static void run_tiles( struct tile_job *job )
+{
+    LONG i;
+
+    while ((i = InterlockedIncrement( &job->next ) - 1) < job->count)
+        job->func( job->dib, &job->tiles[i], job->params );
+}
+
+static void CALLBACK tile_work_callback( TP_CALLBACK_INSTANCE *instance, void *context, TP_WORK *work )
+{
+    run_tiles( context );
+}
+
+/* run an operation over a number of rectangles on several threads; return FALSE if the caller
+ * has to do it itself. Tiles don't overlap, so the result is the same as for a single thread. */
+static BOOL run_tiled( const dib_info *dib, int num, const RECT *rects,
+                       void (*func)( const dib_info *, const RECT *, const void * ), const void *params )
+{
+    struct tile_job job;
+    RECT *tiles;
+    TP_WORK *work;
+    ULONGLONG pixels = 0;
+    int i, y, rows, tile_pixels, count = 0;
+
+    InitOnceExecuteOnce( &tile_init_once, init_tile_threads, NULL, NULL );
+    if (tile_threads < 2) return FALSE;
+
+    for (i = 0; i < num; i++)
+        pixels += (ULONGLONG)(rects[i].right - rects[i].left) * (rects[i].bottom - rects[i].top);
+    if (pixels < TILE_MIN_PIXELS) return FALSE;
+
+    tile_pixels = pixels / (tile_threads * TILES_PER_THREAD);
+    for (i = 0; i < num; i++)
+    {
+        if (rects[i].right <= rects[i].left) continue;
+        rows = max( 1, tile_pixels / (rects[i].right - rects[i].left) );
+        count += (rects[i].bottom - rects[i].top + rows - 1) / rows;
+    }
+    if (!(tiles = HeapAlloc( GetProcessHeap(), 0, count * sizeof(*tiles) ))) return FALSE;
+
+    job.dib    = dib;
+    job.tiles  = tiles;
+    job.count  = 0;
+    job.next   = 0;
+    job.func   = func;
+    job.params = params;
+    for (i = 0; i < num; i++)
+    {
+        if (rects[i].right <= rects[i].left) continue;
+        rows = max( 1, tile_pixels / (rects[i].right - rects[i].left) );
+        for (y = rects[i].top; y < rects[i].bottom; y += rows)
+        {
+            tiles[job.count] = rects[i];
+            tiles[job.count].top = y;
+            tiles[job.count].bottom = min( y + rows, rects[i].bottom );
+            job.count++;
+        }
+    }
+
+    if (!(work = CreateThreadpoolWork( tile_work_callback, &job, NULL )))
+    {
+        HeapFree( GetProcessHeap(), 0, tiles );
+        return FALSE;
+    }
+    for (i = 1; i < min( tile_threads, job.count ); i++) SubmitThreadpoolWork( work );
+    run_tiles( &job );
+    /* all the tiles have been claimed by now, callbacks that haven't started have nothing left
+     * to do; cancel them rather than wait for a pool thread, which may be us */
+    WaitForThreadpoolWorkCallbacks( work, TRUE );
+    CloseThreadpoolWork( work );
+    HeapFree( GetProcessHeap(), 0, tiles );
+    return TRUE;
+}
+
+static void solid_tile( const dib_info *dib, const RECT *rect, const void *params )
+{
+    const rop_mask *mask = params;
+
+    dib->funcs->solid_rects( dib, 1, rect, mask->and, mask->xor );
+}
+
+static void pattern_tile( const dib_info *dib, const RECT *rect, const void *params )
+{
+    const struct pattern_params *p = params;
+
+    dib->funcs->pattern_rects( dib, 1, rect, p->origin, p->brush, p->bits );
+}
+
+static void blend_tile( const dib_info *dib, const RECT *rect, const void *params )
+{
+    const struct blend_params *p = params;
+
+    dib->funcs->blend_rects( dib, 1, rect, p->src, p->offset, p->blend );
+}
+
+void tiled_solid_rects( const dib_info *dib, int num, const RECT *rects, DWORD and, DWORD xor )
+{
+    rop_mask mask;
+
+    mask.and = and;
+    mask.xor = xor;
+    if (!run_tiled( dib, num, rects, solid_tile, &mask ))
+        dib->funcs->solid_rects( dib, num, rects, and, xor );
+}
+
+void tiled_pattern_rects( const dib_info *dib, int num, const RECT *rects, const POINT *origin,
+                          const dib_info *brush, const rop_mask_bits *bits )
+{
+    struct pattern_params params;
+
+    params.origin = origin;
+    params.brush  = brush;
+    params.bits   = bits;
+    if (!run_tiled( dib, num, rects, pattern_tile, &params ))
+        dib->funcs->pattern_rects( dib, num, rects, origin, brush, bits );
+}
+
+void tiled_blend_rects( const dib_info *dib, int num, const RECT *rects, const dib_info *src,
+                        const POINT *offset, BLENDFUNCTION blend )
+{
+    struct blend_params params;
+
+    params.src    = src;
+    params.offset = offset;
+    params.blend  = blend;
+    if (!run_tiled( dib, num, rects, blend_tile, &params ))
+        dib->funcs->blend_rects( dib, num, rects, src, offset, blend );
+}
+
 /**********************************************************************
  *	     dibdrv_CreateDC
  */
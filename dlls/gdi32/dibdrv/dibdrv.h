@@ -266,6 +266,11 @@ extern int clip_line(const POINT *start, const POINT *end, const RECT *clip,
                      const bres_params *params, POINT *pt1, POINT *pt2) DECLSPEC_HIDDEN;
 extern void release_cached_font( struct cached_font *font ) DECLSPEC_HIDDEN;
 extern BOOL fill_with_pixel( DC *dc, dib_info *dib, DWORD pixel, int num, const RECT *rects, INT rop ) DECLSPEC_HIDDEN;
+extern void tiled_solid_rects( const dib_info *dib, int num, const RECT *rects, DWORD and, DWORD xor ) DECLSPEC_HIDDEN;
+extern void tiled_pattern_rects( const dib_info *dib, int num, const RECT *rects, const POINT *origin,
+                                 const dib_info *brush, const rop_mask_bits *bits ) DECLSPEC_HIDDEN;
+extern void tiled_blend_rects( const dib_info *dib, int num, const RECT *rects, const dib_info *src,
+                               const POINT *offset, BLENDFUNCTION blend ) DECLSPEC_HIDDEN;
 
 static inline void init_clipped_rects( struct clipped_rects *clip_rects )
 {
@@ -19,6 +19,7 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include "gdi_private.h"
 #include "dibdrv.h"
 
@@ -29,6 +30,8 @@ WINE_DEFAULT_DEBUG_CHANNEL(dib);
 struct cached_glyph
 {
     GLYPHMETRICS metrics;
+    DWORD        size;       /* size of the allocation */
+    DWORD        last_used;  /* value of font_cache_clock when last drawn */
     BYTE         bits[1];
 };
 
@@ -50,10 +53,15 @@ struct cached_font
     LOGFONTW              lf;
     XFORM                 xform;
     UINT                  aa_flags;
+    LONG                  glyphs_size;  /* size of the cached glyph bitmaps */
+    SRWLOCK               lock;         /* held shared while drawing, exclusive while trimming */
+    BOOL                  trimming;     /* lock held by trim_font_cache */
     struct cached_glyph **glyphs[GLYPH_NBTYPES][GLYPH_CACHE_PAGES];
 };
 
 static struct list font_cache = LIST_INIT( font_cache );
+static LONG font_cache_glyphs_size;  /* size of the glyph bitmaps of all fonts */
+static LONG font_cache_clock;        /* incremented for each string drawn */
 
 static CRITICAL_SECTION font_cache_cs;
 static CRITICAL_SECTION_DEBUG critsect_debug =
@@ -553,10 +561,115 @@ static int font_cache_cmp( const struct cached_font *p1, const struct cached_fon
     return ret;
 }
 
+/* free the glyphs of an unused font, font_cache_cs must be held */
+static void free_cached_glyphs( struct cached_font *font )
+{
+    UINT i, j, k;
+
+    for (i = 0; i < GLYPH_NBTYPES; i++)
+    {
+        for (j = 0; j < GLYPH_CACHE_PAGES; j++)
+        {
+            if (!font->glyphs[i][j]) continue;
+            for (k = 0; k < GLYPH_CACHE_PAGE_SIZE; k++)
+                HeapFree( GetProcessHeap(), 0, font->glyphs[i][j][k] );
+            HeapFree( GetProcessHeap(), 0, font->glyphs[i][j] );
+            font->glyphs[i][j] = NULL;
+        }
+    }
+    InterlockedExchangeAdd( &font_cache_glyphs_size, -font->glyphs_size );
+    font->glyphs_size = 0;
+}
+
+struct glyph_slot
+{
+    struct cached_font   *font;
+    struct cached_glyph **glyph;
+};
+
+static int glyph_slot_cmp( const void *p1, const void *p2 )
+{
+    const struct glyph_slot *slot1 = p1, *slot2 = p2;
+    LONG diff = (*slot1->glyph)->last_used - (*slot2->glyph)->last_used;
+
+    return diff < 0 ? -1 : diff > 0;
+}
+
+/* list the cached glyphs of a font, or only count them if slots is NULL */
+static SIZE_T get_glyph_slots( struct cached_font *font, struct glyph_slot *slots )
+{
+    SIZE_T count = 0;
+    UINT i, j, k;
+
+    for (i = 0; i < GLYPH_NBTYPES; i++)
+    {
+        for (j = 0; j < GLYPH_CACHE_PAGES; j++)
+        {
+            if (!font->glyphs[i][j]) continue;
+            for (k = 0; k < GLYPH_CACHE_PAGE_SIZE; k++)
+            {
+                if (!font->glyphs[i][j][k]) continue;
+                if (slots)
+                {
+                    slots[count].font  = font;
+                    slots[count].glyph = &font->glyphs[i][j][k];
+                }
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/* free the least recently drawn glyphs until the cache is back to 3/4 of its budget,
+ * font_cache_cs must be held */
+static void trim_font_cache(void)
+{
+    SIZE_T budget = get_glyph_cache_budget(), count = 0, i;
+    struct cached_font *font;
+    struct glyph_slot *slots;
+    struct cached_glyph *glyph;
+
+    if ((SIZE_T)font_cache_glyphs_size <= budget) return;
+
+    /* fonts that are being drawn with right now are left alone until next time */
+    LIST_FOR_EACH_ENTRY( font, &font_cache, struct cached_font, entry )
+    {
+        font->trimming = font->glyphs_size && TryAcquireSRWLockExclusive( &font->lock );
+        if (font->trimming) count += get_glyph_slots( font, NULL );
+    }
+
+    if (count && (slots = HeapAlloc( GetProcessHeap(), 0, count * sizeof(*slots) )))
+    {
+        count = 0;
+        LIST_FOR_EACH_ENTRY( font, &font_cache, struct cached_font, entry )
+            if (font->trimming) count += get_glyph_slots( font, slots + count );
+
+        qsort( slots, count, sizeof(*slots), glyph_slot_cmp );
+
+        for (i = 0; i < count && (SIZE_T)font_cache_glyphs_size > budget / 4 * 3; i++)
+        {
+            glyph = *slots[i].glyph;
+            *slots[i].glyph = NULL;
+            InterlockedExchangeAdd( &slots[i].font->glyphs_size, -glyph->size );
+            InterlockedExchangeAdd( &font_cache_glyphs_size, -glyph->size );
+            HeapFree( GetProcessHeap(), 0, glyph );
+        }
+        TRACE( "freed %u glyphs, %d bytes left\n", (UINT)i, font_cache_glyphs_size );
+        HeapFree( GetProcessHeap(), 0, slots );
+    }
+
+    LIST_FOR_EACH_ENTRY( font, &font_cache, struct cached_font, entry )
+    {
+        if (font->trimming) ReleaseSRWLockExclusive( &font->lock );
+        font->trimming = FALSE;
+    }
+}
+
 static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
 {
     struct cached_font font, *ptr, *last_unused = NULL;
-    UINT i = 0, j, k;
+    UINT i = 0;
 
     GetObjectW( hfont, sizeof(font.lf), &font.lf );
     font.xform = dc->xformWorld2Vport;
@@ -572,6 +685,7 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
     font.hash = font_cache_hash( &font );
 
     EnterCriticalSection( &font_cache_cs );
+    trim_font_cache();
     LIST_FOR_EACH_ENTRY( ptr, &font_cache, struct cached_font, entry )
     {
         if (!font_cache_cmp( &font, ptr ))
@@ -590,16 +704,7 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
     if (i > 5)  /* keep at least 5 of the most-recently used fonts around */
     {
         ptr = last_unused;
-        for (i = 0; i < GLYPH_NBTYPES; i++)
-        {
-            for (j = 0; j < GLYPH_CACHE_PAGES; j++)
-            {
-                if (!ptr->glyphs[i][j]) continue;
-                for (k = 0; k < GLYPH_CACHE_PAGE_SIZE; k++)
-                    HeapFree( GetProcessHeap(), 0, ptr->glyphs[i][j][k] );
-                HeapFree( GetProcessHeap(), 0, ptr->glyphs[i][j] );
-            }
-        }
+        free_cached_glyphs( ptr );
         list_remove( &ptr->entry );
     }
     else if (!(ptr = HeapAlloc( GetProcessHeap(), 0, sizeof(*ptr) )))
@@ -610,6 +715,9 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
 
     *ptr = font;
     ptr->ref = 1;
+    ptr->glyphs_size = 0;
+    ptr->trimming = FALSE;
+    InitializeSRWLock( &ptr->lock );
     memset( ptr->glyphs, 0, sizeof(ptr->glyphs) );
 done:
     list_add_head( &font_cache, &ptr->entry );
@@ -645,7 +753,12 @@ static struct cached_glyph *add_cached_glyph( struct cached_font *font, UINT ind
             HeapFree( GetProcessHeap(), 0, ptr );
     }
     ret = InterlockedCompareExchangePointer( (void **)&font->glyphs[type][page][entry], glyph, NULL );
-    if (!ret) ret = glyph;
+    if (!ret)
+    {
+        InterlockedExchangeAdd( &font->glyphs_size, glyph->size );
+        InterlockedExchangeAdd( &font_cache_glyphs_size, glyph->size );
+        ret = glyph;
+    }
     else HeapFree( GetProcessHeap(), 0, glyph );
     return ret;
 }
@@ -804,6 +917,8 @@ static struct cached_glyph *cache_glyph_bitmap( DC *dc, struct cached_font *font
 
 done:
     glyph->metrics = metrics;
+    glyph->size = FIELD_OFFSET( struct cached_glyph, bits[size] );
+    glyph->last_used = font_cache_clock;
     return add_cached_glyph( font, index, flags, glyph );
 }
 
@@ -816,6 +931,7 @@ static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT
     dib_info glyph_dib;
     DWORD text_color;
     struct font_intensities intensity;
+    DWORD clock;
 
     glyph_dib.bit_count    = get_glyph_depth( font->aa_flags );
     glyph_dib.rect.left    = 0;
@@ -830,11 +946,17 @@ static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT
     else
         get_aa_ranges( dib->funcs->pixel_to_colorref( dib, text_color ), intensity.ranges );
 
+    /* the glyphs can't be trimmed while we are using them */
+    AcquireSRWLockShared( &font->lock );
+    clock = InterlockedIncrement( &font_cache_clock );
+
     for (i = 0; i < count; i++)
     {
         if (!(glyph = get_cached_glyph( font, str[i], flags )) &&
             !(glyph = cache_glyph_bitmap( dc, font, str[i], flags ))) continue;
 
+        glyph->last_used = clock;
+
         glyph_dib.width       = glyph->metrics.gmBlackBoxX;
         glyph_dib.height      = glyph->metrics.gmBlackBoxY;
         glyph_dib.rect.right  = glyph->metrics.gmBlackBoxX;
@@ -860,6 +982,16 @@ static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT
             y += glyph->metrics.gmCellIncY;
         }
     }
+
+    ReleaseSRWLockShared( &font->lock );
+
+    /* fonts that stay selected don't go through add_cached_font, trim from here too */
+    if ((SIZE_T)font_cache_glyphs_size > get_glyph_cache_budget())
+    {
+        EnterCriticalSection( &font_cache_cs );
+        trim_font_cache();
+        LeaveCriticalSection( &font_cache_cs );
+    }
 }
 
 BOOL render_aa_text_bitmapinfo( DC *dc, BITMAPINFO *info, struct gdi_image_bits *bits,
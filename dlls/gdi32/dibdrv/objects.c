@@ -1786,7 +1786,7 @@ BOOL fill_with_pixel( DC *dc, dib_info *dib, DWORD pixel, int num, const RECT *r
     rop_mask mask;
 
     calc_rop_masks( rop, pixel, &mask );
-    dib->funcs->solid_rects( dib, num, rects, mask.and, mask.xor );
+    tiled_solid_rects( dib, num, rects, mask.and, mask.xor );
     return TRUE;
 }
 
@@ -2065,7 +2065,7 @@ static BOOL pattern_brush(dibdrv_physdev *pdev, dib_brush *brush, dib_info *dib,
         }
     }
 
-    dib->funcs->pattern_rects( dib, num, rects, brush_org, &brush->dib, &brush->masks );
+    tiled_pattern_rects( dib, num, rects, brush_org, &brush->dib, &brush->masks );
 
     if (needs_reselect) free_pattern_brush( brush );
     return TRUE;
@@ -27,6 +27,25 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(dib);
 
+/* SSE2 versions of the inner loops; on i386 they are only used when the CPU supports it */
+#if defined(__x86_64__) || (defined(__i386__) && defined(__GNUC__))
+#include <x86intrin.h>
+#define HAVE_SSE2_FUNCS
+#ifdef __i386__
+#define SSE2_FUNC __attribute__((target("sse2")))
+static BOOL use_sse2(void)
+{
+    static int supported = -1;
+
+    if (supported == -1) supported = IsProcessorFeaturePresent( PF_XMMI64_INSTRUCTIONS_AVAILABLE );
+    return supported;
+}
+#else
+#define SSE2_FUNC
+#define use_sse2() TRUE
+#endif
+#endif
+
 /* Bayer matrices for dithering */
 
 static const BYTE bayer_4x4[4][4] =
@@ -142,6 +161,44 @@ static inline void do_rop_16(WORD *ptr, WORD and, WORD xor)
     *ptr = (*ptr & and) ^ xor;
 }
 
+#ifdef HAVE_SSE2_FUNCS
+/* applies the rop with 32-bit and/xor patterns 16 bytes at a time, returns the number of bytes done */
+static SSE2_FUNC int do_rop_span_sse2(BYTE *ptr, int len, DWORD and, DWORD xor)
+{
+    const __m128i and_mask = _mm_set1_epi32( and ), xor_mask = _mm_set1_epi32( xor );
+    int x;
+
+    for (x = 0; x + 16 <= len; x += 16)
+    {
+        __m128i val = _mm_loadu_si128( (__m128i *)(ptr + x) );
+        _mm_storeu_si128( (__m128i *)(ptr + x), _mm_xor_si128( _mm_and_si128( val, and_mask ), xor_mask ));
+    }
+    return x;
+}
+#endif
+
+static inline void do_rop_span_32(DWORD *ptr, int len, DWORD and, DWORD xor)
+{
+    int x = 0;
+
+#ifdef HAVE_SSE2_FUNCS
+    if (use_sse2() && len >= 4)
+        x = do_rop_span_sse2( (BYTE *)ptr, len * 4, and, xor ) / 4;
+#endif
+    for (; x < len; x++) do_rop_32( ptr + x, and, xor );
+}
+
+static inline void do_rop_span_16(WORD *ptr, int len, WORD and, WORD xor)
+{
+    int x = 0;
+
+#ifdef HAVE_SSE2_FUNCS
+    if (use_sse2() && len >= 8)
+        x = do_rop_span_sse2( (BYTE *)ptr, len * 2, (DWORD)and << 16 | and, (DWORD)xor << 16 | xor ) / 2;
+#endif
+    for (; x < len; x++) do_rop_16( ptr + x, and, xor );
+}
+
 static inline void do_rop_8(BYTE *ptr, BYTE and, BYTE xor)
 {
     *ptr = (*ptr & and) ^ xor;
@@ -266,8 +323,8 @@ static inline void memset_16( WORD *start, WORD val, DWORD size )
 
 static void solid_rects_32(const dib_info *dib, int num, const RECT *rc, DWORD and, DWORD xor)
 {
-    DWORD *ptr, *start;
-    int x, y, i;
+    DWORD *start;
+    int y, i;
 
     for(i = 0; i < num; i++, rc++)
     {
@@ -276,8 +333,7 @@ static void solid_rects_32(const dib_info *dib, int num, const RECT *rc, DWORD a
         start = get_pixel_ptr_32(dib, rc->left, rc->top);
         if (and)
             for(y = rc->top; y < rc->bottom; y++, start += dib->stride / 4)
-                for(x = rc->left, ptr = start; x < rc->right; x++)
-                    do_rop_32(ptr++, and, xor);
+                do_rop_span_32( start, rc->right - rc->left, and, xor );
         else
             for(y = rc->top; y < rc->bottom; y++, start += dib->stride / 4)
                 memset_32( start, xor, rc->right - rc->left );
@@ -417,8 +473,8 @@ static void solid_rects_24(const dib_info *dib, int num, const RECT *rc, DWORD a
 
 static void solid_rects_16(const dib_info *dib, int num, const RECT *rc, DWORD and, DWORD xor)
 {
-    WORD *ptr, *start;
-    int x, y, i;
+    WORD *start;
+    int y, i;
 
     for(i = 0; i < num; i++, rc++)
     {
@@ -427,8 +483,7 @@ static void solid_rects_16(const dib_info *dib, int num, const RECT *rc, DWORD a
         start = get_pixel_ptr_16(dib, rc->left, rc->top);
         if (and)
             for(y = rc->top; y < rc->bottom; y++, start += dib->stride / 2)
-                for(x = rc->left, ptr = start; x < rc->right; x++)
-                    do_rop_16(ptr++, and, xor);
+                do_rop_span_16( start, rc->right - rc->left, and, xor );
         else
             for(y = rc->top; y < rc->bottom; y++, start += dib->stride / 2)
                 memset_16( start, xor, rc->right - rc->left );
@@ -4678,35 +4733,187 @@ static inline DWORD blend_rgb( BYTE dst_r, BYTE dst_g, BYTE dst_b, DWORD src, BL
             blend_color( dst_r, src >> 16, blend.SourceConstantAlpha ) << 16);
 }
 
+enum blend_op
+{
+    BLEND_ARGB,             /* per-pixel alpha */
+    BLEND_ARGB_ALPHA,       /* per-pixel and constant alpha */
+    BLEND_CONSTANT_ALPHA,   /* constant alpha */
+    BLEND_NO_SRC_ALPHA,     /* constant alpha, source alpha channel treated as 255 */
+};
+
+static void blend_row_8888_c( DWORD *dst, const DWORD *src, int len, enum blend_op op, DWORD alpha )
+{
+    int x;
+
+    switch (op)
+    {
+    case BLEND_ARGB:
+        for (x = 0; x < len; x++) dst[x] = blend_argb( dst[x], src[x] );
+        break;
+    case BLEND_ARGB_ALPHA:
+        for (x = 0; x < len; x++) dst[x] = blend_argb_alpha( dst[x], src[x], alpha );
+        break;
+    case BLEND_CONSTANT_ALPHA:
+        for (x = 0; x < len; x++) dst[x] = blend_argb_constant_alpha( dst[x], src[x], alpha );
+        break;
+    case BLEND_NO_SRC_ALPHA:
+        for (x = 0; x < len; x++) dst[x] = blend_argb_no_src_alpha( dst[x], src[x], alpha );
+        break;
+    }
+}
+
+static inline WORD blend_pixel_555( WORD dst, DWORD src, BLENDFUNCTION blend )
+{
+    DWORD val = blend_rgb( ((dst >> 7) & 0xf8) | ((dst >> 12) & 0x07),
+                           ((dst >> 2) & 0xf8) | ((dst >>  7) & 0x07),
+                           ((dst << 3) & 0xf8) | ((dst >>  2) & 0x07),
+                           src, blend );
+    return ((val >> 9) & 0x7c00) | ((val >> 6) & 0x03e0) | ((val >> 3) & 0x001f);
+}
+
+#ifdef HAVE_SSE2_FUNCS
+
+/* (x + 127) / 255 on 16-bit lanes, exact for x <= 255 * 255 */
+static inline SSE2_FUNC __m128i div255_epu16( __m128i x )
+{
+    x = _mm_add_epi16( x, _mm_set1_epi16( 128 ));
+    return _mm_srli_epi16( _mm_add_epi16( x, _mm_srli_epi16( x, 8 )), 8 );
+}
+
+/* blend two pixels unpacked to 16-bit lanes, same results as the scalar functions */
+static inline SSE2_FUNC __m128i blend_pixels_sse2( __m128i dst, __m128i src, enum blend_op op, __m128i alpha )
+{
+    const __m128i max = _mm_set1_epi16( 255 );
+    __m128i src_alpha;
+
+    switch (op)
+    {
+    case BLEND_ARGB_ALPHA:
+        src = div255_epu16( _mm_mullo_epi16( src, alpha ));
+        /* fall through */
+    case BLEND_ARGB:
+        src_alpha = _mm_shufflehi_epi16( _mm_shufflelo_epi16( src, 0xff ), 0xff );
+        return _mm_add_epi16( src, div255_epu16( _mm_mullo_epi16( dst, _mm_sub_epi16( max, src_alpha ))));
+    default:
+        return div255_epu16( _mm_add_epi16( _mm_mullo_epi16( src, alpha ),
+                                            _mm_mullo_epi16( dst, _mm_sub_epi16( max, alpha ))));
+    }
+}
+
+/* Blend four 8888 pixels. Channels of sources that aren't premultiplied can
+ * overflow into the next one, FALSE is returned for these so that the caller
+ * leaves them to the scalar code. */
+static inline SSE2_FUNC BOOL blend_4_pixels_sse2( __m128i *ret, __m128i d, __m128i s, enum blend_op op, __m128i alpha )
+{
+    const __m128i zero = _mm_setzero_si128(), max = _mm_set1_epi16( 255 );
+    __m128i lo = blend_pixels_sse2( _mm_unpacklo_epi8( d, zero ), _mm_unpacklo_epi8( s, zero ), op, alpha );
+    __m128i hi = blend_pixels_sse2( _mm_unpackhi_epi8( d, zero ), _mm_unpackhi_epi8( s, zero ), op, alpha );
+
+    if (_mm_movemask_epi8( _mm_or_si128( _mm_cmpgt_epi16( lo, max ), _mm_cmpgt_epi16( hi, max )))) return FALSE;
+    *ret = _mm_packus_epi16( lo, hi );
+    return TRUE;
+}
+
+static SSE2_FUNC int blend_row_8888_sse2( DWORD *dst, const DWORD *src, int len, enum blend_op op, DWORD alpha )
+{
+    const __m128i const_alpha = _mm_set1_epi16( alpha );
+    const __m128i alpha_mask = _mm_set1_epi32( op == BLEND_NO_SRC_ALPHA ? 0xff000000 : 0 );
+    __m128i val;
+    int x;
+
+    for (x = 0; x + 4 <= len; x += 4)
+    {
+        __m128i s = _mm_or_si128( _mm_loadu_si128( (const __m128i *)(src + x)), alpha_mask );
+        __m128i d = _mm_loadu_si128( (const __m128i *)(dst + x));
+
+        if (blend_4_pixels_sse2( &val, d, s, op, const_alpha ))
+            _mm_storeu_si128( (__m128i *)(dst + x), val );
+        else
+            blend_row_8888_c( dst + x, src + x, 4, op, alpha );
+    }
+    return x;
+}
+
+/* expands the 555 pixels to 8888 like blend_pixel_555 does, blends them and packs them back */
+static SSE2_FUNC int blend_row_555_sse2( WORD *dst, const DWORD *src, int len, BLENDFUNCTION blend )
+{
+    const __m128i zero = _mm_setzero_si128(), const_alpha = _mm_set1_epi16( blend.SourceConstantAlpha );
+    const __m128i mask_f8 = _mm_set1_epi32( 0xf8 ), mask_07 = _mm_set1_epi32( 0x07 );
+    enum blend_op op;
+    __m128i val;
+    int x, i;
+
+    if (blend.AlphaFormat & AC_SRC_ALPHA)
+        op = blend.SourceConstantAlpha == 255 ? BLEND_ARGB : BLEND_ARGB_ALPHA;
+    else
+        op = BLEND_CONSTANT_ALPHA;
+
+    for (x = 0; x + 4 <= len; x += 4)
+    {
+        __m128i s = _mm_loadu_si128( (const __m128i *)(src + x));
+        __m128i p = _mm_unpacklo_epi16( _mm_loadl_epi64( (const __m128i *)(dst + x)), zero );
+        __m128i r = _mm_or_si128( _mm_and_si128( _mm_srli_epi32( p, 7 ), mask_f8 ),
+                                  _mm_and_si128( _mm_srli_epi32( p, 12 ), mask_07 ));
+        __m128i g = _mm_or_si128( _mm_and_si128( _mm_srli_epi32( p, 2 ), mask_f8 ),
+                                  _mm_and_si128( _mm_srli_epi32( p, 7 ), mask_07 ));
+        __m128i b = _mm_or_si128( _mm_and_si128( _mm_slli_epi32( p, 3 ), mask_f8 ),
+                                  _mm_and_si128( _mm_srli_epi32( p, 2 ), mask_07 ));
+        __m128i d = _mm_or_si128( _mm_or_si128( _mm_slli_epi32( r, 16 ), _mm_slli_epi32( g, 8 )), b );
+
+        if (blend_4_pixels_sse2( &val, d, s, op, const_alpha ))
+        {
+            val = _mm_or_si128( _mm_or_si128( _mm_and_si128( _mm_srli_epi32( val, 9 ), _mm_set1_epi32( 0x7c00 )),
+                                              _mm_and_si128( _mm_srli_epi32( val, 6 ), _mm_set1_epi32( 0x03e0 ))),
+                                _mm_and_si128( _mm_srli_epi32( val, 3 ), _mm_set1_epi32( 0x001f )));
+            _mm_storel_epi64( (__m128i *)(dst + x), _mm_packs_epi32( val, zero ));
+        }
+        else for (i = x; i < x + 4; i++) dst[i] = blend_pixel_555( dst[i], src[i], blend );
+    }
+    return x;
+}
+
+#endif  /* HAVE_SSE2_FUNCS */
+
+static void blend_row_8888( DWORD *dst, const DWORD *src, int len, enum blend_op op, DWORD alpha )
+{
+    int x = 0;
+
+#ifdef HAVE_SSE2_FUNCS
+    if (use_sse2()) x = blend_row_8888_sse2( dst, src, len, op, alpha );
+#endif
+    if (x < len) blend_row_8888_c( dst + x, src + x, len - x, op, alpha );
+}
+
+static void blend_row_555( WORD *dst, const DWORD *src, int len, BLENDFUNCTION blend )
+{
+    int x = 0;
+
+#ifdef HAVE_SSE2_FUNCS
+    if (use_sse2()) x = blend_row_555_sse2( dst, src, len, blend );
+#endif
+    for (; x < len; x++) dst[x] = blend_pixel_555( dst[x], src[x], blend );
+}
+
 static void blend_rects_8888(const dib_info *dst, int num, const RECT *rc,
                              const dib_info *src, const POINT *offset, BLENDFUNCTION blend)
 {
-    int i, x, y;
+    enum blend_op op;
+    int i, y;
+
+    if (blend.AlphaFormat & AC_SRC_ALPHA)
+        op = blend.SourceConstantAlpha == 255 ? BLEND_ARGB : BLEND_ARGB_ALPHA;
+    else if (src->compression == BI_RGB)
+        op = BLEND_CONSTANT_ALPHA;
+    else
+        op = BLEND_NO_SRC_ALPHA;
 
     for (i = 0; i < num; i++, rc++)
     {
         DWORD *src_ptr = get_pixel_ptr_32( src, rc->left + offset->x, rc->top + offset->y );
         DWORD *dst_ptr = get_pixel_ptr_32( dst, rc->left, rc->top );
 
-        if (blend.AlphaFormat & AC_SRC_ALPHA)
-        {
-            if (blend.SourceConstantAlpha == 255)
-                for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-                    for (x = 0; x < rc->right - rc->left; x++)
-                        dst_ptr[x] = blend_argb( dst_ptr[x], src_ptr[x] );
-            else
-                for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-                    for (x = 0; x < rc->right - rc->left; x++)
-                        dst_ptr[x] = blend_argb_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
-        }
-        else if (src->compression == BI_RGB)
-            for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-                for (x = 0; x < rc->right - rc->left; x++)
-                    dst_ptr[x] = blend_argb_constant_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
-        else
-            for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-                for (x = 0; x < rc->right - rc->left; x++)
-                    dst_ptr[x] = blend_argb_no_src_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+        for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
+            blend_row_8888( dst_ptr, src_ptr, rc->right - rc->left, op, blend.SourceConstantAlpha );
     }
 }
 
@@ -4780,7 +4987,7 @@ static void blend_rects_24(const dib_info *dst, int num, const RECT *rc,
 static void blend_rects_555(const dib_info *dst, int num, const RECT *rc,
                             const dib_info *src, const POINT *offset, BLENDFUNCTION blend)
 {
-    int i, x, y;
+    int i, y;
 
     for (i = 0; i < num; i++, rc++)
     {
@@ -4788,16 +4995,7 @@ static void blend_rects_555(const dib_info *dst, int num, const RECT *rc,
         WORD *dst_ptr = get_pixel_ptr_16( dst, rc->left, rc->top );
 
         for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 2, src_ptr += src->stride / 4)
-        {
-            for (x = 0; x < rc->right - rc->left; x++)
-            {
-                DWORD val = blend_rgb( ((dst_ptr[x] >> 7) & 0xf8) | ((dst_ptr[x] >> 12) & 0x07),
-                                       ((dst_ptr[x] >> 2) & 0xf8) | ((dst_ptr[x] >>  7) & 0x07),
-                                       ((dst_ptr[x] << 3) & 0xf8) | ((dst_ptr[x] >>  2) & 0x07),
-                                       src_ptr[x], blend );
-                dst_ptr[x] = ((val >> 9) & 0x7c00) | ((val >> 6) & 0x03e0) | ((val >> 3) & 0x001f);
-            }
-        }
+            blend_row_555( dst_ptr, src_ptr, rc->right - rc->left, blend );
     }
 }
 
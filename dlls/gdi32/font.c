@@ -93,10 +93,12 @@ static const MAT2 identity = { {0,1}, {0,0}, {0,0}, {0,1} };
 static UINT font_smoothing = GGO_BITMAP;
 static UINT subpixel_orientation = GGO_GRAY4_BITMAP;
 static BOOL antialias_fakes = TRUE;
+static SIZE_T glyph_cache_budget = 16 * 1024 * 1024;
 static struct font_gamma_ramp font_gamma_ramp;
 
 static void add_face_to_cache( struct gdi_font_face *face );
 static void remove_face_from_cache( struct gdi_font_face *face );
+static void invalidate_font_cache_section(void);
 
 static inline WCHAR facename_tolower( WCHAR c )
 {
@@ -1139,6 +1141,8 @@ static void add_face_to_cache( struct gdi_font_face *face )
     DWORD len, buffer[1024];
     struct cached_face *cached = (struct cached_face *)buffer;
 
+    invalidate_font_cache_section();
+
     if (RegCreateKeyExW( wine_fonts_cache_key, face->family->family_name, 0, NULL, REG_OPTION_VOLATILE,
                          KEY_ALL_ACCESS, NULL, &hkey_family, NULL ))
         return;
@@ -1180,6 +1184,8 @@ static void remove_face_from_cache( struct gdi_font_face *face )
 {
     HKEY hkey_family;
 
+    invalidate_font_cache_section();
+
     if (RegOpenKeyExW( wine_fonts_cache_key, face->family->family_name, 0, KEY_ALL_ACCESS, &hkey_family ))
         return;
 
@@ -1194,6 +1200,266 @@ static void remove_face_from_cache( struct gdi_font_face *face )
     RegCloseKey( hkey_family );
 }
 
+/* Snapshot of the registry font cache in a named section, so that processes
+ * can load the font list without enumerating the registry. Each snapshot gets
+ * a new generation number in its name; the current one is recorded in the
+ * registry cache key, and both are dropped as soon as the registry cache is
+ * modified, so that the next process publishes a new snapshot. */
+
+#define FONT_CACHE_MAGIC 0x48434657  /* "WFCH" */
+
+static const WCHAR font_cache_generation_value[] = L"SnapshotGeneration";
+static const WCHAR font_cache_snapshot_value[] = L"Snapshot";
+static const WCHAR font_cache_serial_value[] = L"Serial";
+static HANDLE font_cache_section;
+
+struct font_cache_header
+{
+    DWORD                   magic;
+    DWORD                   size;       /* total size of the cache */
+    LONG                    stale;      /* registry cache modified since the snapshot */
+    DWORD                   count;      /* number of entries */
+};
+
+struct font_cache_entry
+{
+    DWORD                   len;        /* size of the entry, names included */
+    DWORD                   scalable;
+    DWORD                   index;
+    DWORD                   flags;
+    DWORD                   ntmflags;
+    DWORD                   version;
+    struct bitmap_font_size size;
+    FONTSIGNATURE           fs;
+    WCHAR                   names[1];   /* family, second, style, full and file names */
+};
+
+static BOOL is_face_in_cache( const struct gdi_font_face *face )
+{
+    return (face->flags & ADDFONT_ADD_TO_CACHE) && face->file;
+}
+
+static DWORD get_font_cache_entry_size( const struct gdi_font_family *family, const struct gdi_font_face *face )
+{
+    DWORD len = lstrlenW( family->family_name ) + lstrlenW( family->second_name ) +
+                lstrlenW( face->style_name ) + lstrlenW( face->full_name ) + lstrlenW( face->file ) + 5;
+
+    return (offsetof( struct font_cache_entry, names[len] ) + 3) & ~3;
+}
+
+static WCHAR *append_font_cache_name( WCHAR *ptr, const WCHAR *name )
+{
+    DWORD len = lstrlenW( name ) + 1;
+
+    memcpy( ptr, name, len * sizeof(WCHAR) );
+    return ptr + len;
+}
+
+static void get_font_cache_name( WCHAR *name, DWORD len, DWORD generation )
+{
+    swprintf( name, len, L"__wine_font_cache_%u", generation );
+}
+
+/* incremented whenever a face is added to or removed from the registry cache */
+static DWORD get_font_cache_serial(void)
+{
+    DWORD serial, len = sizeof(serial);
+
+    if (RegQueryValueExW( wine_fonts_cache_key, font_cache_serial_value, NULL, NULL, (BYTE *)&serial, &len ))
+        serial = 0;
+    return serial;
+}
+
+static void invalidate_font_cache_section(void)
+{
+    struct font_cache_header *header;
+    DWORD serial = get_font_cache_serial() + 1;
+
+    /* let a process that is building a snapshot from the registry know that it is out of date */
+    RegSetValueExW( wine_fonts_cache_key, font_cache_serial_value, 0, REG_DWORD, (BYTE *)&serial, sizeof(serial) );
+    RegDeleteValueW( wine_fonts_cache_key, font_cache_snapshot_value );
+    if (!font_cache_section) return;
+
+    if ((header = MapViewOfFile( font_cache_section, FILE_MAP_WRITE, 0, 0, sizeof(*header) )))
+    {
+        InterlockedExchange( &header->stale, 1 );
+        UnmapViewOfFile( header );
+    }
+    CloseHandle( font_cache_section );
+    font_cache_section = NULL;
+}
+
+/* must be called with the font mutex held; serial is the cache serial the font list was loaded at */
+static void create_font_cache_section( DWORD serial )
+{
+    struct gdi_font_family *family;
+    struct gdi_font_face *face;
+    struct font_cache_header *header;
+    struct font_cache_entry *entry;
+    DWORD size = sizeof(*header), count = 0, generation, len = sizeof(generation);
+    WCHAR name[64];
+    HANDLE section;
+    WCHAR *ptr;
+
+    /* another process changed the registry cache since we read it */
+    if (get_font_cache_serial() != serial) return;
+
+    WINE_RB_FOR_EACH_ENTRY( family, &family_name_tree, struct gdi_font_family, name_entry )
+    {
+        LIST_FOR_EACH_ENTRY( face, &family->faces, struct gdi_font_face, entry )
+        {
+            if (!is_face_in_cache( face )) continue;
+            size += get_font_cache_entry_size( family, face );
+            count++;
+        }
+    }
+
+    if (RegQueryValueExW( wine_fonts_cache_key, font_cache_generation_value, NULL, NULL, (BYTE *)&generation, &len ))
+        generation = 0;
+    if (!++generation) generation++;
+    RegSetValueExW( wine_fonts_cache_key, font_cache_generation_value, 0, REG_DWORD,
+                    (BYTE *)&generation, sizeof(generation) );
+
+    get_font_cache_name( name, ARRAY_SIZE(name), generation );
+    if (!(section = CreateFileMappingW( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name )))
+        return;
+    if (GetLastError() == ERROR_ALREADY_EXISTS || !(header = MapViewOfFile( section, FILE_MAP_WRITE, 0, 0, size )))
+    {
+        CloseHandle( section );
+        return;
+    }
+
+    header->magic = FONT_CACHE_MAGIC;
+    header->size  = size;
+    header->stale = 0;
+    header->count = count;
+
+    entry = (struct font_cache_entry *)(header + 1);
+    WINE_RB_FOR_EACH_ENTRY( family, &family_name_tree, struct gdi_font_family, name_entry )
+    {
+        LIST_FOR_EACH_ENTRY( face, &family->faces, struct gdi_font_face, entry )
+        {
+            if (!is_face_in_cache( face )) continue;
+            entry->len      = get_font_cache_entry_size( family, face );
+            entry->scalable = face->scalable;
+            entry->index    = face->face_index;
+            entry->flags    = face->flags;
+            entry->ntmflags = face->ntmFlags;
+            entry->version  = face->version;
+            entry->size     = face->size;
+            entry->fs       = face->fs;
+            ptr = append_font_cache_name( entry->names, family->family_name );
+            ptr = append_font_cache_name( ptr, family->second_name );
+            ptr = append_font_cache_name( ptr, face->style_name );
+            ptr = append_font_cache_name( ptr, face->full_name );
+            append_font_cache_name( ptr, face->file );
+            entry = (struct font_cache_entry *)((char *)entry + entry->len);
+        }
+    }
+
+    UnmapViewOfFile( header );
+    TRACE( "created font cache %u with %u faces, %u bytes\n", generation, count, size );
+    font_cache_section = section;
+    RegSetValueExW( wine_fonts_cache_key, font_cache_snapshot_value, 0, REG_DWORD,
+                    (BYTE *)&generation, sizeof(generation) );
+
+    /* writers don't take the font mutex, withdraw the snapshot if one raced with the check above */
+    if (get_font_cache_serial() != serial) invalidate_font_cache_section();
+}
+
+static const WCHAR *get_font_cache_name_end( const WCHAR *name, const WCHAR *end )
+{
+    while (name < end && *name) name++;
+    return name < end ? name + 1 : NULL;
+}
+
+/* check that the entries and their names lie within the section */
+static BOOL validate_font_cache( const struct font_cache_header *header, SIZE_T size )
+{
+    const char *ptr = (const char *)(header + 1), *end;
+    const struct font_cache_entry *entry;
+    const WCHAR *name;
+    DWORD i, j;
+
+    if (size < sizeof(*header) || header->magic != FONT_CACHE_MAGIC) return FALSE;
+    if (header->size < sizeof(*header) || header->size > size) return FALSE;
+    end = (const char *)header + header->size;
+
+    for (i = 0; i < header->count; i++, ptr += entry->len)
+    {
+        entry = (const struct font_cache_entry *)ptr;
+        if (end - ptr < offsetof( struct font_cache_entry, names )) return FALSE;
+        if (entry->len < offsetof( struct font_cache_entry, names ) || entry->len > end - ptr) return FALSE;
+        if (entry->len % sizeof(DWORD)) return FALSE;
+
+        name = entry->names;
+        for (j = 0; j < 5 && name; j++)
+            name = get_font_cache_name_end( name, (const WCHAR *)(ptr + entry->len) );
+        if (!name) return FALSE;
+    }
+    return TRUE;
+}
+
+/* must be called with the font mutex held */
+static const struct font_cache_header *map_font_cache_section( HANDLE *ret )
+{
+    const struct font_cache_header *header;
+    MEMORY_BASIC_INFORMATION info;
+    DWORD generation, len = sizeof(generation);
+    WCHAR name[64];
+    HANDLE section;
+
+    if (RegQueryValueExW( wine_fonts_cache_key, font_cache_snapshot_value, NULL, NULL, (BYTE *)&generation, &len ))
+        return NULL;
+
+    get_font_cache_name( name, ARRAY_SIZE(name), generation );
+    if (!(section = OpenFileMappingW( FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name ))) return NULL;
+
+    if ((header = MapViewOfFile( section, FILE_MAP_READ, 0, 0, 0 )))
+    {
+        if (!VirtualQuery( header, &info, sizeof(info) ) || !validate_font_cache( header, info.RegionSize ))
+            WARN( "ignoring invalid font cache %s\n", debugstr_w(name) );
+        else if (!header->stale)
+        {
+            *ret = section;
+            return header;
+        }
+        UnmapViewOfFile( header );
+    }
+    CloseHandle( section );
+    return NULL;
+}
+
+static void load_font_list_from_section( const struct font_cache_header *header )
+{
+    const struct font_cache_entry *entry = (const struct font_cache_entry *)(header + 1);
+    struct gdi_font_family *family = NULL;
+    struct gdi_font_face *face;
+    DWORD i;
+
+    for (i = 0; i < header->count; i++, entry = (const struct font_cache_entry *)((const char *)entry + entry->len))
+    {
+        const WCHAR *family_name = entry->names;
+        const WCHAR *second_name = family_name + lstrlenW( family_name ) + 1;
+        const WCHAR *style = second_name + lstrlenW( second_name ) + 1;
+        const WCHAR *full_name = style + lstrlenW( style ) + 1;
+        const WCHAR *file = full_name + lstrlenW( full_name ) + 1;
+
+        /* entries are grouped by family */
+        if (!family || wcscmp( family->family_name, family_name ))
+        {
+            if (family) release_family( family );
+            family = create_family( family_name, second_name );
+        }
+
+        if ((face = create_face( family, style, full_name, file, NULL, 0, entry->index, entry->fs,
+                                 entry->ntmflags, entry->version, entry->flags,
+                                 entry->scalable ? NULL : &entry->size )))
+            release_face( face );
+    }
+    if (family) release_family( family );
+}
+
 /* font links */
 
 struct gdi_font_link
@@ -3977,6 +4243,10 @@ static void init_font_options(void)
         antialias_fakes = (wcschr(L"yYtT1", buffer[0]) != NULL);
     }
 
+    /* memory budget of the glyph bitmaps cached by the DIB engine, in kilobytes */
+    if (!get_key_value( wine_fonts_key, L"GlyphCacheSize", &val ))
+        glyph_cache_budget = (SIZE_T)val * 1024;
+
     if (!RegOpenKeyW( HKEY_CURRENT_USER, L"Control Panel\\Desktop", &key ))
     {
         /* FIXME: handle vertical orientations even though Windows doesn't */
@@ -4023,6 +4293,12 @@ static void init_font_options(void)
 }
 
 
+/* maximum size of the glyph bitmaps cached by the DIB engine */
+SIZE_T get_glyph_cache_budget(void)
+{
+    return glyph_cache_budget;
+}
+
 static void FONT_LogFontAToW( const LOGFONTA *fontA, LPLOGFONTW fontW )
 {
     memcpy(fontW, fontA, sizeof(LOGFONTA) - LF_FACESIZE);
@@ -7982,8 +8258,9 @@ static const struct font_callback_funcs callback_funcs = { add_gdi_face };
  */
 void font_init(void)
 {
-    HANDLE mutex;
-    DWORD disposition;
+    const struct font_cache_header *cache = NULL;
+    HANDLE mutex, section = NULL;
+    DWORD disposition, serial = 0;
 
     if (RegCreateKeyExW( HKEY_CURRENT_USER, L"Software\\Wine\\Fonts", 0, NULL, 0,
                          KEY_ALL_ACCESS, NULL, &wine_fonts_key, NULL ))
@@ -8007,14 +8284,28 @@ void font_init(void)
     {
         load_registry_fonts();
         update_external_font_keys();
+        create_font_cache_section( get_font_cache_serial() );
     }
+    else if (!(cache = map_font_cache_section( &section ))) serial = get_font_cache_serial();
 
     ReleaseMutex( mutex );
 
     if (disposition != REG_CREATED_NEW_KEY)
     {
         load_registry_fonts();
-        load_font_list_from_cache();
+        if (cache)
+        {
+            load_font_list_from_section( cache );
+            UnmapViewOfFile( cache );
+            font_cache_section = section;
+        }
+        else
+        {
+            load_font_list_from_cache();
+            WaitForSingleObject( mutex, INFINITE );
+            create_font_cache_section( serial );
+            ReleaseMutex( mutex );
+        }
     }
 
     reorder_font_list();
@@ -413,6 +413,7 @@ struct font_callback_funcs
 };
 
 extern void font_init(void) DECLSPEC_HIDDEN;
+extern SIZE_T get_glyph_cache_budget(void) DECLSPEC_HIDDEN;
 
 /* opentype.c */
 
@@ -168,6 +168,12 @@ static inline void empty_region( WINEREGION *reg )
     reg->extents.left = reg->extents.top = reg->extents.right = reg->extents.bottom = 0;
 }
 
+static inline BOOL contains_rect( const RECT *outer, const RECT *inner )
+{
+    return (outer->left <= inner->left && outer->top <= inner->top &&
+            outer->right >= inner->right && outer->bottom >= inner->bottom);
+}
+
 static inline BOOL is_in_rect( const RECT *rect, int x, int y )
 {
     return (rect->right > x && rect->left <= x && rect->bottom > y && rect->top <= y);
@@ -1062,7 +1068,7 @@ BOOL WINAPI RectInRegion( HRGN hrgn, const RECT *rect )
     WINEREGION *obj;
     BOOL ret = FALSE;
     RECT rc;
-    int i;
+    int i, y;
 
     /* swap the coordinates to make right >= left and bottom >= top */
     /* (region building rectangles are normalized the same way) */
@@ -1073,21 +1079,19 @@ BOOL WINAPI RectInRegion( HRGN hrgn, const RECT *rect )
     {
 	if ((obj->numRects > 0) && overlapping(&obj->extents, &rc))
 	{
-	    for (i = region_find_pt( obj, rc.left, rc.top, &ret ); !ret && i < obj->numRects; i++ )
+	    /* only look at the first rectangle right of rc.left in each band */
+	    for (y = rc.top; !ret && y < rc.bottom; )
 	    {
-	        if (obj->rects[i].bottom <= rc.top)
-		    continue;             /* not far enough down yet */
-
-		if (obj->rects[i].top >= rc.bottom)
-		    break;                /* too far down */
-
-		if (obj->rects[i].right <= rc.left)
-		    continue;              /* not far enough over yet */
-
-		if (obj->rects[i].left >= rc.right)
-		    continue;
-
-		ret = TRUE;
+	        i = region_find_pt( obj, rc.left, y, &ret );
+	        if (ret || i == obj->numRects) break;
+
+	        if (obj->rects[i].top > y)
+	        {
+	            y = obj->rects[i].top;  /* nothing left in this band, skip to the next one */
+	            continue;
+	        }
+	        ret = obj->rects[i].left < rc.right;
+	        y = obj->rects[i].bottom;
 	    }
 	}
 	GDI_ReleaseObj(hrgn);
@@ -1929,6 +1933,11 @@ static BOOL REGION_IntersectRegion(WINEREGION *newReg, WINEREGION *reg1,
     if ( (!(reg1->numRects)) || (!(reg2->numRects))  ||
 	(!overlapping(&reg1->extents, &reg2->extents)))
 	newReg->numRects = 0;
+    /* one of the regions is a single rectangle covering the other one */
+    else if (reg2->numRects == 1 && contains_rect( &reg2->extents, &reg1->extents ))
+	return REGION_CopyRegion(newReg, reg1);
+    else if (reg1->numRects == 1 && contains_rect( &reg1->extents, &reg2->extents ))
+	return REGION_CopyRegion(newReg, reg2);
     else
 	if (!REGION_RegionOp (newReg, reg1, reg2, REGION_IntersectO, NULL, NULL)) return FALSE;
 
@@ -2031,6 +2040,33 @@ static BOOL REGION_UnionO (WINEREGION *pReg, RECT *r1, RECT *r1End,
 #undef MERGERECT
 }
 
+/***********************************************************************
+ *	     REGION_AppendRegion
+ *
+ *      Append the bands of src to dst, in place. src must lie entirely
+ *      below dst; the adjoining bands are coalesced if possible.
+ */
+static BOOL REGION_AppendRegion( WINEREGION *dst, const WINEREGION *src )
+{
+    INT prevStart, curStart = dst->numRects;
+
+    if (dst->numRects + src->numRects > dst->size &&
+        !grow_region( dst, max( dst->numRects + src->numRects, 2 * dst->size ) ))
+        return FALSE;
+
+    memcpy( dst->rects + curStart, src->rects, src->numRects * sizeof(RECT) );
+    dst->numRects += src->numRects;
+
+    for (prevStart = curStart - 1; prevStart > 0; prevStart--)
+        if (dst->rects[prevStart - 1].top != dst->rects[curStart - 1].top) break;
+    REGION_Coalesce( dst, prevStart, curStart );
+
+    dst->extents.left = min( dst->extents.left, src->extents.left );
+    dst->extents.right = max( dst->extents.right, src->extents.right );
+    dst->extents.bottom = src->extents.bottom;
+    return TRUE;
+}
+
 /***********************************************************************
  *	     REGION_UnionRegion
  */
@@ -2088,6 +2124,22 @@ static BOOL REGION_UnionRegion(WINEREGION *newReg, WINEREGION *reg1, WINEREGION
 	return ret;
     }
 
+    /*
+     * One region lies entirely below the other, so its bands can simply be
+     * appended without going through REGION_RegionOp. This is the common
+     * case when a region is built one scanline at a time.
+     */
+    if (reg2->extents.top >= reg1->extents.bottom && newReg != reg2)
+    {
+        if (newReg != reg1 && !REGION_CopyRegion(newReg, reg1)) return FALSE;
+        return REGION_AppendRegion(newReg, reg2);
+    }
+    if (reg1->extents.top >= reg2->extents.bottom && newReg != reg1)
+    {
+        if (newReg != reg2 && !REGION_CopyRegion(newReg, reg2)) return FALSE;
+        return REGION_AppendRegion(newReg, reg1);
+    }
+
     if ((ret = REGION_RegionOp (newReg, reg1, reg2, REGION_UnionO, REGION_UnionNonO, REGION_UnionNonO)))
     {
         newReg->extents.left = min(reg1->extents.left, reg2->extents.left);
@@ -2253,6 +2305,13 @@ static BOOL REGION_SubtractRegion(WINEREGION *regD, WINEREGION *regM, WINEREGION
 	(!overlapping(&regM->extents, &regS->extents)) )
 	return REGION_CopyRegion(regD, regM);
 
+    /* a single rectangle covering the minuend removes everything */
+    if (regS->numRects == 1 && contains_rect( &regS->extents, &regM->extents ))
+    {
+        empty_region( regD );
+        return TRUE;
+    }
+
     if (!REGION_RegionOp (regD, regM, regS, REGION_SubtractO, REGION_SubtractNonO1, NULL))
         return FALSE;
 
@@ -319,6 +319,79 @@ static void test_region(void)
     DeleteObject(hrgn);
 }
 
+static void test_region_bands(void)
+{
+    HRGN hrgn, row, tmp;
+    RGNDATA *data;
+    RECT rc;
+    DWORD size;
+    BOOL ret;
+    int i, type;
+
+    /* build the region one scanline at a time, identical rows get coalesced */
+    hrgn = CreateRectRgn( 0, 0, 0, 0 );
+    for (i = 0; i < 10; i++)
+    {
+        row = CreateRectRgn( 0, i, 10, i + 1 );
+        type = CombineRgn( hrgn, hrgn, row, RGN_OR );
+        ok( type == SIMPLEREGION, "%d: got type %d\n", i, type );
+        DeleteObject( row );
+    }
+    GetRgnBox( hrgn, &rc );
+    ok( rc.left == 0 && rc.top == 0 && rc.right == 10 && rc.bottom == 10, "got %s\n", wine_dbgstr_rect(&rc) );
+
+    /* two spans per row, with a gap between the bands */
+    for (i = 20; i < 30; i++)
+    {
+        row = CreateRectRgn( 0, i, 10, i + 1 );
+        tmp = CreateRectRgn( 20, i, 30, i + 1 );
+        CombineRgn( row, row, tmp, RGN_OR );
+        /* union in the other direction, the row ends up below */
+        type = CombineRgn( hrgn, row, hrgn, RGN_OR );
+        ok( type == COMPLEXREGION, "%d: got type %d\n", i, type );
+        DeleteObject( tmp );
+        DeleteObject( row );
+    }
+    size = GetRegionData( hrgn, 0, NULL );
+    data = HeapAlloc( GetProcessHeap(), 0, size );
+    GetRegionData( hrgn, size, data );
+    ok( data->rdh.nCount == 3, "got %u rects\n", data->rdh.nCount );
+    HeapFree( GetProcessHeap(), 0, data );
+    GetRgnBox( hrgn, &rc );
+    ok( rc.left == 0 && rc.top == 0 && rc.right == 30 && rc.bottom == 30, "got %s\n", wine_dbgstr_rect(&rc) );
+
+    SetRect( &rc, 12, 0, 18, 30 );
+    ret = RectInRegion( hrgn, &rc );
+    ok( !ret, "RectInRegion should return FALSE\n" );
+    SetRect( &rc, 12, 10, 40, 20 );
+    ret = RectInRegion( hrgn, &rc );
+    ok( !ret, "RectInRegion should return FALSE\n" );
+    SetRect( &rc, 12, 5, 40, 21 );
+    ret = RectInRegion( hrgn, &rc );
+    ok( ret, "RectInRegion should return TRUE\n" );
+    SetRect( &rc, 15, 15, 20, 21 );
+    ret = RectInRegion( hrgn, &rc );
+    ok( !ret, "RectInRegion should return FALSE\n" );
+    SetRect( &rc, 29, 29, 35, 35 );
+    ret = RectInRegion( hrgn, &rc );
+    ok( ret, "RectInRegion should return TRUE\n" );
+
+    /* a single covering rectangle */
+    row = CreateRectRgn( -5, -5, 35, 35 );
+    tmp = CreateRectRgn( 0, 0, 0, 0 );
+    type = CombineRgn( tmp, hrgn, row, RGN_AND );
+    ok( type == COMPLEXREGION, "got type %d\n", type );
+    ok( EqualRgn( tmp, hrgn ), "regions differ\n" );
+    type = CombineRgn( tmp, row, hrgn, RGN_AND );
+    ok( type == COMPLEXREGION, "got type %d\n", type );
+    ok( EqualRgn( tmp, hrgn ), "regions differ\n" );
+    type = CombineRgn( tmp, hrgn, row, RGN_DIFF );
+    ok( type == NULLREGION, "got type %d\n", type );
+    DeleteObject( tmp );
+    DeleteObject( row );
+    DeleteObject( hrgn );
+}
+
 static void test_handles_on_win64(void)
 {
     int i;
@@ -368,5 +441,6 @@ START_TEST(gdiobj)
     test_thread_objects();
     test_GetCurrentObject();
     test_region();
+    test_region_bands();
     test_handles_on_win64();
 }
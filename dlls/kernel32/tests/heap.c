@@ -889,6 +889,133 @@ static void test_HeapQueryInformation(void)
     ok(info == 0 || info == 1 || info == 2, "expected 0, 1 or 2, got %u\n", info);
 }
 
+static DWORD WINAPI lfh_thread( void *arg )
+{
+    HANDLE heap = arg;
+    BYTE *ptrs[64];
+    DWORD i, j;
+
+    for (i = 0; i < 200; i++)
+    {
+        for (j = 0; j < ARRAY_SIZE(ptrs); j++)
+        {
+            if (!(ptrs[j] = HeapAlloc( heap, 0, 8 + (i * 7 + j * 13) % 1000 ))) return 1;
+            memset( ptrs[j], j, 8 );
+        }
+        for (j = 0; j < ARRAY_SIZE(ptrs); j++)
+        {
+            if (ptrs[j][0] != j || ptrs[j][7] != j) return 2;
+            if (!HeapFree( heap, 0, ptrs[j] )) return 3;
+        }
+    }
+    return 0;
+}
+
+static void test_low_fragmentation_heap(void)
+{
+    PROCESS_HEAP_ENTRY entry;
+    HANDLE heap, threads[4];
+    BYTE *ptrs[100], *p;
+    DWORD i, j, code;
+    SIZE_T size;
+    ULONG info;
+    BOOL ret;
+
+    heap = HeapCreate( HEAP_NO_SERIALIZE, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed\n" );
+    info = 2;
+    ret = HeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( !ret, "HeapSetInformation succeeded on a non-serialized heap\n" );
+    HeapDestroy( heap );
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed\n" );
+    info = 2;
+    ret = HeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    if (!ret)
+    {
+        win_skip( "low-fragmentation heap not available\n" );
+        HeapDestroy( heap );
+        return;
+    }
+
+    info = 0xdeadbeef;
+    ret = HeapQueryInformation( heap, HeapCompatibilityInformation, &info, sizeof(info), NULL );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( info == 2, "expected 2, got %u\n", info );
+
+    for (i = 0; i < ARRAY_SIZE(ptrs); i++)
+    {
+        ptrs[i] = HeapAlloc( heap, HEAP_ZERO_MEMORY, i * 11 );
+        ok( ptrs[i] != NULL, "%u: HeapAlloc failed\n", i );
+        size = HeapSize( heap, 0, ptrs[i] );
+        ok( size == i * 11, "%u: wrong size %lu\n", i, size );
+        for (j = 0; j < i * 11; j++) if (ptrs[i][j]) break;
+        ok( j == i * 11, "%u: block not zeroed at %u\n", i, j );
+        memset( ptrs[i], i, i * 11 );
+    }
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+
+    for (i = 0; i < ARRAY_SIZE(ptrs); i += 2)
+    {
+        ret = HeapFree( heap, 0, ptrs[i] );
+        ok( ret, "%u: HeapFree failed\n", i );
+    }
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+
+    memset( &entry, 0, sizeof(entry) );
+    SetLastError( 0xdeadbeef );
+    while (HeapWalk( heap, &entry )) ;
+    ok( GetLastError() == ERROR_NO_MORE_ITEMS, "HeapWalk failed with error %u\n", GetLastError() );
+
+    for (i = 1; i < ARRAY_SIZE(ptrs); i += 2)
+    {
+        p = HeapReAlloc( heap, 0, ptrs[i], i * 11 + 2000 );
+        ok( p != NULL, "%u: HeapReAlloc failed\n", i );
+        ok( p[0] == (BYTE)i && p[i * 11 - 1] == (BYTE)i, "%u: wrong data after HeapReAlloc\n", i );
+        size = HeapSize( heap, 0, p );
+        ok( size == i * 11 + 2000, "%u: wrong size %lu\n", i, size );
+        ret = HeapFree( heap, 0, p );
+        ok( ret, "%u: HeapFree failed\n", i );
+    }
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+
+    /* allocations still work while the heap is locked */
+    ret = HeapLock( heap );
+    ok( ret, "HeapLock failed\n" );
+    p = HeapAlloc( heap, 0, 24 );
+    ok( p != NULL, "HeapAlloc failed\n" );
+    ret = HeapFree( heap, 0, p );
+    ok( ret, "HeapFree failed\n" );
+    memset( &entry, 0, sizeof(entry) );
+    SetLastError( 0xdeadbeef );
+    while (HeapWalk( heap, &entry )) ;
+    ok( GetLastError() == ERROR_NO_MORE_ITEMS, "HeapWalk failed with error %u\n", GetLastError() );
+    ret = HeapUnlock( heap );
+    ok( ret, "HeapUnlock failed\n" );
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+    {
+        threads[i] = CreateThread( NULL, 0, lfh_thread, heap, 0, NULL );
+        ok( threads[i] != NULL, "CreateThread failed\n" );
+    }
+    WaitForMultipleObjects( ARRAY_SIZE(threads), threads, TRUE, INFINITE );
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+    {
+        GetExitCodeThread( threads[i], &code );
+        ok( !code, "%u: thread failed with %u\n", i, code );
+        CloseHandle( threads[i] );
+    }
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+
+    info = 0;
+    ret = HeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( !ret, "low-fragmentation heap shouldn't be disabled\n" );
+
+    HeapDestroy( heap );
+}
+
 static void test_heap_checks( DWORD flags )
 {
     BYTE old, *p, *p2;
@@ -1296,6 +1423,7 @@ START_TEST(heap)
     test_sized_HeapReAlloc((1 << 20), 1);
 
     test_HeapQueryInformation();
+    test_low_fragmentation_heap();
     test_GetPhysicallyInstalledSystemMemory();
     test_GlobalMemoryStatus();
 
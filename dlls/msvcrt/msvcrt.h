@@ -35,6 +35,19 @@
 
 extern BOOL sse2_supported DECLSPEC_HIDDEN;
 
+/* SSE2 versions of the string functions; on i386 they are only used when the CPU supports it */
+#if defined(__x86_64__) || (defined(__i386__) && defined(__GNUC__))
+#include <x86intrin.h>
+#define HAVE_SSE2_FUNCS
+#ifdef __i386__
+#define SSE2_FUNC __attribute__((target("sse2")))
+#define use_sse2() sse2_supported
+#else
+#define SSE2_FUNC
+#define use_sse2() TRUE
+#endif
+#endif
+
 #define DBL80_MAX_10_EXP 4932
 #define DBL80_MIN_10_EXP -4951
 
@@ -1501,12 +1501,37 @@ int CDECL _atoldbl(_LDOUBLE *value, char *str)
     return _atoldbl_l( (MSVCRT__LDOUBLE*)value, str, NULL );
 }
 
+#ifdef HAVE_SSE2_FUNCS
+/* The SSE2 string functions only do aligned 16-byte loads, so they may read
+ * past the end of the string but never into the next page. */
+static SSE2_FUNC size_t sse2_strlen(const char *str)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const char *p = (const char *)((ULONG_PTR)str & ~15);
+    DWORD mask, idx;
+
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), zero));
+    mask &= ~0u << (str - p);
+    while (!mask)
+    {
+        p += 16;
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), zero));
+    }
+    BitScanForward(&idx, mask);
+    return p + idx - str;
+}
+#endif
+
 /*********************************************************************
  *              strlen (MSVCRT.@)
  */
 size_t __cdecl strlen(const char *str)
 {
     const char *s = str;
+
+#ifdef HAVE_SSE2_FUNCS
+    if (use_sse2()) return sse2_strlen(str);
+#endif
     while (*s) s++;
     return s - str;
 }
@@ -2859,11 +2884,60 @@ void* __cdecl memset(void *dst, int c, size_t n)
     return dst;
 }
 
+#ifdef HAVE_SSE2_FUNCS
+static SSE2_FUNC char *sse2_strchr(const char *str, int c)
+{
+    const __m128i zero = _mm_setzero_si128(), chr = _mm_set1_epi8(c);
+    const char *p = (const char *)((ULONG_PTR)str & ~15);
+    DWORD mask_chr, mask_end, idx;
+    __m128i v;
+
+    v = _mm_load_si128((const __m128i *)p);
+    mask_chr = _mm_movemask_epi8(_mm_cmpeq_epi8(v, chr)) & (~0u << (str - p));
+    mask_end = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & (~0u << (str - p));
+    while (!mask_chr && !mask_end)
+    {
+        p += 16;
+        v = _mm_load_si128((const __m128i *)p);
+        mask_chr = _mm_movemask_epi8(_mm_cmpeq_epi8(v, chr));
+        mask_end = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+    }
+    BitScanForward(&idx, mask_chr | mask_end);
+    return mask_chr & (1 << idx) ? (char *)p + idx : NULL;
+}
+
+static SSE2_FUNC void *sse2_memchr(const void *ptr, int c, size_t n)
+{
+    const __m128i chr = _mm_set1_epi8(c);
+    const unsigned char *p = (const unsigned char *)((ULONG_PTR)ptr & ~15), *end;
+    DWORD mask, idx;
+
+    if (!n) return NULL;
+    /* some callers pass a huge length to search an unbounded buffer */
+    if (n > ~(ULONG_PTR)ptr) end = (const unsigned char *)~(ULONG_PTR)0;
+    else end = (const unsigned char *)ptr + n;
+
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), chr));
+    mask &= ~0u << ((const unsigned char *)ptr - p);
+    while (!mask)
+    {
+        p += 16;
+        if (p >= end) return NULL;
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), chr));
+    }
+    BitScanForward(&idx, mask);
+    return p + idx < end ? (void *)(ULONG_PTR)(p + idx) : NULL;
+}
+#endif
+
 /*********************************************************************
  *		    strchr (MSVCRT.@)
  */
 char* __cdecl strchr(const char *str, int c)
 {
+#ifdef HAVE_SSE2_FUNCS
+    if (use_sse2()) return sse2_strchr(str, c);
+#endif
     do
     {
         if (*str == (char)c) return (char*)str;
@@ -2888,6 +2962,9 @@ void* __cdecl memchr(const void *ptr, int c, size_t n)
 {
     const unsigned char *p = ptr;
 
+#ifdef HAVE_SSE2_FUNCS
+    if (use_sse2()) return sse2_memchr(ptr, c, n);
+#endif
     for (p = ptr; n; n--, p++) if (*p == (unsigned char)c) return (void *)(ULONG_PTR)p;
     return NULL;
 }
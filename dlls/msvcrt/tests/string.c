@@ -4477,6 +4477,64 @@ static void test_wcsncpy(void)
             wine_dbgstr_wn(dst, ARRAY_SIZE(dst)));
 }
 
+static void test_page_boundary(void)
+{
+    char *mem, *end, *str;
+    wchar_t *wstr;
+    DWORD old_prot;
+    size_t len, ret;
+    BOOL success;
+    void *p;
+
+    /* make sure nothing is read past the end of the page */
+    mem = VirtualAlloc(NULL, 0x2000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    ok(mem != NULL, "VirtualAlloc failed %u\n", GetLastError());
+    success = VirtualProtect(mem + 0x1000, 0x1000, PAGE_NOACCESS, &old_prot);
+    ok(success, "VirtualProtect failed %u\n", GetLastError());
+    end = mem + 0x1000;
+
+    for (len = 0; len < 64; len++)
+    {
+        memset(mem, 'a', 0x1000);
+        str = end - len - 1;
+        str[len] = 0;
+
+        ret = strlen(str);
+        ok(ret == len, "%d: strlen returned %d\n", (int)len, (int)ret);
+        p = strchr(str, 'b');
+        ok(!p, "%d: strchr returned %p\n", (int)len, p);
+        p = strchr(str, 0);
+        ok(p == str + len, "%d: strchr returned %p, expected %p\n", (int)len, p, str + len);
+        if (len)
+        {
+            str[len - 1] = 'b';
+            p = strchr(str, 'b');
+            ok(p == str + len - 1, "%d: strchr returned %p, expected %p\n", (int)len, p, str + len - 1);
+        }
+
+        memset(mem, 'a', 0x1000);
+        str = end - len;
+        p = memchr(str, 0, len);
+        ok(!p, "%d: memchr returned %p\n", (int)len, p);
+        if (len)
+        {
+            p = memchr(str, 'b', len - 1);
+            ok(!p, "%d: memchr returned %p\n", (int)len, p);
+            str[len - 1] = 'b';
+            p = memchr(str, 'b', len);
+            ok(p == str + len - 1, "%d: memchr returned %p, expected %p\n", (int)len, p, str + len - 1);
+        }
+
+        wstr = (wchar_t *)end - len - 1;
+        wmemset(wstr, 'a', len);
+        wstr[len] = 0;
+        ret = wcslen(wstr);
+        ok(ret == len, "%d: wcslen returned %d\n", (int)len, (int)ret);
+    }
+
+    VirtualFree(mem, 0, MEM_RELEASE);
+}
+
 START_TEST(string)
 {
     char mem[100];
@@ -4633,4 +4691,5 @@ START_TEST(string)
     test_SpecialCasing();
     test__mbbtype();
     test_wcsncpy();
+    test_page_boundary();
 }
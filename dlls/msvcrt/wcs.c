@@ -2833,12 +2833,37 @@ wchar_t* CDECL wcsrchr(const wchar_t *str, wchar_t ch)
     return ret;
 }
 
+#ifdef HAVE_SSE2_FUNCS
+/* only aligned 16-byte loads are done, so this never reads into the next page */
+static SSE2_FUNC size_t sse2_wcslen(const wchar_t *str)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const char *p = (const char *)((ULONG_PTR)str & ~15);
+    DWORD mask, idx;
+
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_load_si128((const __m128i *)p), zero));
+    mask &= ~0u << ((const char *)str - p);
+    while (!mask)
+    {
+        p += 16;
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_load_si128((const __m128i *)p), zero));
+    }
+    BitScanForward(&idx, mask);
+    return (p + idx - (const char *)str) / sizeof(wchar_t);
+}
+#endif
+
 /***********************************************************************
  *              wcslen (MSVCRT.@)
  */
 size_t CDECL wcslen(const wchar_t *str)
 {
     const wchar_t *s = str;
+
+#ifdef HAVE_SSE2_FUNCS
+    /* the 16-bit lanes only line up with the characters if the string is aligned */
+    if (use_sse2() && !((ULONG_PTR)str & 1)) return sse2_wcslen(str);
+#endif
     while (*s) s++;
     return s - str;
 }
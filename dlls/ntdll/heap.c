@@ -76,6 +76,8 @@ typedef struct
 /* Value for arena 'magic' field */
 #define ARENA_INUSE_MAGIC      0x455355
 #define ARENA_PENDING_MAGIC    0xbedead
+#define ARENA_LFH_MAGIC        0x48464c    /* in use, allocated from the low-fragmentation heap */
+#define ARENA_LFH_FREE_MAGIC   0x68666c    /* free, cached by the low-fragmentation heap */
 #define ARENA_FREE_MAGIC       0x45455246
 #define ARENA_LARGE_MAGIC      0x6752614c
 
@@ -125,6 +127,41 @@ typedef union
     void       *alignment[4];
 } FREE_LIST_ENTRY;
 
+/* The low-fragmentation heap keeps freed blocks of small sizes in per-size class caches, */
+/* instead of returning them to the free lists. The caches are split in stripes that are */
+/* shared between threads, each one protected by its own spin lock, so that most small */
+/* allocations and frees don't need to enter the heap critical section. The sub-heaps that */
+/* blocks are split from are recorded, so that freed pointers can be checked without the */
+/* heap lock; those sub-heaps are never released. */
+#define LFH_NB_STRIPES       16      /* number of cache stripes */
+#define LFH_NB_CLASSES       24      /* number of size classes */
+#define LFH_MAX_DATA_SIZE    0x400   /* largest block data size managed by the LFH */
+#define LFH_SLAB_SIZE        0x4000  /* size of the chunks split into blocks of a class */
+#define LFH_SLAB_BLOCKS      32      /* max number of blocks split from a chunk */
+#define LFH_MAX_CACHED       64      /* max number of cached blocks per stripe and class */
+#define LFH_MAX_SUBHEAPS     64      /* max number of recorded sub-heaps */
+
+struct lfh_bin
+{
+    ARENA_INUSE *head;       /* list of cached blocks, linked through their data */
+    ULONG        count;      /* number of blocks in the list */
+};
+
+struct lfh_stripe
+{
+    LONG           lock;     /* spin lock protecting the bins */
+    struct lfh_bin bins[LFH_NB_CLASSES];
+};
+
+struct tagSUBHEAP;
+
+struct lfh_heap
+{
+    struct lfh_stripe  stripes[LFH_NB_STRIPES];
+    struct tagSUBHEAP *subheaps[LFH_MAX_SUBHEAPS];  /* sub-heaps holding blocks of the LFH */
+    LONG               nb_subheaps;                 /* number of recorded sub-heaps */
+};
+
 struct tagHEAP;
 
 typedef struct tagSUBHEAP
@@ -163,6 +200,8 @@ typedef struct tagHEAP
     ARENA_INUSE    **pending_free;  /* Ring buffer for pending free requests */
     RTL_CRITICAL_SECTION critSection; /* Critical section for serialization */
     FREE_LIST_ENTRY *freeList;      /* Free lists */
+    struct lfh_heap *lfh;           /* Low-fragmentation heap caches, if enabled */
+    LONG             locked;        /* Number of RtlLockHeap calls in effect, the LFH caches aren't used then */
 } HEAP;
 
 #define HEAP_MAGIC       ((DWORD)('H' | ('E'<<8) | ('A'<<16) | ('P'<<24)))
@@ -294,8 +333,10 @@ static void subheap_notify_free_all(SUBHEAP const *subheap)
         else
         {
             ARENA_INUSE const *pArena = (ARENA_INUSE const *)ptr;
-            if (pArena->magic == ARENA_INUSE_MAGIC) notify_free(pArena + 1);
-            else if (pArena->magic != ARENA_PENDING_MAGIC) ERR("bad inuse_magic @%p\n", pArena);
+            if (pArena->magic == ARENA_INUSE_MAGIC || pArena->magic == ARENA_LFH_MAGIC)
+                notify_free(pArena + 1);
+            else if (pArena->magic != ARENA_PENDING_MAGIC && pArena->magic != ARENA_LFH_FREE_MAGIC)
+                ERR("bad inuse_magic @%p\n", pArena);
             ptr += sizeof(*pArena) + (pArena->size & ARENA_SIZE_MASK);
         }
     }
@@ -386,7 +427,9 @@ static void HEAP_Dump( HEAP *heap )
             {
                 ARENA_INUSE *pArena = (ARENA_INUSE *)ptr;
                 TRACE( "%p %08x %s %08x\n",
-                         pArena, pArena->magic, pArena->magic == ARENA_INUSE_MAGIC ? "used" : "pend",
+                         pArena, pArena->magic, pArena->magic == ARENA_INUSE_MAGIC ? "used" :
+                         pArena->magic == ARENA_LFH_MAGIC ? "lfh " :
+                         pArena->magic == ARENA_LFH_FREE_MAGIC ? "lfhf" : "pend",
                          pArena->size & ARENA_SIZE_MASK );
                 ptr += sizeof(*pArena) + (pArena->size & ARENA_SIZE_MASK);
                 arenaSize += sizeof(ARENA_INUSE);
@@ -624,6 +667,21 @@ static void HEAP_CreateFreeBlock( SUBHEAP *subheap, void *ptr, SIZE_T size )
 }
 
 
+/***********************************************************************
+ *           lfh_is_recorded_subheap
+ *
+ * Check if the LFH may look up a sub-heap without holding the heap lock.
+ */
+static BOOL lfh_is_recorded_subheap( const HEAP *heap, const SUBHEAP *subheap )
+{
+    LONG i;
+
+    if (!heap->lfh) return FALSE;
+    for (i = 0; i < heap->lfh->nb_subheaps; i++) if (heap->lfh->subheaps[i] == subheap) return TRUE;
+    return FALSE;
+}
+
+
 /***********************************************************************
  *           HEAP_MakeInUseBlockFree
  *
@@ -668,9 +726,10 @@ static void HEAP_MakeInUseBlockFree( SUBHEAP *subheap, ARENA_INUSE *pArena )
         return;  /* Not the last block, so nothing more to do */
 
     /* Free the whole sub-heap if it's empty and not the original one */
+    /* nor one that the LFH may still look up without holding the lock */
 
     if (((char *)pFree == (char *)subheap->base + subheap->headerSize) &&
-        (subheap != &subheap->heap->subheap))
+        (subheap != &subheap->heap->subheap) && !lfh_is_recorded_subheap( heap, subheap ))
     {
         void *addr = subheap->base;
 
@@ -924,6 +983,8 @@ static SUBHEAP *HEAP_CreateSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         heap->flags         = flags;
         heap->magic         = HEAP_MAGIC;
         heap->grow_size     = max( HEAP_DEF_SIZE, totalSize );
+        heap->lfh           = NULL;
+        heap->locked        = 0;
         list_init( &heap->subheap_list );
         list_init( &heap->large_list );
 
@@ -1213,7 +1274,8 @@ static BOOL HEAP_ValidateInUseArena( const SUBHEAP *subheap, const ARENA_INUSE *
     }
 
     /* Check magic number */
-    if (pArena->magic != ARENA_INUSE_MAGIC && pArena->magic != ARENA_PENDING_MAGIC)
+    if (pArena->magic != ARENA_INUSE_MAGIC && pArena->magic != ARENA_PENDING_MAGIC &&
+        pArena->magic != ARENA_LFH_MAGIC && pArena->magic != ARENA_LFH_FREE_MAGIC)
     {
         if (quiet == NOISY) {
             ERR("Heap %p: invalid in-use arena magic %08x for %p\n", subheap->heap, pArena->magic, pArena );
@@ -1419,9 +1481,9 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
         ret = HEAP_ValidateInUseArena( subheap, arena, QUIET );
     else if ((ULONG_PTR)arena % ALIGNMENT != ARENA_OFFSET)
         WARN( "Heap %p: unaligned arena pointer %p\n", subheap->heap, arena );
-    else if (arena->magic == ARENA_PENDING_MAGIC)
+    else if (arena->magic == ARENA_PENDING_MAGIC || arena->magic == ARENA_LFH_FREE_MAGIC)
         WARN( "Heap %p: block %p used after free\n", subheap->heap, arena + 1 );
-    else if (arena->magic != ARENA_INUSE_MAGIC)
+    else if (arena->magic != ARENA_INUSE_MAGIC && arena->magic != ARENA_LFH_MAGIC)
         WARN( "Heap %p: invalid in-use arena magic %08x for %p\n", subheap->heap, arena->magic, arena );
     else if (arena->size & ARENA_FLAG_FREE)
         ERR( "Heap %p: bad flags %08x for in-use arena %p\n",
@@ -1437,6 +1499,303 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
 }
 
 
+/***********************************************************************
+ *           lfh_get_class
+ *
+ * Get the smallest size class that can hold a block data size. Classes
+ * are 16 bytes apart up to 256 bytes, and then 4 per power of two.
+ */
+static inline unsigned int lfh_get_class( SIZE_T data_size )
+{
+    unsigned int shift;
+
+    if (data_size <= 0x100) return data_size ? (data_size - 1) / 0x10 : 0;
+    for (shift = 8; data_size > ((SIZE_T)2 << shift); shift++) ;
+    return 16 + (shift - 8) * 4 + (data_size - ((SIZE_T)1 << shift) - 1) / ((SIZE_T)1 << (shift - 2));
+}
+
+
+/***********************************************************************
+ *           lfh_get_class_size
+ *
+ * Get the block data size of a size class.
+ */
+static inline SIZE_T lfh_get_class_size( unsigned int class )
+{
+    unsigned int shift;
+
+    if (class < 16) return (class + 1) * 0x10;
+    shift = 8 + (class - 16) / 4;
+    return ((SIZE_T)1 << shift) + ((class - 16) % 4 + 1) * ((SIZE_T)1 << (shift - 2));
+}
+
+
+static inline struct lfh_stripe *lfh_get_stripe( HEAP *heap )
+{
+    return &heap->lfh->stripes[HandleToULong( NtCurrentTeb()->ClientId.UniqueThread ) / 4 % LFH_NB_STRIPES];
+}
+
+static inline void lfh_lock( struct lfh_stripe *stripe )
+{
+    while (InterlockedCompareExchange( &stripe->lock, 1, 0 )) YieldProcessor();
+}
+
+static inline void lfh_unlock( struct lfh_stripe *stripe )
+{
+    InterlockedExchange( &stripe->lock, 0 );
+}
+
+static inline ARENA_INUSE **lfh_next_ptr( ARENA_INUSE *arena )
+{
+    return (ARENA_INUSE **)(arena + 1);
+}
+
+static inline BOOL heap_is_locked( const HEAP *heap )
+{
+    return *(volatile const LONG *)&heap->locked != 0;
+}
+
+
+/***********************************************************************
+ *           lfh_add_subheap
+ *
+ * Record a sub-heap that blocks of the LFH are split from.
+ * The heap critical section must be held.
+ */
+static void lfh_add_subheap( HEAP *heap, SUBHEAP *subheap )
+{
+    struct lfh_heap *lfh = heap->lfh;
+    LONG i;
+
+    for (i = 0; i < lfh->nb_subheaps; i++) if (lfh->subheaps[i] == subheap) return;
+    if (i == LFH_MAX_SUBHEAPS) return;  /* its blocks will be freed under the heap lock */
+    lfh->subheaps[i] = subheap;
+    InterlockedExchange( &lfh->nb_subheaps, i + 1 );
+}
+
+
+/***********************************************************************
+ *           lfh_find_subheap
+ *
+ * Find the recorded sub-heap that contains an arena; doesn't need the heap lock.
+ */
+static SUBHEAP *lfh_find_subheap( HEAP *heap, const ARENA_INUSE *arena )
+{
+    struct lfh_heap *lfh = heap->lfh;
+    LONG i, count = *(volatile LONG *)&lfh->nb_subheaps;
+
+    for (i = 0; i < count; i++)
+    {
+        SUBHEAP *subheap = lfh->subheaps[i];
+        SIZE_T commit = *(volatile SIZE_T *)&subheap->commitSize;
+
+        if ((const char *)arena >= (char *)subheap->base + subheap->headerSize &&
+            (const char *)(arena + 1) <= (char *)subheap->base + commit)
+            return subheap;
+    }
+    return NULL;
+}
+
+
+/***********************************************************************
+ *           lfh_claim_block
+ *
+ * Atomically mark an in-use block of the LFH as free, so that it can only
+ * be freed once.
+ */
+static BOOL lfh_claim_block( ARENA_INUSE *arena )
+{
+    union { ARENA_INUSE arena; LONG64 data; } old, new;
+
+    old.arena = *arena;
+    if (old.arena.magic != ARENA_LFH_MAGIC) return FALSE;
+    new = old;
+    new.arena.magic = ARENA_LFH_FREE_MAGIC;
+    new.arena.unused_bytes = 0;
+    return InterlockedCompareExchange64( (LONG64 *)arena, new.data, old.data ) == old.data;
+}
+
+
+/***********************************************************************
+ *           lfh_release_blocks
+ *
+ * Give a list of cached blocks back to the heap free lists.
+ */
+static void lfh_release_blocks( HEAP *heap, ARENA_INUSE *list )
+{
+    ARENA_INUSE *next;
+
+    RtlEnterCriticalSection( &heap->critSection );
+    for (; list; list = next)
+    {
+        next = *lfh_next_ptr( list );
+        list->magic = ARENA_INUSE_MAGIC;
+        HEAP_MakeInUseBlockFree( HEAP_FindSubHeap( heap, list ), list );
+    }
+    RtlLeaveCriticalSection( &heap->critSection );
+}
+
+
+/***********************************************************************
+ *           lfh_alloc_slab
+ *
+ * Split a chunk of the heap into blocks of a size class. One of them is
+ * returned, the others are added to the stripe cache.
+ */
+static ARENA_INUSE *lfh_alloc_slab( HEAP *heap, struct lfh_stripe *stripe, unsigned int class )
+{
+    SIZE_T block_size = lfh_get_class_size( class ) + ARENA_OFFSET;
+    SIZE_T stride = block_size + sizeof(ARENA_INUSE);
+    SIZE_T i, count = min( max( LFH_SLAB_SIZE / stride, 1 ), LFH_SLAB_BLOCKS ), remaining;
+    ARENA_INUSE *arena, *block, *list = NULL, *tail = NULL;
+    ARENA_FREE *pArena;
+    SUBHEAP *subheap;
+    DWORD flags;
+
+    RtlEnterCriticalSection( &heap->critSection );
+    if (!(pArena = HEAP_FindFreeBlock( heap, count * stride - sizeof(ARENA_INUSE), &subheap )))
+    {
+        /* fall back to a single block */
+        count = 1;
+        if (!(pArena = HEAP_FindFreeBlock( heap, block_size, &subheap )))
+        {
+            RtlLeaveCriticalSection( &heap->critSection );
+            return NULL;
+        }
+    }
+    list_remove( &pArena->entry );
+    lfh_add_subheap( heap, subheap );
+    arena = (ARENA_INUSE *)pArena;
+    arena->size  = (arena->size & ~ARENA_FLAG_FREE) + sizeof(ARENA_FREE) - sizeof(ARENA_INUSE);
+    arena->magic = ARENA_LFH_FREE_MAGIC;
+    arena->unused_bytes = 0;
+    HEAP_ShrinkBlock( subheap, arena, count * stride - sizeof(ARENA_INUSE) );
+
+    /* split it while still holding the lock, so that heap walks never see a partial chunk */
+    flags = arena->size & ~ARENA_SIZE_MASK;
+    remaining = arena->size & ARENA_SIZE_MASK;
+    for (i = 0, block = arena; i < count; i++)
+    {
+        SIZE_T size = (i < count - 1) ? block_size : remaining;  /* the last one gets the leftover */
+
+        block->size = size | (i ? 0 : flags);
+        block->magic = ARENA_LFH_FREE_MAGIC;
+        block->unused_bytes = 0;
+        if (i)
+        {
+            if (!tail) tail = block;
+            *lfh_next_ptr( block ) = list;
+            list = block;
+        }
+        remaining -= stride;
+        block = (ARENA_INUSE *)((char *)(block + 1) + size);
+    }
+    RtlLeaveCriticalSection( &heap->critSection );
+
+    if (list)
+    {
+        struct lfh_bin *bin = &stripe->bins[class];
+
+        lfh_lock( stripe );
+        *lfh_next_ptr( tail ) = bin->head;
+        bin->head = list;
+        bin->count += count - 1;
+        lfh_unlock( stripe );
+    }
+    return arena;
+}
+
+
+/***********************************************************************
+ *           lfh_allocate
+ *
+ * Allocate a block from the low-fragmentation heap.
+ */
+static void *lfh_allocate( HEAP *heap, DWORD flags, SIZE_T size, SIZE_T rounded_size )
+{
+    unsigned int class = lfh_get_class( rounded_size - ARENA_OFFSET );
+    struct lfh_stripe *stripe = lfh_get_stripe( heap );
+    struct lfh_bin *bin = &stripe->bins[class];
+    ARENA_INUSE *arena;
+
+    lfh_lock( stripe );
+    if ((arena = bin->head))
+    {
+        bin->head = *lfh_next_ptr( arena );
+        bin->count--;
+    }
+    lfh_unlock( stripe );
+
+    if (!arena && !(arena = lfh_alloc_slab( heap, stripe, class ))) return NULL;
+
+    arena->magic = ARENA_LFH_MAGIC;
+    arena->unused_bytes = (arena->size & ARENA_SIZE_MASK) - size;
+    notify_alloc( arena + 1, size, flags & HEAP_ZERO_MEMORY );
+    initialize_block( arena + 1, size, arena->unused_bytes, flags );
+    return arena + 1;
+}
+
+
+/***********************************************************************
+ *           lfh_free
+ *
+ * Put a block claimed with lfh_claim_block() back in the cache of its size
+ * class. When the cache gets too large, the older half of it is released
+ * to the heap.
+ */
+static void lfh_free( HEAP *heap, ARENA_INUSE *arena )
+{
+    SIZE_T data_size = (arena->size & ARENA_SIZE_MASK) - ARENA_OFFSET;
+    unsigned int i, class = lfh_get_class( data_size );
+    struct lfh_stripe *stripe = lfh_get_stripe( heap );
+    ARENA_INUSE *tail, *list = NULL;
+    struct lfh_bin *bin;
+
+    /* the block may be larger than its class, cache it with the smaller ones */
+    if (lfh_get_class_size( class ) > data_size) class--;
+    if (class >= LFH_NB_CLASSES) class = LFH_NB_CLASSES - 1;
+    bin = &stripe->bins[class];
+
+    lfh_lock( stripe );
+    *lfh_next_ptr( arena ) = bin->head;
+    bin->head = arena;
+    if (++bin->count > LFH_MAX_CACHED)
+    {
+        for (i = 1, tail = bin->head; i < LFH_MAX_CACHED / 2; i++) tail = *lfh_next_ptr( tail );
+        list = *lfh_next_ptr( tail );
+        *lfh_next_ptr( tail ) = NULL;
+        bin->count = LFH_MAX_CACHED / 2;
+    }
+    lfh_unlock( stripe );
+
+    if (list) lfh_release_blocks( heap, list );
+}
+
+
+/***********************************************************************
+ *           lfh_enable
+ *
+ * Switch a heap to the low-fragmentation heap mode.
+ */
+static NTSTATUS lfh_enable( HEAP *heap )
+{
+    struct lfh_heap *lfh;
+
+    if (heap->lfh) return STATUS_SUCCESS;
+    /* the caches need serialization, and would hide blocks from the heap checks */
+    if (heap->flags & (HEAP_NO_SERIALIZE | HEAP_TAIL_CHECKING_ENABLED | HEAP_FREE_CHECKING_ENABLED |
+                       HEAP_VALIDATE | HEAP_VALIDATE_ALL | HEAP_VALIDATE_PARAMS))
+        return STATUS_UNSUCCESSFUL;
+
+    if (!(lfh = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*lfh) )))
+        return STATUS_NO_MEMORY;
+    if (InterlockedCompareExchangePointer( (void **)&heap->lfh, lfh, NULL ))
+        RtlFreeHeap( GetProcessHeap(), 0, lfh );
+    TRACE( "enabled low-fragmentation heap for %p\n", heap );
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           heap_set_debug_flags
  */
@@ -1624,6 +1983,7 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
     }
     subheap_notify_free_all(&heapPtr->subheap);
     RtlFreeHeap( GetProcessHeap(), 0, heapPtr->pending_free );
+    RtlFreeHeap( GetProcessHeap(), 0, heapPtr->lfh );
     size = 0;
     addr = heapPtr->subheap.base;
     NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
@@ -1669,6 +2029,16 @@ void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
+    if (heapPtr->lfh && !heap_is_locked( heapPtr ) && rounded_size - ARENA_OFFSET <= LFH_MAX_DATA_SIZE)
+    {
+        void *ret = lfh_allocate( heapPtr, flags, size, rounded_size );
+        if (ret)
+        {
+            TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
+            return ret;
+        }
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
@@ -1752,15 +2122,43 @@ BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE heap, ULONG flags, void *pt
 
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
+    pInUse  = (ARENA_INUSE *)ptr - 1;
+
+    /* blocks of the low-fragmentation heap go back to its caches without taking the heap lock */
+    if (heapPtr->lfh && !heap_is_locked( heapPtr ) && (ULONG_PTR)pInUse % ALIGNMENT == ARENA_OFFSET &&
+        (subheap = lfh_find_subheap( heapPtr, pInUse )) &&
+        (const char *)(pInUse + 1) + (pInUse->size & ARENA_SIZE_MASK) <= (char *)subheap->base + subheap->size &&
+        lfh_claim_block( pInUse ))
+    {
+        notify_free( ptr );
+        lfh_free( heapPtr, pInUse );
+        TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     /* Inform valgrind we are trying to free memory, so it can throw up an error message */
     notify_free( ptr );
 
     /* Some sanity checks */
-    pInUse  = (ARENA_INUSE *)ptr - 1;
     if (!validate_block_pointer( heapPtr, &subheap, pInUse )) goto error;
 
+    /* blocks of the LFH that weren't handled above are from sub-heaps that it couldn't record, */
+    /* or the heap is locked and they must really be freed */
+    if (subheap && pInUse->magic == ARENA_LFH_MAGIC)
+    {
+        if (!lfh_claim_block( pInUse )) goto error;  /* freed concurrently */
+        if (!heap_is_locked( heapPtr ))
+        {
+            if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
+            lfh_free( heapPtr, pInUse );
+            TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+            return TRUE;
+        }
+        pInUse->magic = ARENA_INUSE_MAGIC;
+    }
+
     if (!subheap)
         free_large_block( heapPtr, flags, ptr );
     else
@@ -1827,6 +2225,9 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
         goto done;
     }
 
+    /* resized blocks are no longer managed by the low-fragmentation heap */
+    if (pArena->magic == ARENA_LFH_MAGIC) pArena->magic = ARENA_INUSE_MAGIC;
+
     /* Check if we need to grow the block */
 
     oldBlockSize = (pArena->size & ARENA_SIZE_MASK);
@@ -1966,6 +2367,7 @@ BOOLEAN WINAPI RtlLockHeap( HANDLE heap )
     HEAP *heapPtr = HEAP_GetPtr( heap );
     if (!heapPtr) return FALSE;
     RtlEnterCriticalSection( &heapPtr->critSection );
+    InterlockedIncrement( &heapPtr->locked );
     return TRUE;
 }
 
@@ -1986,6 +2388,7 @@ BOOLEAN WINAPI RtlUnlockHeap( HANDLE heap )
 {
     HEAP *heapPtr = HEAP_GetPtr( heap );
     if (!heapPtr) return FALSE;
+    InterlockedDecrement( &heapPtr->locked );
     RtlLeaveCriticalSection( &heapPtr->critSection );
     return TRUE;
 }
@@ -2119,7 +2522,9 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         }
 
         if (((ARENA_INUSE *)ptr - 1)->magic == ARENA_INUSE_MAGIC ||
-            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_PENDING_MAGIC)
+            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_PENDING_MAGIC ||
+            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_LFH_MAGIC ||
+            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_LFH_FREE_MAGIC)
         {
             ARENA_INUSE *pArena = (ARENA_INUSE *)ptr - 1;
             ptr += pArena->size & ARENA_SIZE_MASK;
@@ -2167,7 +2572,7 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         entry->lpData = pArena + 1;
         entry->cbData = pArena->size & ARENA_SIZE_MASK;
         entry->cbOverhead = sizeof(ARENA_INUSE);
-        entry->wFlags = (pArena->magic == ARENA_PENDING_MAGIC) ?
+        entry->wFlags = (pArena->magic == ARENA_PENDING_MAGIC || pArena->magic == ARENA_LFH_FREE_MAGIC) ?
                         PROCESS_HEAP_UNCOMMITTED_RANGE : PROCESS_HEAP_ENTRY_BUSY;
         /* FIXME: can't handle PROCESS_HEAP_ENTRY_MOVEABLE
         and PROCESS_HEAP_ENTRY_DDESHARE yet */
@@ -2232,6 +2637,8 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
 NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
                                          PVOID info, SIZE_T size_in, PSIZE_T size_out)
 {
+    HEAP *heapPtr;
+
     switch (info_class)
     {
     case HeapCompatibilityInformation:
@@ -2239,8 +2646,9 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
 
         if (size_in < sizeof(ULONG))
             return STATUS_BUFFER_TOO_SMALL;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
 
-        *(ULONG *)info = 0; /* standard heap */
+        *(ULONG *)info = heapPtr->lfh ? 2 : 0; /* low-fragmentation or standard heap */
         return STATUS_SUCCESS;
 
     default:
@@ -2254,6 +2662,26 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
  */
 NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class, PVOID info, SIZE_T size)
 {
-    FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
-    return STATUS_SUCCESS;
+    HEAP *heapPtr;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+
+        switch (*(ULONG *)info)
+        {
+        case 0:  /* standard heap */
+            return heapPtr->lfh ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+        case 2:  /* low-fragmentation heap */
+            return lfh_enable( heapPtr );
+        default:
+            return STATUS_UNSUCCESSFUL;
+        }
+
+    default:
+        FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
+        return STATUS_SUCCESS;
+    }
 }
@@ -134,8 +134,12 @@ typedef struct _wine_modref
     int                   alloc_deps;
     int                   nDeps;
     struct _wine_modref **deps;
+    DWORD                *export_hash;       /* hash index of the exported names, built on first use */
+    DWORD                 export_hash_size;  /* size of the hash index, a power of two */
 } WINE_MODREF;
 
+#define MIN_EXPORT_HASH_NAMES 16  /* below this number of names a binary search is good enough */
+
 static UINT tls_module_count;      /* number of modules with TLS directory */
 static IMAGE_TLS_DIRECTORY *tls_dirs;  /* array of TLS directories */
 LIST_ENTRY tls_links = { &tls_links, &tls_links };
@@ -747,6 +751,54 @@ static int find_name_in_exports( HMODULE module, const IMAGE_EXPORT_DIRECTORY *e
 }
 
 
+static inline DWORD hash_export_name( const char *name )
+{
+    DWORD hash = 2166136261u;  /* FNV-1a */
+
+    while (*name) hash = (hash ^ (unsigned char)*name++) * 16777619;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		find_name_in_export_hash
+ *
+ * Helper for find_named_export. Look up a name in the hash index of the
+ * module exports, building the index on first use.
+ * The loader_section must be locked while calling this function.
+ */
+static int find_name_in_export_hash( WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports,
+                                     const char *name )
+{
+    HMODULE module = wm->ldr.DllBase;
+    const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    DWORD i, pos, mask;
+
+    if (!wm->export_hash)
+    {
+        DWORD size = 1;
+
+        while (size < exports->NumberOfNames * 2) size *= 2;
+        if (!(wm->export_hash = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                                 size * sizeof(*wm->export_hash) )))
+            return find_name_in_exports( module, exports, name );
+        wm->export_hash_size = size;
+        for (i = 0; i < exports->NumberOfNames; i++)
+        {
+            pos = hash_export_name( get_rva( module, names[i] )) & (size - 1);
+            while (wm->export_hash[pos]) pos = (pos + 1) & (size - 1);
+            wm->export_hash[pos] = i + 1;
+        }
+    }
+
+    mask = wm->export_hash_size - 1;
+    for (pos = hash_export_name( name ) & mask; (i = wm->export_hash[pos]); pos = (pos + 1) & mask)
+        if (!strcmp( get_rva( module, names[i - 1] ), name )) return ordinals[i - 1];
+    return -1;
+}
+
+
 /*************************************************************************
  *		find_named_export
  *
@@ -758,6 +810,7 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 {
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
+    WINE_MODREF *wm;
     int ordinal;
 
     /* first check the hint */
@@ -768,8 +821,12 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
     }
 
-    /* then do a binary search */
-    if ((ordinal = find_name_in_exports( module, exports, name )) == -1) return NULL;
+    /* then use the hash index, or a binary search for small export tables */
+    if (exports->NumberOfNames >= MIN_EXPORT_HASH_NAMES && (wm = get_modref( module )))
+        ordinal = find_name_in_export_hash( wm, exports, name );
+    else
+        ordinal = find_name_in_exports( module, exports, name );
+    if (ordinal == -1) return NULL;
     return find_ordinal_export( module, exports, exp_size, ordinal, load_path );
 
 }
@@ -1177,6 +1234,9 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     if (!create_module_activation_context( &wm->ldr ))
         RtlActivateActivationContext( 0, wm->ldr.ActivationContext, &cookie );
 
+    /* let the dependency files be read in while we load them one at a time */
+    if (nb_imports > 1) unix_funcs->prefetch_dlls( wm->ldr.DllBase, load_path ? load_path : default_load_path );
+
     /* load the imported modules. They are automatically
      * added to the modref list of the process.
      */
@@ -3453,6 +3513,7 @@ static void free_modref( WINE_MODREF *wm )
     if (cached_modref == wm) cached_modref = NULL;
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
     RtlFreeHeap( GetProcessHeap(), 0, wm->deps );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_hash );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
 }
 
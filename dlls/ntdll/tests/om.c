@@ -2655,6 +2655,131 @@ static void test_get_next_thread(void)
     CloseHandle(thread);
 }
 
+static DWORD WINAPI release_semaphore_thread( void *arg )
+{
+    HANDLE semaphore = arg;
+    NTSTATUS status;
+    ULONG prev;
+
+    Sleep( 50 );
+    prev = 0xdeadbeef;
+    status = pNtReleaseSemaphore( semaphore, 2, &prev );
+    ok( status == STATUS_SUCCESS, "NtReleaseSemaphore failed %08x\n", status );
+    ok( prev == 0, "got %u\n", prev );
+    return 0;
+}
+
+static void test_sync_handles(void)
+{
+    SEMAPHORE_BASIC_INFORMATION info;
+    HANDLE event, event2, semaphore, semaphore2, handles[2], thread;
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING str;
+    NTSTATUS status;
+    LONG state;
+    ULONG prev;
+    DWORD ret;
+    BOOL success;
+
+    /* handles to the same object share its state */
+    pRtlInitUnicodeString( &str, L"\\BaseNamedObjects\\test_sync_handles_event" );
+    InitializeObjectAttributes( &attr, &str, 0, 0, NULL );
+    status = pNtCreateEvent( &event, EVENT_ALL_ACCESS, &attr, SynchronizationEvent, FALSE );
+    ok( status == STATUS_SUCCESS, "NtCreateEvent failed %08x\n", status );
+    status = pNtOpenEvent( &event2, SYNCHRONIZE, &attr );
+    ok( status == STATUS_SUCCESS, "NtOpenEvent failed %08x\n", status );
+
+    ret = WaitForSingleObject( event2, 0 );
+    ok( ret == WAIT_TIMEOUT, "got %u\n", ret );
+    state = 0xdeadbeef;
+    status = pNtSetEvent( event, &state );
+    ok( status == STATUS_SUCCESS, "NtSetEvent failed %08x\n", status );
+    ok( !state, "got state %d\n", state );
+    ret = WaitForSingleObject( event2, 0 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+    /* the wait reset the auto-reset event */
+    ret = WaitForSingleObject( event, 0 );
+    ok( ret == WAIT_TIMEOUT, "got %u\n", ret );
+
+    /* access rights are checked */
+    status = pNtSetEvent( event2, NULL );
+    ok( status == STATUS_ACCESS_DENIED, "NtSetEvent returned %08x\n", status );
+    status = pNtResetEvent( event2, NULL );
+    ok( status == STATUS_ACCESS_DENIED, "NtResetEvent returned %08x\n", status );
+    pNtClose( event2 );
+    status = pNtOpenEvent( &event2, EVENT_MODIFY_STATE, &attr );
+    ok( status == STATUS_SUCCESS, "NtOpenEvent failed %08x\n", status );
+    status = pNtSetEvent( event2, NULL );
+    ok( status == STATUS_SUCCESS, "NtSetEvent failed %08x\n", status );
+    ret = WaitForSingleObject( event2, 0 );
+    ok( ret == WAIT_FAILED, "got %u\n", ret );
+    ok( GetLastError() == ERROR_ACCESS_DENIED, "got error %u\n", GetLastError() );
+    pNtClose( event2 );
+
+    /* a closed handle must not stay usable */
+    success = DuplicateHandle( GetCurrentProcess(), event, GetCurrentProcess(), &event2,
+                               0, FALSE, DUPLICATE_SAME_ACCESS );
+    ok( success, "DuplicateHandle failed %u\n", GetLastError() );
+    ret = WaitForSingleObject( event2, 0 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+    pNtClose( event2 );
+    status = pNtSetEvent( event2, NULL );
+    ok( status == STATUS_INVALID_HANDLE, "NtSetEvent returned %08x\n", status );
+    ret = WaitForSingleObject( event2, 0 );
+    ok( ret == WAIT_FAILED, "got %u\n", ret );
+
+    status = pNtCreateSemaphore( &semaphore, SEMAPHORE_ALL_ACCESS, NULL, 2, 3 );
+    ok( status == STATUS_SUCCESS, "NtCreateSemaphore failed %08x\n", status );
+    success = DuplicateHandle( GetCurrentProcess(), semaphore, GetCurrentProcess(), &semaphore2,
+                               SYNCHRONIZE, FALSE, 0 );
+    ok( success, "DuplicateHandle failed %u\n", GetLastError() );
+    status = pNtReleaseSemaphore( semaphore2, 1, NULL );
+    ok( status == STATUS_ACCESS_DENIED, "NtReleaseSemaphore returned %08x\n", status );
+
+    ret = WaitForSingleObject( semaphore2, 0 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+    ret = WaitForSingleObject( semaphore, 0 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+    ret = WaitForSingleObject( semaphore2, 0 );
+    ok( ret == WAIT_TIMEOUT, "got %u\n", ret );
+
+    /* the first signaled object is acquired, and only that one */
+    pNtSetEvent( event, NULL );
+    handles[0] = semaphore;
+    handles[1] = event;
+    ret = WaitForMultipleObjects( 2, handles, FALSE, 0 );
+    ok( ret == WAIT_OBJECT_0 + 1, "got %u\n", ret );
+    ret = WaitForMultipleObjects( 2, handles, FALSE, 0 );
+    ok( ret == WAIT_TIMEOUT, "got %u\n", ret );
+    pNtReleaseSemaphore( semaphore, 1, NULL );
+    pNtSetEvent( event, NULL );
+    ret = WaitForMultipleObjects( 2, handles, FALSE, 0 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+    ret = WaitForSingleObject( event, 0 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+
+    /* a blocked waiter is woken up by a release from another thread */
+    thread = CreateThread( NULL, 0, release_semaphore_thread, semaphore, 0, NULL );
+    ret = WaitForSingleObject( semaphore2, 5000 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+    ret = WaitForSingleObject( thread, 5000 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+    CloseHandle( thread );
+
+    memset( &info, 0xcc, sizeof(info) );
+    status = pNtQuerySemaphore( semaphore, SemaphoreBasicInformation, &info, sizeof(info), NULL );
+    ok( status == STATUS_SUCCESS, "NtQuerySemaphore failed %08x\n", status );
+    ok( info.CurrentCount == 1, "expected 1, got %d\n", info.CurrentCount );
+    prev = 0xdeadbeef;
+    status = pNtReleaseSemaphore( semaphore, 3, &prev );
+    ok( status == STATUS_SEMAPHORE_LIMIT_EXCEEDED, "NtReleaseSemaphore returned %08x\n", status );
+    ok( prev == 0xdeadbeef, "got %u\n", prev );
+
+    pNtClose( semaphore2 );
+    pNtClose( semaphore );
+    pNtClose( event );
+}
+
 START_TEST(om)
 {
     HMODULE hntdll = GetModuleHandleA("ntdll.dll");
@@ -2719,6 +2844,7 @@ START_TEST(om)
     test_event();
     test_mutant();
     test_semaphore();
+    test_sync_handles();
     test_keyed_events();
     test_null_device();
     test_wait_on_address();
@@ -842,6 +842,95 @@ static void test_NtQueryValueKey(void)
     pNtClose(key);
 }
 
+static void test_value_changes(void)
+{
+    HANDLE key, key2;
+    NTSTATUS status;
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING name;
+    KEY_VALUE_PARTIAL_INFORMATION *info;
+    KEY_FULL_INFORMATION full_info;
+    char buffer[FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data[sizeof(DWORD)])];
+    DWORD len, data, values;
+
+    info = (KEY_VALUE_PARTIAL_INFORMATION *)buffer;
+    pRtlCreateUnicodeStringFromAsciiz(&name, "changetest");
+
+    InitializeObjectAttributes(&attr, &winetestpath, 0, 0, 0);
+    status = pNtOpenKey(&key, KEY_READ, &attr);
+    ok(status == STATUS_SUCCESS, "NtOpenKey failed: 0x%08x\n", status);
+    status = pNtOpenKey(&key2, KEY_READ|KEY_SET_VALUE, &attr);
+    ok(status == STATUS_SUCCESS, "NtOpenKey failed: 0x%08x\n", status);
+
+    /* repeated queries must see the changes made through another handle */
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_OBJECT_NAME_NOT_FOUND, "NtQueryValueKey returned 0x%08x\n", status);
+    status = pNtQueryKey(key, KeyFullInformation, &full_info, sizeof(full_info), &len);
+    ok(status == STATUS_SUCCESS, "NtQueryKey returned 0x%08x\n", status);
+    values = full_info.Values;
+
+    data = 1;
+    status = pNtSetValueKey(key2, &name, 0, REG_DWORD, &data, sizeof(data));
+    ok(status == STATUS_SUCCESS, "NtSetValueKey failed: 0x%08x\n", status);
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_SUCCESS, "NtQueryValueKey returned 0x%08x\n", status);
+    ok(*(DWORD *)info->Data == 1, "got %u\n", *(DWORD *)info->Data);
+    status = pNtQueryKey(key, KeyFullInformation, &full_info, sizeof(full_info), &len);
+    ok(status == STATUS_SUCCESS, "NtQueryKey returned 0x%08x\n", status);
+    ok(full_info.Values == values + 1, "got %u values, expected %u\n", full_info.Values, values + 1);
+
+    data = 2;
+    status = pNtSetValueKey(key2, &name, 0, REG_DWORD, &data, sizeof(data));
+    ok(status == STATUS_SUCCESS, "NtSetValueKey failed: 0x%08x\n", status);
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_SUCCESS, "NtQueryValueKey returned 0x%08x\n", status);
+    ok(*(DWORD *)info->Data == 2, "got %u\n", *(DWORD *)info->Data);
+
+    status = pNtDeleteValueKey(key2, &name);
+    ok(status == STATUS_SUCCESS, "NtDeleteValueKey failed: 0x%08x\n", status);
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_OBJECT_NAME_NOT_FOUND, "NtQueryValueKey returned 0x%08x\n", status);
+    status = pNtQueryKey(key, KeyFullInformation, &full_info, sizeof(full_info), &len);
+    ok(status == STATUS_SUCCESS, "NtQueryKey returned 0x%08x\n", status);
+    ok(full_info.Values == values, "got %u values, expected %u\n", full_info.Values, values);
+
+    /* the same goes for handles that are opened and closed around each query */
+    data = 3;
+    status = pNtSetValueKey(key2, &name, 0, REG_DWORD, &data, sizeof(data));
+    ok(status == STATUS_SUCCESS, "NtSetValueKey failed: 0x%08x\n", status);
+    pNtClose(key);
+    status = pNtOpenKey(&key, KEY_READ, &attr);
+    ok(status == STATUS_SUCCESS, "NtOpenKey failed: 0x%08x\n", status);
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_SUCCESS, "NtQueryValueKey returned 0x%08x\n", status);
+    ok(*(DWORD *)info->Data == 3, "got %u\n", *(DWORD *)info->Data);
+    pNtClose(key);
+
+    data = 4;
+    status = pNtSetValueKey(key2, &name, 0, REG_DWORD, &data, sizeof(data));
+    ok(status == STATUS_SUCCESS, "NtSetValueKey failed: 0x%08x\n", status);
+    status = pNtOpenKey(&key, KEY_READ, &attr);
+    ok(status == STATUS_SUCCESS, "NtOpenKey failed: 0x%08x\n", status);
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_SUCCESS, "NtQueryValueKey returned 0x%08x\n", status);
+    ok(*(DWORD *)info->Data == 4, "got %u\n", *(DWORD *)info->Data);
+    pNtClose(key);
+
+    /* a previous query through another handle doesn't bypass the access check */
+    status = pNtOpenKey(&key, KEY_SET_VALUE, &attr);
+    ok(status == STATUS_SUCCESS, "NtOpenKey failed: 0x%08x\n", status);
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_ACCESS_DENIED, "NtQueryValueKey returned 0x%08x\n", status);
+    status = pNtQueryKey(key, KeyFullInformation, &full_info, sizeof(full_info), &len);
+    ok(status == STATUS_ACCESS_DENIED, "NtQueryKey returned 0x%08x\n", status);
+
+    status = pNtDeleteValueKey(key2, &name);
+    ok(status == STATUS_SUCCESS, "NtDeleteValueKey failed: 0x%08x\n", status);
+    pRtlFreeUnicodeString(&name);
+    pNtClose(key2);
+    pNtClose(key);
+}
+
 static void test_NtDeleteKey(void)
 {
     NTSTATUS status;
@@ -2072,6 +2161,7 @@ START_TEST(reg)
     test_NtQueryKey();
     test_NtQueryLicenseKey();
     test_NtQueryValueKey();
+    test_value_changes();
     test_long_value_name();
     test_notify();
     test_RtlCreateRegistryKey();
@@ -740,6 +740,71 @@ static void test_tp_work(void)
     pTpReleasePool(pool);
 }
 
+static void CALLBACK busy_work_release_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
+{
+    HANDLE semaphore = userdata;
+    ReleaseSemaphore(semaphore, 1, NULL);
+}
+
+static void CALLBACK busy_work_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
+{
+    TP_WORK *other_work = userdata;
+    /* the only worker thread is busy while the work item is posted */
+    pTpPostWork(other_work);
+    Sleep(50);
+}
+
+static void test_tp_work_busy(void)
+{
+    TP_CALLBACK_ENVIRON environment;
+    TP_WORK *work, *work2;
+    HANDLE semaphore;
+    TP_POOL *pool;
+    NTSTATUS status;
+    DWORD result;
+    int i;
+
+    semaphore = CreateSemaphoreA(NULL, 0, 1, NULL);
+    ok(semaphore != NULL, "CreateSemaphoreA failed %u\n", GetLastError());
+
+    /* allocate new threadpool with only one thread */
+    pool = NULL;
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %x\n", status);
+    ok(pool != NULL, "expected pool != NULL\n");
+    pTpSetPoolMaxThreads(pool, 1);
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = pool;
+
+    work2 = NULL;
+    status = pTpAllocWork(&work2, busy_work_release_cb, semaphore, &environment);
+    ok(!status, "TpAllocWork failed with status %x\n", status);
+    ok(work2 != NULL, "expected work2 != NULL\n");
+
+    work = NULL;
+    status = pTpAllocWork(&work, busy_work_cb, work2, &environment);
+    ok(!status, "TpAllocWork failed with status %x\n", status);
+    ok(work != NULL, "expected work != NULL\n");
+
+    /* work posted from a callback runs once the busy worker is done, without waking anybody */
+    for (i = 0; i < 3; i++)
+    {
+        pTpPostWork(work);
+        result = WaitForSingleObject(semaphore, 1000);
+        ok(result == WAIT_OBJECT_0, "%d: WaitForSingleObject returned %u\n", i, result);
+    }
+
+    pTpWaitForWork(work, FALSE);
+    pTpWaitForWork(work2, FALSE);
+
+    pTpReleaseWork(work);
+    pTpReleaseWork(work2);
+    pTpReleasePool(pool);
+    CloseHandle(semaphore);
+}
+
 static void test_tp_work_scheduler(void)
 {
     TP_CALLBACK_ENVIRON environment;
@@ -1980,6 +2045,153 @@ static void test_tp_multi_wait(void)
     CloseHandle(semaphore);
 }
 
+static struct
+{
+    HANDLE semaphore;
+    LONG count;
+    DWORD order[8];
+} wait_order_info;
+
+static void CALLBACK wait_order_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WAIT *wait, TP_WAIT_RESULT result)
+{
+    LONG index = InterlockedIncrement(&wait_order_info.count) - 1;
+
+    ok(result == WAIT_TIMEOUT, "unexpected result %u\n", result);
+    if (index < ARRAY_SIZE(wait_order_info.order))
+        wait_order_info.order[index] = (DWORD)(DWORD_PTR)userdata;
+    ReleaseSemaphore(wait_order_info.semaphore, 1, NULL);
+}
+
+static void test_tp_wait_timeout_order(void)
+{
+    TP_CALLBACK_ENVIRON environment;
+    HANDLE events[ARRAY_SIZE(wait_order_info.order)];
+    TP_WAIT *waits[ARRAY_SIZE(wait_order_info.order)];
+    LARGE_INTEGER when;
+    NTSTATUS status;
+    TP_POOL *pool;
+    DWORD result;
+    int i;
+
+    wait_order_info.semaphore = CreateSemaphoreW(NULL, 0, ARRAY_SIZE(waits), NULL);
+    ok(wait_order_info.semaphore != NULL, "failed to create semaphore\n");
+    wait_order_info.count = 0;
+
+    pool = NULL;
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %x\n", status);
+    pTpSetPoolMaxThreads(pool, 1);
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = pool;
+
+    /* wait objects are set with decreasing timeouts, they must expire in the opposite order */
+    for (i = 0; i < ARRAY_SIZE(waits); i++)
+    {
+        events[i] = CreateEventW(NULL, TRUE, FALSE, NULL);
+        ok(events[i] != NULL, "failed to create event %i\n", i);
+
+        waits[i] = NULL;
+        status = pTpAllocWait(&waits[i], wait_order_cb, (void *)(DWORD_PTR)i, &environment);
+        ok(!status, "TpAllocWait failed with status %x\n", status);
+
+        when.QuadPart = (ULONGLONG)(ARRAY_SIZE(waits) - i) * 50 * -10000;
+        pTpSetWait(waits[i], events[i], &when);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(waits); i++)
+    {
+        result = WaitForSingleObject(wait_order_info.semaphore, 1000);
+        ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+    }
+
+    ok(wait_order_info.count == ARRAY_SIZE(waits), "got %u callbacks\n", wait_order_info.count);
+    for (i = 0; i < ARRAY_SIZE(waits); i++)
+        ok(wait_order_info.order[i] == ARRAY_SIZE(waits) - 1 - i, "expected %u, got %u\n",
+           (DWORD)(ARRAY_SIZE(waits) - 1 - i), wait_order_info.order[i]);
+
+    for (i = 0; i < ARRAY_SIZE(waits); i++)
+    {
+        pTpReleaseWait(waits[i]);
+        CloseHandle(events[i]);
+    }
+
+    pTpReleasePool(pool);
+    CloseHandle(wait_order_info.semaphore);
+}
+
+static struct
+{
+    HANDLE done;
+    LONG count;
+} many_waits_info;
+
+static void CALLBACK many_waits_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WAIT *wait, TP_WAIT_RESULT result)
+{
+    ok(result == WAIT_OBJECT_0, "unexpected result %u\n", result);
+    if (!InterlockedDecrement(&many_waits_info.count)) SetEvent(many_waits_info.done);
+}
+
+static void test_tp_many_waits(void)
+{
+    TP_CALLBACK_ENVIRON environment;
+    HANDLE *events;
+    TP_WAIT **waits;
+    DWORD result, ticks;
+    NTSTATUS status;
+    TP_POOL *pool;
+    int i, count = 10000;
+
+    events = HeapAlloc(GetProcessHeap(), 0, count * sizeof(*events));
+    waits = HeapAlloc(GetProcessHeap(), 0, count * sizeof(*waits));
+    many_waits_info.done = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(many_waits_info.done != NULL, "failed to create event\n");
+
+    pool = NULL;
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %x\n", status);
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = pool;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!(events[i] = CreateEventW(NULL, TRUE, FALSE, NULL))) break;
+        waits[i] = NULL;
+        status = pTpAllocWait(&waits[i], many_waits_cb, NULL, &environment);
+        ok(!status, "TpAllocWait failed with status %x\n", status);
+        if (status)
+        {
+            CloseHandle(events[i]);
+            break;
+        }
+    }
+    count = i;
+    many_waits_info.count = count;
+
+    ticks = GetTickCount();
+    for (i = 0; i < count; i++) pTpSetWait(waits[i], events[i], NULL);
+    for (i = 0; i < count; i++) SetEvent(events[i]);
+
+    result = WaitForSingleObject(many_waits_info.done, 10000);
+    ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+    ok(!many_waits_info.count, "%u callbacks still pending\n", many_waits_info.count);
+    if (winetest_debug > 1) trace("%u waits took %u ms\n", count, GetTickCount() - ticks);
+
+    for (i = 0; i < count; i++)
+    {
+        pTpReleaseWait(waits[i]);
+        CloseHandle(events[i]);
+    }
+
+    pTpReleasePool(pool);
+    CloseHandle(many_waits_info.done);
+    HeapFree(GetProcessHeap(), 0, waits);
+    HeapFree(GetProcessHeap(), 0, events);
+}
+
 struct io_cb_ctx
 {
     unsigned int count;
@@ -2300,6 +2512,7 @@ START_TEST(threadpool)
     test_tp_simple();
     test_tp_work();
     test_tp_work_scheduler();
+    test_tp_work_busy();
     test_tp_group_wait();
     test_tp_group_cancel();
     test_tp_instance();
@@ -2308,6 +2521,8 @@ START_TEST(threadpool)
     test_tp_window_length();
     test_tp_wait();
     test_tp_multi_wait();
+    test_tp_wait_timeout_order();
+    test_tp_many_waits();
     test_tp_io();
     test_kernel32_tp_io();
 }
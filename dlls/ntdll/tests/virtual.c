@@ -1089,6 +1089,93 @@ static void test_syscalls(void)
     UnmapViewOfFile( ptr );
 }
 
+static void test_protection_ranges(void)
+{
+    static const SIZE_T count = 1027;
+    MEMORY_BASIC_INFORMATION mbi;
+    NTSTATUS status;
+    SIZE_T size, i;
+    ULONG old_prot;
+    char *base;
+    void *addr;
+
+    addr = NULL;
+    size = count * page_size;
+    status = NtAllocateVirtualMemory( NtCurrentProcess(), &addr, 0, &size, MEM_COMMIT, PAGE_READWRITE );
+    ok( status == STATUS_SUCCESS, "NtAllocateVirtualMemory returned %08x\n", status );
+    base = addr;
+
+    /* runs of various lengths that don't line up with anything */
+    for (i = 3; i + 7 < count; i += 13)
+    {
+        addr = base + i * page_size;
+        size = 7 * page_size;
+        status = NtProtectVirtualMemory( NtCurrentProcess(), &addr, &size, PAGE_READONLY, &old_prot );
+        ok( status == STATUS_SUCCESS, "NtProtectVirtualMemory returned %08x\n", status );
+    }
+
+    status = NtQueryVirtualMemory( NtCurrentProcess(), base, MemoryBasicInformation, &mbi, sizeof(mbi), NULL );
+    ok( status == STATUS_SUCCESS, "NtQueryVirtualMemory returned %08x\n", status );
+    ok( mbi.RegionSize == 3 * page_size, "got region size %I64x\n", (UINT64)mbi.RegionSize );
+    ok( mbi.Protect == PAGE_READWRITE, "got protection %x\n", mbi.Protect );
+
+    for (i = 3; i + 7 < count; i += 13)
+    {
+        status = NtQueryVirtualMemory( NtCurrentProcess(), base + i * page_size, MemoryBasicInformation,
+                                       &mbi, sizeof(mbi), NULL );
+        ok( status == STATUS_SUCCESS, "NtQueryVirtualMemory returned %08x\n", status );
+        ok( mbi.RegionSize == 7 * page_size, "%u: got region size %I64x\n", (UINT)i, (UINT64)mbi.RegionSize );
+        ok( mbi.Protect == PAGE_READONLY, "%u: got protection %x\n", (UINT)i, mbi.Protect );
+        if (i + 13 + 7 >= count) break;
+        status = NtQueryVirtualMemory( NtCurrentProcess(), base + (i + 7) * page_size, MemoryBasicInformation,
+                                       &mbi, sizeof(mbi), NULL );
+        ok( status == STATUS_SUCCESS, "NtQueryVirtualMemory returned %08x\n", status );
+        ok( mbi.RegionSize == 6 * page_size, "%u: got region size %I64x\n", (UINT)i, (UINT64)mbi.RegionSize );
+        ok( mbi.Protect == PAGE_READWRITE, "%u: got protection %x\n", (UINT)i, mbi.Protect );
+    }
+
+    /* the whole range becomes a single region again */
+    addr = base;
+    size = count * page_size;
+    status = NtProtectVirtualMemory( NtCurrentProcess(), &addr, &size, PAGE_READWRITE, &old_prot );
+    ok( status == STATUS_SUCCESS, "NtProtectVirtualMemory returned %08x\n", status );
+    ok( old_prot == PAGE_READWRITE, "got old protection %x\n", old_prot );
+    for (i = 0; i < count; i++) base[i * page_size] = 1;
+
+    status = NtQueryVirtualMemory( NtCurrentProcess(), base + page_size, MemoryBasicInformation,
+                                   &mbi, sizeof(mbi), NULL );
+    ok( status == STATUS_SUCCESS, "NtQueryVirtualMemory returned %08x\n", status );
+    ok( mbi.RegionSize == (count - 1) * page_size, "got region size %I64x\n", (UINT64)mbi.RegionSize );
+
+    /* decommitted pages in the middle */
+    addr = base + 9 * page_size;
+    size = 500 * page_size;
+    status = NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_DECOMMIT );
+    ok( status == STATUS_SUCCESS, "NtFreeVirtualMemory returned %08x\n", status );
+
+    status = NtQueryVirtualMemory( NtCurrentProcess(), base, MemoryBasicInformation, &mbi, sizeof(mbi), NULL );
+    ok( status == STATUS_SUCCESS, "NtQueryVirtualMemory returned %08x\n", status );
+    ok( mbi.RegionSize == 9 * page_size, "got region size %I64x\n", (UINT64)mbi.RegionSize );
+    ok( mbi.State == MEM_COMMIT, "got state %x\n", mbi.State );
+
+    status = NtQueryVirtualMemory( NtCurrentProcess(), base + 9 * page_size, MemoryBasicInformation,
+                                   &mbi, sizeof(mbi), NULL );
+    ok( status == STATUS_SUCCESS, "NtQueryVirtualMemory returned %08x\n", status );
+    ok( mbi.RegionSize == 500 * page_size, "got region size %I64x\n", (UINT64)mbi.RegionSize );
+    ok( mbi.State == MEM_RESERVE, "got state %x\n", mbi.State );
+
+    status = NtQueryVirtualMemory( NtCurrentProcess(), base + 509 * page_size, MemoryBasicInformation,
+                                   &mbi, sizeof(mbi), NULL );
+    ok( status == STATUS_SUCCESS, "NtQueryVirtualMemory returned %08x\n", status );
+    ok( mbi.RegionSize == (count - 509) * page_size, "got region size %I64x\n", (UINT64)mbi.RegionSize );
+    ok( mbi.State == MEM_COMMIT, "got state %x\n", mbi.State );
+
+    addr = base;
+    size = 0;
+    status = NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+    ok( status == STATUS_SUCCESS, "NtFreeVirtualMemory returned %08x\n", status );
+}
+
 START_TEST(virtual)
 {
     HMODULE mod;
@@ -1128,4 +1215,5 @@ START_TEST(virtual)
     test_NtMapViewOfSection();
     test_user_shared_data();
     test_syscalls();
+    test_protection_ranges();
 }
@@ -115,6 +115,7 @@ struct threadpool
     int                     min_workers;
     int                     num_workers;
     int                     num_busy_workers;
+    int                     num_idle_workers;
     HANDLE                  compl_port;
     TP_POOL_STACK_INFORMATION stack_info;
 };
@@ -196,6 +197,9 @@ struct threadpool_object
             HANDLE          handle;
             DWORD           flags;
             RTL_WAITORTIMERCALLBACKFUNC rtl_callback;
+            /* pending wait completion, for waits handled by the completion port bucket */
+            HANDLE          completion_wait;
+            ULONG_PTR       completion_key;
         } wait;
         struct
         {
@@ -270,12 +274,16 @@ static struct
     CRITICAL_SECTION        cs;
     LONG                    num_buckets;
     struct list             buckets;
+    struct waitqueue_bucket *port_bucket;
+    ULONG_PTR               port_key;
 }
 waitqueue =
 {
     { &waitqueue_debug, -1, 0, 0, 0, 0 },       /* cs */
     0,                                          /* num_buckets */
-    LIST_INIT( waitqueue.buckets )              /* buckets */
+    LIST_INIT( waitqueue.buckets ),             /* buckets */
+    NULL,                                       /* port_bucket */
+    0                                           /* port_key */
 };
 
 static RTL_CRITICAL_SECTION_DEBUG waitqueue_debug =
@@ -293,6 +301,8 @@ struct waitqueue_bucket
     struct list             waiting;
     HANDLE                  update_event;
     BOOL                    alertable;
+    /* completion port receiving the wait completions, the waiting list is then sorted by timeout */
+    HANDLE                  port;
 };
 
 /* global I/O completion queue object */
@@ -1401,48 +1411,270 @@ static void CALLBACK waitqueue_thread_proc( void *param )
 }
 
 /***********************************************************************
- *           tp_waitqueue_lock    (internal)
+ *           tp_waitqueue_cancel_completion    (internal)
+ *
+ * Cancels the pending wait completion of a wait object in the port bucket.
  */
-static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
+static void tp_waitqueue_cancel_completion( struct threadpool_object *wait )
 {
+    BOOLEAN signaled = TRUE;
+
+    if (!wait->u.wait.completion_wait) return;
+
+    if (unix_funcs->cancel_wait_completion( wait->u.wait.completion_wait, &signaled ))
+    {
+        /* Keep the reference, in case a completion has been posted. */
+        ERR( "failed to cancel wait completion for %p\n", wait );
+        NtClose( wait->u.wait.completion_wait );
+    }
+
+    wait->u.wait.completion_wait = NULL;
+    wait->u.wait.completion_key  = 0;
+
+    /* Once posted, the reference is released when the completion is dequeued.
+     * Otherwise drop it here; the caller still holds one, so it is never the last. */
+    if (!signaled) InterlockedDecrement( &wait->refcount );
+}
+
+/***********************************************************************
+ *           tp_waitqueue_set_completion    (internal)
+ *
+ * Starts waiting for a wait object in the port bucket. Returns FALSE if the
+ * server can't wait for the object that way.
+ */
+static BOOL tp_waitqueue_set_completion( struct waitqueue_bucket *bucket, struct threadpool_object *wait )
+{
+    struct threadpool_object *other;
+    struct list *ptr = &bucket->waiting;
+    NTSTATUS status;
+
+    if (!++waitqueue.port_key) ++waitqueue.port_key;
+    wait->u.wait.completion_key = waitqueue.port_key;
+
+    InterlockedIncrement( &wait->refcount );
+    if ((status = unix_funcs->create_wait_completion( bucket->port, wait->u.wait.handle,
+                                                      wait->u.wait.completion_key, (ULONG_PTR)wait,
+                                                      &wait->u.wait.completion_wait )))
+    {
+        TRACE( "can't wait for %p with a completion, status %x\n", wait->u.wait.handle, status );
+        wait->u.wait.completion_wait = NULL;
+        wait->u.wait.completion_key  = 0;
+        InterlockedDecrement( &wait->refcount );
+        return FALSE;
+    }
+
+    /* Keep the waiting list sorted by timeout. */
+    LIST_FOR_EACH_ENTRY_REV( other, &bucket->waiting, struct threadpool_object, u.wait.wait_entry )
+    {
+        if (other->u.wait.timeout <= wait->u.wait.timeout)
+        {
+            ptr = &other->u.wait.wait_entry;
+            break;
+        }
+    }
+    list_add_after( ptr, &wait->u.wait.wait_entry );
+
+    /* Wake up the wait queue thread if the next timeout changed. */
+    if (list_head( &bucket->waiting ) == &wait->u.wait.wait_entry && wait->u.wait.timeout != MAXLONGLONG)
+        NtSetIoCompletion( bucket->port, 0, 0, STATUS_SUCCESS, 0 );
+    return TRUE;
+}
+
+static NTSTATUS tp_waitqueue_add_to_handle_bucket( struct threadpool_object *wait );
+
+/***********************************************************************
+ *           tp_waitqueue_set_handle_wait    (internal)
+ *
+ * Moves a wait object out of the port bucket into a bucket with its own
+ * wait thread, for objects that the server can't wait for with a
+ * completion. The object must not be on any bucket list. Must be called
+ * with waitqueue.cs held.
+ */
+static void tp_waitqueue_set_handle_wait( struct threadpool_object *wait )
+{
+    struct waitqueue_bucket *port_bucket = wait->u.wait.bucket;
     struct waitqueue_bucket *bucket;
     NTSTATUS status;
-    HANDLE thread;
-    BOOL alertable = (wait->u.wait.flags & WT_EXECUTEINIOTHREAD) != 0;
-    assert( wait->type == TP_OBJECT_TYPE_WAIT );
 
-    wait->u.wait.signaled       = 0;
-    wait->u.wait.bucket         = NULL;
-    wait->u.wait.wait_pending   = FALSE;
-    wait->u.wait.timeout        = 0;
-    wait->u.wait.handle         = INVALID_HANDLE_VALUE;
+    if ((status = tp_waitqueue_add_to_handle_bucket( wait )))
+    {
+        /* Only the timeout can fire now, but that's the best we can do. */
+        ERR( "failed to wait for %p, status %x\n", wait->u.wait.handle, status );
+        list_add_tail( &port_bucket->waiting, &wait->u.wait.wait_entry );
+        return;
+    }
+
+    bucket = wait->u.wait.bucket;
+    list_add_tail( &bucket->waiting, &wait->u.wait.wait_entry );
+    NtSetEvent( bucket->update_event, NULL );
+
+    if (!--port_bucket->objcount) NtSetIoCompletion( port_bucket->port, 0, 0, STATUS_SUCCESS, 0 );
+}
+
+/***********************************************************************
+ *           waitqueue_port_thread_proc    (internal)
+ *
+ * Wait queue thread for the port bucket. The server posts a completion
+ * for each signaled wait object, so that there is no limit on the number
+ * of objects handled by a single thread.
+ */
+static void CALLBACK waitqueue_port_thread_proc( void *param )
+{
+    struct waitqueue_bucket *bucket = param;
+    struct threadpool_object *wait, *next, *release = NULL;
+    LARGE_INTEGER now, timeout;
+    ULONG_PTR key, value;
+    IO_STATUS_BLOCK iosb;
+    NTSTATUS status;
+
+    TRACE( "starting wait queue port thread\n" );
 
     RtlEnterCriticalSection( &waitqueue.cs );
 
+    for (;;)
+    {
+        NtQuerySystemTime( &now );
+        timeout.QuadPart = MAXLONGLONG;
+
+        LIST_FOR_EACH_ENTRY_SAFE( wait, next, &bucket->waiting, struct threadpool_object,
+                                  u.wait.wait_entry )
+        {
+            assert( wait->type == TP_OBJECT_TYPE_WAIT );
+            if (wait->u.wait.timeout > now.QuadPart)
+            {
+                timeout.QuadPart = wait->u.wait.timeout;
+                break;
+            }
+
+            /* Wait object timed out. */
+            list_remove( &wait->u.wait.wait_entry );
+            list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+            tp_object_submit( wait, FALSE );
+            tp_waitqueue_cancel_completion( wait );
+        }
+
+        /* All wait objects have been destroyed, if no new wait objects are created
+         * within some amount of time, then we can shutdown this thread. */
+        if (!bucket->objcount)
+            timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+
+        RtlLeaveCriticalSection( &waitqueue.cs );
+
+        /* The last reference may unload a DLL, which takes the loader lock. */
+        if (release) tp_object_release( release );
+        release = NULL;
+
+        status = NtRemoveIoCompletion( bucket->port, &key, &value, &iosb, &timeout );
+        RtlEnterCriticalSection( &waitqueue.cs );
+
+        if (status == STATUS_TIMEOUT && !bucket->objcount)
+            break;
+        if (status || !key) continue;
+
+        wait = (struct threadpool_object *)value;
+        assert( wait->type == TP_OBJECT_TYPE_WAIT );
+        if (wait->u.wait.bucket == bucket && wait->u.wait.completion_key == key)
+        {
+            /* Wait object signaled. */
+            NtClose( wait->u.wait.completion_wait );
+            wait->u.wait.completion_wait = NULL;
+            wait->u.wait.completion_key  = 0;
+            list_remove( &wait->u.wait.wait_entry );
+            list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+            tp_object_submit( wait, TRUE );
+        }
+
+        /* Release the reference held by the wait completion, once out of waitqueue.cs. */
+        release = wait;
+    }
+
+    waitqueue.port_bucket = NULL;
+
+    RtlLeaveCriticalSection( &waitqueue.cs );
+
+    TRACE( "terminating wait queue port thread\n" );
+
+    assert( bucket->objcount == 0 );
+    assert( list_empty( &bucket->reserved ) );
+    assert( list_empty( &bucket->waiting ) );
+    NtClose( bucket->port );
+
+    RtlFreeHeap( GetProcessHeap(), 0, bucket );
+    RtlExitUserThread( 0 );
+}
+
+/***********************************************************************
+ *           tp_waitqueue_get_port_bucket    (internal)
+ *
+ * Returns the port bucket, creating it if needed. Must be called with waitqueue.cs held.
+ */
+static struct waitqueue_bucket *tp_waitqueue_get_port_bucket(void)
+{
+    struct waitqueue_bucket *bucket;
+    HANDLE thread;
+
+    if (waitqueue.port_bucket) return waitqueue.port_bucket;
+
+    if (!(bucket = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*bucket) )))
+        return NULL;
+
+    bucket->objcount = 0;
+    bucket->alertable = FALSE;
+    bucket->update_event = NULL;
+    list_init( &bucket->reserved );
+    list_init( &bucket->waiting );
+
+    if (NtCreateIoCompletion( &bucket->port, IO_COMPLETION_ALL_ACCESS, NULL, 1 ))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, bucket );
+        return NULL;
+    }
+
+    if (RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, 0, 0, 0,
+                             waitqueue_port_thread_proc, bucket, &thread, NULL ))
+    {
+        NtClose( bucket->port );
+        RtlFreeHeap( GetProcessHeap(), 0, bucket );
+        return NULL;
+    }
+
+    NtClose( thread );
+    return waitqueue.port_bucket = bucket;
+}
+
+/***********************************************************************
+ *           tp_waitqueue_add_to_handle_bucket    (internal)
+ *
+ * Assigns a wait object to a bucket with its own wait thread, creating it
+ * if needed. The caller adds the object to one of the bucket lists. Must be
+ * called with waitqueue.cs held.
+ */
+static NTSTATUS tp_waitqueue_add_to_handle_bucket( struct threadpool_object *wait )
+{
+    struct waitqueue_bucket *bucket;
+    NTSTATUS status;
+    HANDLE thread;
+    BOOL alertable = (wait->u.wait.flags & WT_EXECUTEINIOTHREAD) != 0;
+
     /* Try to assign to existing bucket if possible. */
     LIST_FOR_EACH_ENTRY( bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
     {
         if (bucket->objcount < MAXIMUM_WAITQUEUE_OBJECTS && bucket->alertable == alertable)
         {
-            list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
             wait->u.wait.bucket = bucket;
             bucket->objcount++;
 
-            status = STATUS_SUCCESS;
-            goto out;
+            return STATUS_SUCCESS;
         }
     }
 
     /* Create a new bucket and corresponding worker thread. */
     bucket = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*bucket) );
-    if (!bucket)
-    {
-        status = STATUS_NO_MEMORY;
-        goto out;
-    }
+    if (!bucket) return STATUS_NO_MEMORY;
 
     bucket->objcount = 0;
     bucket->alertable = alertable;
+    bucket->port = NULL;
     list_init( &bucket->reserved );
     list_init( &bucket->waiting );
 
@@ -1451,7 +1683,7 @@ static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
     if (status)
     {
         RtlFreeHeap( GetProcessHeap(), 0, bucket );
-        goto out;
+        return status;
     }
 
     status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, 0, 0, 0,
@@ -1461,7 +1693,6 @@ static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
         list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
         waitqueue.num_buckets++;
 
-        list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
         wait->u.wait.bucket = bucket;
         bucket->objcount++;
 
@@ -1473,6 +1704,44 @@ static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
         RtlFreeHeap( GetProcessHeap(), 0, bucket );
     }
 
+    return status;
+}
+
+/***********************************************************************
+ *           tp_waitqueue_lock    (internal)
+ */
+static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
+{
+    struct waitqueue_bucket *bucket;
+    NTSTATUS status;
+    assert( wait->type == TP_OBJECT_TYPE_WAIT );
+
+    wait->u.wait.signaled       = 0;
+    wait->u.wait.bucket         = NULL;
+    wait->u.wait.wait_pending   = FALSE;
+    wait->u.wait.timeout        = 0;
+    wait->u.wait.handle         = INVALID_HANDLE_VALUE;
+    wait->u.wait.completion_wait = NULL;
+    wait->u.wait.completion_key  = 0;
+
+    RtlEnterCriticalSection( &waitqueue.cs );
+
+    /* One-shot waits don't need a dedicated thread, use the port bucket for them. */
+    if ((wait->u.wait.flags & WT_EXECUTEONLYONCE) &&
+        !(wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)) &&
+        (bucket = tp_waitqueue_get_port_bucket()))
+    {
+        list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+        wait->u.wait.bucket = bucket;
+        bucket->objcount++;
+
+        status = STATUS_SUCCESS;
+        goto out;
+    }
+
+    if (!(status = tp_waitqueue_add_to_handle_bucket( wait )))
+        list_add_tail( &wait->u.wait.bucket->reserved, &wait->u.wait.wait_entry );
+
 out:
     RtlLeaveCriticalSection( &waitqueue.cs );
     return status;
@@ -1495,7 +1764,12 @@ static void tp_waitqueue_unlock( struct threadpool_object *wait )
         wait->u.wait.bucket = NULL;
         bucket->objcount--;
 
-        NtSetEvent( bucket->update_event, NULL );
+        if (bucket->port)
+        {
+            tp_waitqueue_cancel_completion( wait );
+            if (!bucket->objcount) NtSetIoCompletion( bucket->port, 0, 0, STATUS_SUCCESS, 0 );
+        }
+        else NtSetEvent( bucket->update_event, NULL );
     }
     RtlLeaveCriticalSection( &waitqueue.cs );
 }
@@ -1650,6 +1924,7 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
     pool->min_workers             = 0;
     pool->num_workers             = 0;
     pool->num_busy_workers        = 0;
+    pool->num_idle_workers        = 0;
     pool->stack_info.StackReserve = nt->OptionalHeader.SizeOfStackReserve;
     pool->stack_info.StackCommit  = nt->OptionalHeader.SizeOfStackCommit;
 
@@ -1967,11 +2242,13 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
     if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
         object->u.wait.signaled++;
 
-    /* No new thread started - wake up one existing thread. */
+    /* No new thread started - wake up one existing thread. Busy threads
+     * pick up the work item on their own once the callback returns. */
     if (status != STATUS_SUCCESS)
     {
         assert( pool->num_workers > 0 );
-        RtlWakeConditionVariable( &pool->update_event );
+        if (pool->num_idle_workers)
+            RtlWakeConditionVariable( &pool->update_event );
     }
 
     RtlLeaveCriticalSection( &pool->cs );
@@ -2278,6 +2555,7 @@ static void CALLBACK threadpool_worker_proc( void *param )
 {
     struct threadpool *pool = param;
     LARGE_INTEGER timeout;
+    NTSTATUS status;
     struct list *ptr;
 
     TRACE( "starting worker thread for pool %p\n", pool );
@@ -2314,9 +2592,11 @@ static void CALLBACK threadpool_worker_proc( void *param )
          * min_workers == 0, then objcount is used to detect if the last thread
          * can be terminated. */
         timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
-        if (RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout ) == STATUS_TIMEOUT &&
-            !threadpool_get_next_item( pool ) && (pool->num_workers > max( pool->min_workers, 1 ) ||
-            (!pool->min_workers && !pool->objcount)))
+        pool->num_idle_workers++;
+        status = RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout );
+        pool->num_idle_workers--;
+        if (status == STATUS_TIMEOUT && !threadpool_get_next_item( pool ) &&
+            (pool->num_workers > max( pool->min_workers, 1 ) || (!pool->min_workers && !pool->objcount)))
         {
             break;
         }
@@ -2997,6 +3277,7 @@ VOID WINAPI TpSetWait( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout )
     {
         struct waitqueue_bucket *bucket = this->u.wait.bucket;
         list_remove( &this->u.wait.wait_entry );
+        if (bucket->port) tp_waitqueue_cancel_completion( this );
 
         /* Convert relative timeout to absolute timestamp. */
         if (handle && timeout)
@@ -3013,9 +3294,10 @@ VOID WINAPI TpSetWait( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout )
         /* Add wait object back into one of the queues. */
         if (handle)
         {
-            list_add_tail( &bucket->waiting, &this->u.wait.wait_entry );
             this->u.wait.wait_pending = TRUE;
             this->u.wait.timeout = timestamp;
+            if (!bucket->port) list_add_tail( &bucket->waiting, &this->u.wait.wait_entry );
+            else if (!tp_waitqueue_set_completion( bucket, this )) tp_waitqueue_set_handle_wait( this );
         }
         else
         {
@@ -3024,7 +3306,7 @@ VOID WINAPI TpSetWait( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout )
         }
 
         /* Wake up the wait queue thread. */
-        NtSetEvent( bucket->update_event, NULL );
+        if (!bucket->port) NtSetEvent( bucket->update_event, NULL );
     }
 
     RtlLeaveCriticalSection( &waitqueue.cs );
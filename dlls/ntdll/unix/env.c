@@ -1381,51 +1381,75 @@ static WCHAR *expand_value( WCHAR *env, SIZE_T size, const WCHAR *src, SIZE_T sr
 }
 
 /***********************************************************************
- *           add_registry_variables
+ *           add_registry_variable
  *
- * Set environment variables by enumerating the values of a key;
- * helper for add_registry_environment().
- * Note that Windows happily truncates the value if it's too big.
+ * Set an environment variable from a registry value.
  */
-static void add_registry_variables( WCHAR **env, SIZE_T *pos, SIZE_T *size, HANDLE key )
+static void add_registry_variable( WCHAR **env, SIZE_T *pos, SIZE_T *size, KEY_VALUE_FULL_INFORMATION *info )
 {
     static const WCHAR pathW[] = {'P','A','T','H'};
-    NTSTATUS status;
-    DWORD index = 0, info_size, namelen, datalen;
+    DWORD namelen, datalen;
     WCHAR *data, *value, *p;
-    WCHAR buffer[offsetof(KEY_VALUE_FULL_INFORMATION, Name[1024]) / sizeof(WCHAR)];
-    KEY_VALUE_FULL_INFORMATION *info = (KEY_VALUE_FULL_INFORMATION *)buffer;
 
-    for (;;)
+    value = data = (WCHAR *)((char *)info + info->DataOffset);
+    datalen = info->DataLength / sizeof(WCHAR);
+    namelen = info->NameLength / sizeof(WCHAR);
+
+    if (datalen && !data[datalen - 1]) datalen--;  /* don't count terminating null if any */
+    if (!datalen) return;
+    data[datalen] = 0;
+    if (info->Type == REG_EXPAND_SZ) value = expand_value( *env, *pos, data, datalen );
+
+    /* PATH is magic */
+    if (namelen == 4 && !wcsnicmp( info->Name, pathW, 4 ) && (p = find_env_var( *env, *pos, pathW, 4 )))
     {
-        status = NtEnumerateValueKey( key, index++, KeyValueFullInformation,
-                                      buffer, sizeof(buffer) - sizeof(WCHAR), &info_size );
-        if (status != STATUS_SUCCESS && status != STATUS_BUFFER_OVERFLOW) break;
+        static const WCHAR sepW[] = {';',0};
+        WCHAR *newpath = malloc( (wcslen(p) - 3 + wcslen(value)) * sizeof(WCHAR) );
+        wcscpy( newpath, p + 5 );
+        wcscat( newpath, sepW );
+        wcscat( newpath, value );
+        if (value != data) free( value );
+        value = newpath;
+    }
 
-        value = data = buffer + info->DataOffset / sizeof(WCHAR);
-        datalen = info->DataLength / sizeof(WCHAR);
-        namelen = info->NameLength / sizeof(WCHAR);
+    set_env_var( env, pos, size, info->Name, namelen, value );
+    if (value != data) free( value );
+}
 
-        if (datalen && !data[datalen - 1]) datalen--;  /* don't count terminating null if any */
-        if (!datalen) continue;
-        data[datalen] = 0;
-        if (info->Type == REG_EXPAND_SZ) value = expand_value( *env, *pos, data, datalen );
 
-        /* PATH is magic */
-        if (namelen == 4 && !wcsnicmp( info->Name, pathW, 4 ) && (p = find_env_var( *env, *pos, pathW, 4 )))
+/***********************************************************************
+ *           add_registry_variables
+ *
+ * Set environment variables by enumerating the values of a key;
+ * helper for add_registry_environment().
+ * Note that Windows happily truncates the value if it's too big.
+ */
+static void add_registry_variables( WCHAR **env, SIZE_T *pos, SIZE_T *size, HANDLE key )
+{
+    static const DWORD info_size = offsetof( KEY_VALUE_FULL_INFORMATION, Name[1024] );
+    KEY_VALUE_FULL_INFORMATION *infos[8];
+    NTSTATUS status[8];
+    DWORD index, i;
+    char *buffer;
+
+    /* fetch the values in batches, to save server round trips */
+    if (!(buffer = malloc( ARRAY_SIZE(infos) * info_size ))) return;
+    for (i = 0; i < ARRAY_SIZE(infos); i++) infos[i] = (KEY_VALUE_FULL_INFORMATION *)(buffer + i * info_size);
+
+    for (index = 0; ; index += ARRAY_SIZE(infos))
+    {
+        /* leave room for the null terminator */
+        enum_key_values( key, index, ARRAY_SIZE(infos), infos, info_size - sizeof(WCHAR), status );
+        for (i = 0; i < ARRAY_SIZE(infos); i++)
         {
-            static const WCHAR sepW[] = {';',0};
-            WCHAR *newpath = malloc( (wcslen(p) - 3 + wcslen(value)) * sizeof(WCHAR) );
-            wcscpy( newpath, p + 5 );
-            wcscat( newpath, sepW );
-            wcscat( newpath, value );
-            if (value != data) free( value );
-            value = newpath;
+            if (status[i] != STATUS_SUCCESS && status[i] != STATUS_BUFFER_OVERFLOW) goto done;
+            if (infos[i]->DataOffset > info_size - sizeof(WCHAR)) continue;
+            infos[i]->DataLength = min( infos[i]->DataLength, info_size - sizeof(WCHAR) - infos[i]->DataOffset );
+            add_registry_variable( env, pos, size, infos[i] );
         }
-
-        set_env_var( env, pos, size, info->Name, namelen, value );
-        if (value != data) free( value );
     }
+done:
+    free( buffer );
 }
 
 
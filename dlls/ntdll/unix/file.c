@@ -1408,6 +1408,25 @@ static BOOLEAN is_legal_8dot3_name( const WCHAR *name, int len )
 }
 
 
+/***********************************************************************
+ *           add_dir_data_entry
+ *
+ * Add the converted names of a file to the directory data if they match the mask.
+ */
+static BOOL add_dir_data_entry( struct dir_data *data, const WCHAR *long_nameW, int long_len,
+                                const WCHAR *short_nameW, int short_len, const char *unix_name,
+                                const UNICODE_STRING *mask )
+{
+    if (mask && !match_filename( long_nameW, long_len, mask ))
+    {
+        if (!short_len) return TRUE;  /* no short name to match */
+        if (!match_filename( short_nameW, short_len, mask )) return TRUE;
+    }
+
+    return add_dir_data_names( data, long_nameW, short_nameW, unix_name );
+}
+
+
 /***********************************************************************
  *           append_entry
  *
@@ -1441,13 +1460,7 @@ static BOOL append_entry( struct dir_data *data, const char *long_name,
     TRACE( "long %s short %s mask %s\n",
            debugstr_w( long_nameW ), debugstr_w( short_nameW ), debugstr_us( mask ));
 
-    if (mask && !match_filename( long_nameW, long_len, mask ))
-    {
-        if (!short_len) return TRUE;  /* no short name to match */
-        if (!match_filename( short_nameW, short_len, mask )) return TRUE;
-    }
-
-    return add_dir_data_names( data, long_nameW, short_nameW, long_name );
+    return add_dir_data_entry( data, long_nameW, long_len, short_nameW, short_len, long_name, mask );
 }
 
 
@@ -2232,12 +2245,177 @@ done:
 }
 
 
+/* entry of a directory snapshot shared between processes through the server */
+struct dir_snapshot_entry
+{
+    unsigned short long_len;    /* length of the long name in WCHARs */
+    unsigned short short_len;   /* length of the short name in WCHARs */
+    unsigned short unix_len;    /* length of the Unix name in bytes */
+    WCHAR          names[1];    /* long name, short name and Unix name, not null-terminated */
+};
+
+static inline data_size_t dir_snapshot_entry_size( unsigned int long_len, unsigned int short_len,
+                                                   unsigned int unix_len )
+{
+    data_size_t size = offsetof( struct dir_snapshot_entry, names[long_len + short_len] ) + unix_len;
+    return (size + sizeof(WCHAR) - 1) & ~(sizeof(WCHAR) - 1);
+}
+
+/* build the snapshot data of a full directory listing */
+static void *build_dir_snapshot( const struct dir_data *data, data_size_t *ret_size )
+{
+    struct dir_snapshot_entry *entry;
+    data_size_t size = 0;
+    unsigned int i, long_len, short_len, unix_len;
+    char *buffer, *ptr;
+
+    for (i = 0; i < data->count; i++)
+        size += dir_snapshot_entry_size( wcslen( data->names[i].long_name ), wcslen( data->names[i].short_name ),
+                                         strlen( data->names[i].unix_name ));
+    if (!(buffer = malloc( size ))) return NULL;
+
+    for (i = 0, ptr = buffer; i < data->count; i++)
+    {
+        entry = (struct dir_snapshot_entry *)ptr;
+        entry->long_len  = long_len  = wcslen( data->names[i].long_name );
+        entry->short_len = short_len = wcslen( data->names[i].short_name );
+        entry->unix_len  = unix_len  = strlen( data->names[i].unix_name );
+        memcpy( entry->names, data->names[i].long_name, long_len * sizeof(WCHAR) );
+        memcpy( entry->names + long_len, data->names[i].short_name, short_len * sizeof(WCHAR) );
+        memcpy( entry->names + long_len + short_len, data->names[i].unix_name, unix_len );
+        ptr += dir_snapshot_entry_size( long_len, short_len, unix_len );
+    }
+    *ret_size = size;
+    return buffer;
+}
+
+/* add the entries of a directory snapshot that match the mask */
+static BOOL read_dir_snapshot( struct dir_data *data, const char *ptr, data_size_t size,
+                               const UNICODE_STRING *mask )
+{
+    const char *end = ptr + size;
+    WCHAR long_nameW[MAX_DIR_ENTRY_LEN + 1];
+    WCHAR short_nameW[13];
+    char unix_name[MAX_DIR_ENTRY_LEN * 3 + 1];
+
+    while (ptr < end)
+    {
+        const struct dir_snapshot_entry *entry = (const struct dir_snapshot_entry *)ptr;
+
+        if (end - ptr < offsetof( struct dir_snapshot_entry, names )) return FALSE;
+        if (entry->long_len > MAX_DIR_ENTRY_LEN || entry->short_len >= ARRAY_SIZE(short_nameW) ||
+            entry->unix_len >= sizeof(unix_name)) return FALSE;
+        if (end - ptr < dir_snapshot_entry_size( entry->long_len, entry->short_len, entry->unix_len ))
+            return FALSE;
+
+        memcpy( long_nameW, entry->names, entry->long_len * sizeof(WCHAR) );
+        long_nameW[entry->long_len] = 0;
+        memcpy( short_nameW, entry->names + entry->long_len, entry->short_len * sizeof(WCHAR) );
+        short_nameW[entry->short_len] = 0;
+        memcpy( unix_name, entry->names + entry->long_len + entry->short_len, entry->unix_len );
+        unix_name[entry->unix_len] = 0;
+
+        if (!add_dir_data_entry( data, long_nameW, entry->long_len, short_nameW, entry->short_len,
+                                 unix_name, mask ))
+            return FALSE;
+        ptr += dir_snapshot_entry_size( entry->long_len, entry->short_len, entry->unix_len );
+    }
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           read_directory_data_snapshot
+ *
+ * Read the directory contents from the snapshot shared by the server, or
+ * read the full directory with readdir and give it to the server for other
+ * processes.
+ */
+static NTSTATUS read_directory_data_snapshot( HANDLE handle, struct dir_data *data, int fd,
+                                              const UNICODE_STRING *mask )
+{
+    LARGE_INTEGER mtime, ctime, atime, creation;
+    struct dir_data *full;
+    data_size_t size = 0x10000, total = 0;
+    struct stat st;
+    NTSTATUS status;
+    unsigned int i;
+    void *buffer;
+
+    for (;;)
+    {
+        if (!(buffer = malloc( size ))) return STATUS_NO_MEMORY;
+        SERVER_START_REQ( get_directory_snapshot )
+        {
+            req->handle = wine_server_obj_handle( handle );
+            wine_server_set_reply( req, buffer, size );
+            status = wine_server_call( req );
+            total = status ? reply->total : wine_server_reply_size( reply );
+        }
+        SERVER_END_REQ;
+        if (status != STATUS_BUFFER_TOO_SMALL) break;
+        free( buffer );
+        size = total;
+    }
+    if (!status)
+    {
+        BOOL ret = read_dir_snapshot( data, buffer, total, mask );
+
+        free( buffer );
+        if (ret) return STATUS_SUCCESS;
+        data->count = 0;
+        return STATUS_NO_MEMORY;
+    }
+    free( buffer );
+
+    /* read the full directory and share it; its times are taken first */
+    /* so that the server can detect changes that happen while reading */
+    if (fstat( fd, &st ) == -1) return errno_to_status( errno );
+    get_file_times( &st, &mtime, &ctime, &atime, &creation );
+
+    if (!(full = calloc( 1, sizeof(*full) ))) return STATUS_NO_MEMORY;
+    if ((status = read_directory_data_readdir( full, NULL ))) goto done;
+
+    if ((buffer = build_dir_snapshot( full, &size )))
+    {
+        SERVER_START_REQ( set_directory_snapshot )
+        {
+            req->handle = wine_server_obj_handle( handle );
+            req->mtime  = mtime.QuadPart;
+            req->ctime  = ctime.QuadPart;
+            wine_server_add_data( req, buffer, size );
+            wine_server_call( req );
+        }
+        SERVER_END_REQ;
+        free( buffer );
+    }
+
+    for (i = 0; i < full->count; i++)
+    {
+        const struct dir_data_names *names = &full->names[i];
+
+        if (!add_dir_data_entry( data, names->long_name, wcslen( names->long_name ), names->short_name,
+                                 wcslen( names->short_name ), names->unix_name, mask ))
+        {
+            data->count = 0;
+            status = STATUS_NO_MEMORY;
+            break;
+        }
+    }
+
+done:
+    free_dir_data( full );
+    return status;
+}
+
+
 /***********************************************************************
  *           read_directory_data
  *
  * Read the full contents of a directory, using one of the above helper functions.
  */
-static NTSTATUS read_directory_data( struct dir_data *data, int fd, const UNICODE_STRING *mask )
+static NTSTATUS read_directory_data( HANDLE handle, struct dir_data *data, int fd,
+                                     const UNICODE_STRING *mask )
 {
     NTSTATUS status;
 
@@ -2261,6 +2439,7 @@ static NTSTATUS read_directory_data( struct dir_data *data, int fd, const UNICOD
         }
     }
 
+    if (!(status = read_directory_data_snapshot( handle, data, fd, mask ))) return status;
     return read_directory_data_readdir( data, mask );
 }
 
@@ -2281,7 +2460,8 @@ static int name_compare( const void *a, const void *b )
  *
  * Initialize the cached directory contents.
  */
-static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const UNICODE_STRING *mask )
+static NTSTATUS init_cached_dir_data( HANDLE handle, struct dir_data **data_ret, int fd,
+                                      const UNICODE_STRING *mask )
 {
     struct dir_data *data;
     struct stat st;
@@ -2290,7 +2470,7 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
 
     if (!(data = calloc( 1, sizeof(*data) ))) return STATUS_NO_MEMORY;
 
-    if ((status = read_directory_data( data, fd, mask )))
+    if ((status = read_directory_data( handle, data, fd, mask )))
     {
         free_dir_data( data );
         return status;
@@ -2365,7 +2545,7 @@ static NTSTATUS get_cached_dir_data( HANDLE handle, struct dir_data **data_ret,
         dir_data_cache_size = size;
     }
 
-    if (!dir_data_cache[entry]) status = init_cached_dir_data( &dir_data_cache[entry], fd, mask );
+    if (!dir_data_cache[entry]) status = init_cached_dir_data( handle, &dir_data_cache[entry], fd, mask );
 
     *data_ret = dir_data_cache[entry];
     return status;
@@ -2467,6 +2647,165 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event, PIO_APC_ROUTI
 }
 
 
+/* case-insensitive index of the file names of a directory */
+struct dir_name_index
+{
+    struct list      entry;      /* entry in the list of cached indexes */
+    struct dir_data *data;       /* upper-case and Unix names, and directory identity */
+    LARGE_INTEGER    mtime;      /* directory modification time when the names were read */
+    LARGE_INTEGER    ctime;      /* directory change time when the names were read */
+    unsigned int     hash_size;  /* size of the hash table, a power of two */
+    unsigned int    *hash;       /* first name of each hash chain, plus one */
+    unsigned int    *next;       /* next name in the hash chain, plus one */
+};
+
+#define MAX_DIR_NAME_INDEXES 64  /* max number of cached directory indexes */
+
+static struct list dir_name_indexes = LIST_INIT( dir_name_indexes );  /* most recently used first */
+static unsigned int dir_name_index_count;
+static pthread_mutex_t dir_name_index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int hash_dir_name( const WCHAR *name, int length )
+{
+    unsigned int hash = 0;
+    int i;
+
+    for (i = 0; i < length; i++) hash = hash * 31 + towupper( name[i] );
+    return hash;
+}
+
+static void free_dir_name_index( struct dir_name_index *index )
+{
+    free_dir_data( index->data );
+    free( index->hash );
+    free( index );
+}
+
+/* read the names of a directory into a new index */
+static struct dir_name_index *create_dir_name_index( const char *unix_name, const struct stat *st )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN + 1];
+    LARGE_INTEGER atime, creation;
+    struct dir_name_index *index;
+    struct dirent *de;
+    unsigned int i, count, hash;
+    DIR *dir;
+    int len;
+
+    if (!(dir = opendir( unix_name ))) return NULL;
+    if (!(index = calloc( 1, sizeof(*index) ))) goto failed;
+    if (!(index->data = calloc( 1, sizeof(*index->data) ))) goto failed;
+
+    while ((de = readdir( dir )))
+    {
+        len = ntdll_umbstowcs( de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
+        buffer[len] = 0;
+        wcsupr( buffer );
+        if (!add_dir_data_names( index->data, buffer, buffer + len, de->d_name )) goto failed;
+    }
+    closedir( dir );
+    dir = NULL;
+
+    count = index->data->count;
+    for (index->hash_size = 16; index->hash_size < count; index->hash_size *= 2) ;
+    if (!(index->hash = calloc( index->hash_size + count, sizeof(*index->hash) ))) goto failed;
+    index->next = index->hash + index->hash_size;
+    /* insert backwards so that chains keep the readdir order */
+    for (i = count; i > 0; i--)
+    {
+        const WCHAR *name = index->data->names[i - 1].long_name;
+
+        hash = hash_dir_name( name, wcslen( name )) & (index->hash_size - 1);
+        index->next[i - 1] = index->hash[hash];
+        index->hash[hash] = i;
+    }
+
+    index->data->id.dev = st->st_dev;
+    index->data->id.ino = st->st_ino;
+    get_file_times( st, &index->mtime, &index->ctime, &atime, &creation );
+    return index;
+
+failed:
+    if (dir) closedir( dir );
+    if (index) free_dir_name_index( index );
+    return NULL;
+}
+
+/***********************************************************************
+ *           find_name_in_dir_index
+ *
+ * Look up a file name case-insensitively in the cached index of a directory,
+ * and copy the matching Unix name to unix_name_ret.
+ * Returns 1 if found, 0 if not found, and -1 if the index can't be used.
+ */
+static int find_name_in_dir_index( const char *unix_name, const WCHAR *name, int length,
+                                   char *unix_name_ret )
+{
+    struct dir_name_index *index = NULL, *iter;
+    LARGE_INTEGER mtime, ctime, atime, creation;
+    unsigned int i;
+    struct stat st;
+    int ret = 0;
+
+    if (stat( unix_name, &st ) == -1) return -1;
+    /* a directory modified within the last second may change again without a visible
+     * timestamp change; don't index it until it settles, a plain scan is cheaper */
+    if (st.st_mtime >= time(NULL) - 1 || st.st_ctime >= time(NULL) - 1) return -1;
+    get_file_times( &st, &mtime, &ctime, &atime, &creation );
+
+    mutex_lock( &dir_name_index_mutex );
+    LIST_FOR_EACH_ENTRY( iter, &dir_name_indexes, struct dir_name_index, entry )
+    {
+        if (iter->data->id.dev != st.st_dev || iter->data->id.ino != st.st_ino) continue;
+        if (iter->mtime.QuadPart == mtime.QuadPart && iter->ctime.QuadPart == ctime.QuadPart)
+        {
+            index = iter;
+            list_remove( &index->entry );
+            list_add_head( &dir_name_indexes, &index->entry );
+        }
+        break;
+    }
+
+    if (!index)
+    {
+        /* don't hold the mutex while reading the directory */
+        mutex_unlock( &dir_name_index_mutex );
+        if (!(index = create_dir_name_index( unix_name, &st ))) return -1;
+        mutex_lock( &dir_name_index_mutex );
+
+        LIST_FOR_EACH_ENTRY( iter, &dir_name_indexes, struct dir_name_index, entry )
+        {
+            if (iter->data->id.dev != st.st_dev || iter->data->id.ino != st.st_ino) continue;
+            list_remove( &iter->entry );
+            free_dir_name_index( iter );
+            dir_name_index_count--;
+            break;
+        }
+        list_add_head( &dir_name_indexes, &index->entry );
+        if (++dir_name_index_count > MAX_DIR_NAME_INDEXES)
+        {
+            iter = LIST_ENTRY( list_tail( &dir_name_indexes ), struct dir_name_index, entry );
+            list_remove( &iter->entry );
+            free_dir_name_index( iter );
+            dir_name_index_count--;
+        }
+    }
+
+    /* the index may be freed by other threads as soon as the mutex is released */
+    for (i = index->hash[hash_dir_name( name, length ) & (index->hash_size - 1)]; i; i = index->next[i - 1])
+    {
+        const struct dir_data_names *names = &index->data->names[i - 1];
+
+        if (wcsnicmp( names->long_name, name, length ) || names->long_name[length]) continue;
+        strcpy( unix_name_ret, names->unix_name );
+        ret = 1;
+        break;
+    }
+    mutex_unlock( &dir_name_index_mutex );
+    return ret;
+}
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2557,6 +2896,17 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     }
 #endif /* VFAT_IOCTL_READDIR_BOTH */
 
+    /* short names are computed from the long names, they are not in the index */
+    switch (find_name_in_dir_index( unix_name, name, length, unix_name + pos ))
+    {
+    case 1:
+        unix_name[pos - 1] = '/';
+        return STATUS_SUCCESS;
+    case 0:
+        if (!is_name_8_dot_3 || length < 8 || name[4] != '~') goto not_found;
+        break;
+    }
+
     if (!(dir = opendir( unix_name ))) return errno_to_status( errno );
 
     unix_name[pos - 1] = '/';
@@ -852,8 +852,7 @@ static void load_ntdll_functions( HMODULE module )
 }
 
 /* reimplementation of LdrProcessRelocationBlock */
-static IMAGE_BASE_RELOCATION *process_relocation_block( void *module, IMAGE_BASE_RELOCATION *rel,
-                                                        INT_PTR delta )
+IMAGE_BASE_RELOCATION *process_relocation_block( void *module, IMAGE_BASE_RELOCATION *rel, INT_PTR delta )
 {
     char *page = get_rva( module, rel->VirtualAddress );
     UINT count = (rel->SizeOfBlock - sizeof(*rel)) / sizeof(USHORT);
@@ -1798,6 +1797,331 @@ static ULONG_PTR get_image_address(void)
 }
 
 
+/***********************************************************************
+ *           DLL prefetching
+ *
+ * While the loader resolves imports one at a time under the loader lock, helper threads walk the
+ * rest of the import graph and read the files in, so that the loader mostly hits the page cache.
+ * The helpers are plain pthreads that never run Windows code nor talk to the server.
+ */
+
+#define PREFETCH_MAX_THREADS 4
+#define PREFETCH_MAX_NAMES   768
+#define PREFETCH_HASH_SIZE   1024  /* must be a power of 2 larger than PREFETCH_MAX_NAMES */
+
+struct prefetch_dirs
+{
+    struct list entry;
+    WCHAR      *load_path;     /* load path these directories have been built from */
+    char      **dirs;          /* NULL-terminated array of unix directories */
+};
+
+struct prefetch_item
+{
+    struct list                 entry;
+    const struct prefetch_dirs *dirs;   /* directories to look into */
+    char                        name[1];
+};
+
+static pthread_mutex_t prefetch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct list prefetch_queue = LIST_INIT( prefetch_queue );
+static struct list prefetch_dir_list = LIST_INIT( prefetch_dir_list );
+static unsigned int prefetch_names[PREFETCH_HASH_SIZE];  /* hashes of the names already queued */
+static unsigned int prefetch_count;
+static unsigned int prefetch_threads;
+
+static void *prefetch_thread( void *arg );
+
+/* queue a dll name for prefetching, unless it has already been seen; prefetch_mutex must be held */
+static void queue_prefetch( const struct prefetch_dirs *dirs, const char *name )
+{
+    struct prefetch_item *item;
+    unsigned int i, hash = 5381, len = strlen( name );
+    pthread_attr_t attr;
+    pthread_t thread;
+    sigset_t set, old_set;
+
+    if (!len || len > MAX_PATH) return;
+    for (i = 0; i < len; i++)
+    {
+        char c = name[i];
+        if (c & 0x80 || c == '/' || c == '\\' || c == ':') return;
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        hash = hash * 33 + c;
+    }
+    if (!hash) hash = 1;
+
+    if (prefetch_count >= PREFETCH_MAX_NAMES) return;
+    for (i = hash & (PREFETCH_HASH_SIZE - 1); prefetch_names[i]; i = (i + 1) & (PREFETCH_HASH_SIZE - 1))
+        if (prefetch_names[i] == hash) return;
+    prefetch_names[i] = hash;
+    prefetch_count++;
+
+    if (!(item = malloc( offsetof( struct prefetch_item, name[len + 1] )))) return;
+    item->dirs = dirs;
+    for (i = 0; i <= len; i++)
+        item->name[i] = (name[i] >= 'A' && name[i] <= 'Z') ? name[i] + 'a' - 'A' : name[i];
+    list_add_tail( &prefetch_queue, &item->entry );
+
+    if (prefetch_threads >= PREFETCH_MAX_THREADS) return;
+
+    /* the helpers must never handle signals meant for Windows threads */
+    sigfillset( &set );
+    pthread_sigmask( SIG_BLOCK, &set, &old_set );
+    pthread_attr_init( &attr );
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+    if (!pthread_create( &thread, &attr, prefetch_thread, NULL )) prefetch_threads++;
+    pthread_attr_destroy( &attr );
+    pthread_sigmask( SIG_SETMASK, &old_set, NULL );
+}
+
+/* convert an import table rva to a file offset */
+static off_t prefetch_rva_to_offset( const IMAGE_SECTION_HEADER *sec, unsigned int count, DWORD rva )
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (rva < sec[i].VirtualAddress) continue;
+        if (rva - sec[i].VirtualAddress >= sec[i].SizeOfRawData) continue;
+        return sec[i].PointerToRawData + rva - sec[i].VirtualAddress;
+    }
+    return -1;
+}
+
+/* read the import table of a dll file and queue its dependencies */
+static void prefetch_imports( int fd, const struct prefetch_dirs *dirs )
+{
+    IMAGE_DOS_HEADER dos;
+    union
+    {
+        IMAGE_NT_HEADERS32 nt32;
+        IMAGE_NT_HEADERS64 nt64;
+    } nt;
+    IMAGE_SECTION_HEADER sec[96];
+    IMAGE_IMPORT_DESCRIPTOR descr[32];
+    IMAGE_DATA_DIRECTORY dir;
+    unsigned int i, count, nb_sections, nb_names = 0;
+    char names[64][64];
+    off_t pos;
+
+    if (pread( fd, &dos, sizeof(dos), 0 ) != sizeof(dos) || dos.e_magic != IMAGE_DOS_SIGNATURE) return;
+    if (pread( fd, &nt, sizeof(nt), dos.e_lfanew ) < (ssize_t)sizeof(nt.nt32)) return;
+    if (nt.nt32.Signature != IMAGE_NT_SIGNATURE) return;
+
+    pos = dos.e_lfanew + offsetof( IMAGE_NT_HEADERS32, OptionalHeader ) + nt.nt32.FileHeader.SizeOfOptionalHeader;
+    if (nt.nt32.OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
+    {
+        if (nt.nt32.OptionalHeader.NumberOfRvaAndSizes <= IMAGE_DIRECTORY_ENTRY_IMPORT) return;
+        dir = nt.nt32.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+    }
+    else if (nt.nt64.OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+    {
+        if (nt.nt64.OptionalHeader.NumberOfRvaAndSizes <= IMAGE_DIRECTORY_ENTRY_IMPORT) return;
+        dir = nt.nt64.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+    }
+    else return;
+    if (!dir.VirtualAddress || !dir.Size) return;
+
+    nb_sections = min( nt.nt32.FileHeader.NumberOfSections, ARRAY_SIZE(sec) );
+    if (pread( fd, sec, nb_sections * sizeof(sec[0]), pos ) != nb_sections * sizeof(sec[0])) return;
+    if ((pos = prefetch_rva_to_offset( sec, nb_sections, dir.VirtualAddress )) == -1) return;
+
+    count = pread( fd, descr, sizeof(descr), pos );
+    if ((ssize_t)count <= 0) return;
+    count /= sizeof(descr[0]);
+
+    for (i = 0; i < count && descr[i].Name && nb_names < ARRAY_SIZE(names); i++)
+    {
+        off_t name_pos = prefetch_rva_to_offset( sec, nb_sections, descr[i].Name );
+        ssize_t len;
+
+        if (name_pos == -1) continue;
+        if ((len = pread( fd, names[nb_names], sizeof(names[0]) - 1, name_pos )) <= 0) continue;
+        names[nb_names][len] = 0;
+        nb_names++;
+    }
+
+    mutex_lock( &prefetch_mutex );
+    for (i = 0; i < nb_names; i++) queue_prefetch( dirs, names[i] );
+    mutex_unlock( &prefetch_mutex );
+}
+
+/* open a candidate file and ask the kernel to read it in; return TRUE if it exists */
+static BOOL prefetch_file( const char *path, const struct prefetch_dirs *dirs, BOOL parse_imports )
+{
+    int fd;
+
+    /* no tracing here, the helper threads don't have a TEB */
+    if ((fd = open( path, O_RDONLY )) == -1) return FALSE;
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise( fd, 0, 0, POSIX_FADV_WILLNEED );
+#endif
+    if (parse_imports) prefetch_imports( fd, dirs );
+    close( fd );
+    return TRUE;
+}
+
+/* look for all the files the loader may use for a dll, and read them in */
+static void prefetch_dll( const struct prefetch_item *item )
+{
+    const char *pe_dir = get_pe_dir( current_machine );
+    unsigned int i, len = strlen( item->name );
+    BOOL found = FALSE;
+    size_t maxlen = dll_path_maxlen;
+    char *path;
+
+    for (i = 0; item->dirs->dirs[i]; i++) maxlen = max( maxlen, strlen( item->dirs->dirs[i] ));
+    if (build_dir) maxlen = max( maxlen, strlen( build_dir ) + sizeof("/dlls/") + len );
+    maxlen += sizeof("/aarch64-windows/") + len;
+    if (!(path = malloc( maxlen ))) return;
+
+    for (i = 0; item->dirs->dirs[i]; i++)
+    {
+        sprintf( path, "%s/%s", item->dirs->dirs[i], item->name );
+        if (prefetch_file( path, item->dirs, !found )) found = TRUE;
+    }
+    if (build_dir)
+    {
+        sprintf( path, "%s/dlls/%s", build_dir, item->name );
+        if (len > 4 && !strcmp( item->name + len - 4, ".dll" )) path[strlen( path ) - 4] = 0;
+        strcat( path, "/" );
+        strcat( path, item->name );
+        if (prefetch_file( path, item->dirs, !found )) found = TRUE;
+    }
+    for (i = 0; dll_paths[i]; i++)
+    {
+        sprintf( path, "%s%s/%s", dll_paths[i], pe_dir, item->name );
+        if (prefetch_file( path, item->dirs, !found )) found = TRUE;
+    }
+    free( path );
+}
+
+static void *prefetch_thread( void *arg )
+{
+    struct list *ptr;
+
+    mutex_lock( &prefetch_mutex );
+    while ((ptr = list_head( &prefetch_queue )))
+    {
+        struct prefetch_item *item = LIST_ENTRY( ptr, struct prefetch_item, entry );
+
+        list_remove( &item->entry );
+        mutex_unlock( &prefetch_mutex );
+        prefetch_dll( item );
+        free( item );
+        mutex_lock( &prefetch_mutex );
+    }
+    prefetch_threads--;
+    mutex_unlock( &prefetch_mutex );
+    return NULL;
+}
+
+/* convert the absolute entries of a dll load path to unix directories */
+static struct prefetch_dirs *get_prefetch_dirs( const WCHAR *load_path )
+{
+    struct prefetch_dirs *dirs, *existing;
+    const WCHAR *p, *end;
+    unsigned int count = 1;
+    WCHAR *buffer;
+
+    mutex_lock( &prefetch_mutex );
+    LIST_FOR_EACH_ENTRY( existing, &prefetch_dir_list, struct prefetch_dirs, entry )
+    {
+        if (wcscmp( existing->load_path, load_path )) continue;
+        mutex_unlock( &prefetch_mutex );
+        return existing;
+    }
+    mutex_unlock( &prefetch_mutex );
+
+    for (p = load_path; *p; p++) if (*p == ';') count++;
+    if (!(dirs = malloc( sizeof(*dirs) ))) return NULL;
+    dirs->load_path = malloc( (wcslen( load_path ) + 1) * sizeof(WCHAR) );
+    dirs->dirs = malloc( (count + 1) * sizeof(*dirs->dirs) );
+    buffer = malloc( (wcslen( load_path ) + 5) * sizeof(WCHAR) );
+    if (!dirs->load_path || !dirs->dirs || !buffer)
+    {
+        free( dirs->load_path );
+        free( dirs->dirs );
+        free( dirs );
+        free( buffer );
+        return NULL;
+    }
+    wcscpy( dirs->load_path, load_path );
+
+    for (count = 0, p = load_path; *p; p = *end ? end + 1 : end)
+    {
+        UNICODE_STRING nt_name;
+        OBJECT_ATTRIBUTES attr;
+        char *unix_name;
+
+        for (end = p; *end && *end != ';'; end++) ;
+        /* only plain drive paths can be resolved without the loader */
+        if (end - p < 3 || p[1] != ':' || p[2] != '\\') continue;
+        buffer[0] = '\\';
+        buffer[1] = '?';
+        buffer[2] = '?';
+        buffer[3] = '\\';
+        memcpy( buffer + 4, p, (end - p) * sizeof(WCHAR) );
+        nt_name.Buffer = buffer;
+        nt_name.Length = nt_name.MaximumLength = (end - p + 4) * sizeof(WCHAR);
+        InitializeObjectAttributes( &attr, &nt_name, OBJ_CASE_INSENSITIVE, 0, NULL );
+        if (!nt_to_unix_file_name( &attr, &unix_name, FILE_OPEN )) dirs->dirs[count++] = unix_name;
+    }
+    dirs->dirs[count] = NULL;
+    free( buffer );
+
+    mutex_lock( &prefetch_mutex );
+    /* another thread may have added the same path in the meantime */
+    LIST_FOR_EACH_ENTRY( existing, &prefetch_dir_list, struct prefetch_dirs, entry )
+    {
+        if (wcscmp( existing->load_path, load_path )) continue;
+        mutex_unlock( &prefetch_mutex );
+        for (count = 0; dirs->dirs[count]; count++) free( dirs->dirs[count] );
+        free( dirs->dirs );
+        free( dirs->load_path );
+        free( dirs );
+        return existing;
+    }
+    list_add_tail( &prefetch_dir_list, &dirs->entry );
+    mutex_unlock( &prefetch_mutex );
+    return dirs;
+}
+
+/***********************************************************************
+ *           prefetch_dlls
+ *
+ * Start reading in the dependencies of a module before the loader resolves them.
+ */
+static void CDECL prefetch_dlls( void *module, const WCHAR *load_path )
+{
+    static int enabled = -1;
+    const IMAGE_NT_HEADERS *nt = get_rva( module, ((IMAGE_DOS_HEADER *)module)->e_lfanew );
+    const IMAGE_DATA_DIRECTORY *dir;
+    const IMAGE_IMPORT_DESCRIPTOR *descr;
+    struct prefetch_dirs *dirs;
+
+    if (enabled == -1)
+    {
+        const char *env = getenv( "WINEDLLPREFETCH" );
+        enabled = !env || atoi( env );
+    }
+    if (!enabled || !load_path) return;
+    if (nt->OptionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR_MAGIC) return;
+    dir = &nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+    if (!dir->VirtualAddress || !dir->Size) return;
+    if (!(dirs = get_prefetch_dirs( load_path ))) return;
+
+    mutex_lock( &prefetch_mutex );
+    for (descr = get_rva( module, dir->VirtualAddress ); descr->Name && descr->FirstThunk; descr++)
+    {
+        TRACE( "prefetching %s\n", debugstr_a( get_rva( module, descr->Name )));
+        queue_prefetch( dirs, get_rva( module, descr->Name ));
+    }
+    mutex_unlock( &prefetch_mutex );
+}
+
+
 /* math function wrappers */
 static double CDECL ntdll_atan( double d )  { return atan( d ); }
 static double CDECL ntdll_ceil( double d )  { return ceil( d ); }
@@ -1835,6 +2159,8 @@ static struct unix_funcs unix_funcs =
     fast_RtlReleaseSRWLockShared,
     fast_RtlWakeConditionVariable,
     fast_wait_cv,
+    create_wait_completion,
+    cancel_wait_completion,
     ntdll_atan,
     ntdll_ceil,
     ntdll_cos,
@@ -1850,6 +2176,7 @@ static struct unix_funcs unix_funcs =
     init_builtin_dll,
     init_unix_lib,
     unwind_builtin_dll,
+    prefetch_dlls,
 };
 
 
@@ -624,7 +624,7 @@ NTSTATUS WINAPI NtCreateUserProcess( HANDLE *process_handle_ptr, HANDLE *thread_
     int unixdir, socketfd[2] = { -1, -1 };
     pe_image_info_t pe_info;
     CLIENT_ID id;
-    HANDLE parent = 0, debug = 0, token = 0;
+    HANDLE parent = 0, debug = 0, token = 0, close_list[4];
     UNICODE_STRING redir, path = {0};
     OBJECT_ATTRIBUTES attr, empty_attr = { sizeof(empty_attr) };
     SIZE_T i, attr_count = (ps_attr->TotalLength - sizeof(ps_attr->TotalLength)) / sizeof(PS_ATTRIBUTE);
@@ -849,10 +849,11 @@ NTSTATUS WINAPI NtCreateUserProcess( HANDLE *process_handle_ptr, HANDLE *thread_
     status = STATUS_SUCCESS;
 
 done:
-    if (file_handle) NtClose( file_handle );
-    if (process_info) NtClose( process_info );
-    if (process_handle) NtClose( process_handle );
-    if (thread_handle) NtClose( thread_handle );
+    close_list[0] = file_handle;
+    close_list[1] = process_info;
+    close_list[2] = process_handle;
+    close_list[3] = thread_handle;
+    server_close_handles( close_list, ARRAY_SIZE(close_list) );
     if (socketfd[0] != -1) close( socketfd[0] );
     if (unixdir != -1) close( unixdir );
     free( startup_info );
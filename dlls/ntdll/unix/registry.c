@@ -25,8 +25,14 @@
 #pragma makedep unix
 #endif
 
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -39,6 +45,276 @@ WINE_DEFAULT_DEBUG_CHANNEL(reg);
 /* maximum length of a value name in bytes (without terminating null) */
 #define MAX_VALUE_LENGTH (16383 * sizeof(WCHAR))
 
+/* Replies to value and key queries are cached per key object, along with the generation of
+ * the key they were returned for.  The server increments the generations in a shared
+ * table whenever a key changes, which invalidates the corresponding cache entries.
+ * The server returns the id of the key object and the granted access when a handle is
+ * opened, so that the cache survives the handle being closed and the key reopened. */
+
+#define REG_CACHE_BUCKETS        256   /* number of hash buckets, indexed by key id or handle */
+#define REG_CACHE_BUCKET_ENTRIES 8     /* max. number of entries per bucket */
+#define REG_CACHE_MAX_DATA       4096  /* max. size of the cached reply data */
+
+/* a key handle opened by this process */
+struct reg_handle
+{
+    struct reg_handle *next;
+    HANDLE             handle;    /* key handle */
+    object_id_t        key_id;    /* id of the key object */
+    ACCESS_MASK        access;    /* access granted to the handle */
+    unsigned int       handle_gen; /* handle generation of the process before the handle was opened */
+};
+
+struct reg_cache_key
+{
+    HANDLE          handle;      /* key handle */
+    ACCESS_MASK     access;      /* access needed on the handle */
+    enum request    req;         /* REQ_get_key_value or REQ_enum_key */
+    int             index;       /* subkey index for enum_key */
+    int             info_class;  /* information class for enum_key */
+    const WCHAR    *name;        /* value name for get_key_value */
+    data_size_t     namelen;     /* length of the value name */
+    object_id_t     key_id;      /* id of the key object, set by get_cached_reply */
+};
+
+struct reg_cache_entry
+{
+    struct reg_cache_entry *next;
+    struct reg_cache_key    key;         /* name points to the entry data */
+    unsigned int            gen_slot;    /* generation slot of the registry key */
+    unsigned int            generation;  /* generation of the registry key when the reply was received */
+    NTSTATUS                status;      /* status of the reply */
+    union
+    {
+        struct get_key_value_reply value;
+        struct enum_key_reply      key;
+    } reply;
+    data_size_t             total;       /* total size of the reply data */
+    data_size_t             size;        /* size of the cached reply data */
+    char                    data[1];     /* value name followed by the reply data */
+};
+
+static struct reg_cache_entry *reg_cache[REG_CACHE_BUCKETS];
+static struct reg_handle *reg_handles[REG_CACHE_BUCKETS];
+static const unsigned int *registry_generations;
+static pthread_mutex_t reg_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline unsigned int reg_handle_hash( HANDLE handle )
+{
+    return (wine_server_obj_handle( handle ) >> 2) % REG_CACHE_BUCKETS;
+}
+
+static inline unsigned int reg_cache_hash( object_id_t key_id )
+{
+    return key_id % REG_CACHE_BUCKETS;
+}
+
+static inline BOOL reg_cache_key_matches( const struct reg_cache_key *a, const struct reg_cache_key *b )
+{
+    return a->key_id == b->key_id && a->req == b->req && a->index == b->index &&
+           a->info_class == b->info_class && a->namelen == b->namelen &&
+           !memcmp( a->name, b->name, a->namelen );
+}
+
+/* map the shared table of key generations */
+static const unsigned int *get_registry_generations(void)
+{
+    static const WCHAR nameW[] = {'\\','K','e','r','n','e','l','O','b','j','e','c','t','s','\\',
+                                  '_','_','w','i','n','e','_','r','e','g','i','s','t','r','y','_',
+                                  'g','e','n','e','r','a','t','i','o','n','s',0};
+    static BOOL mapped;
+    UNICODE_STRING name_str = { sizeof(nameW) - sizeof(WCHAR), sizeof(nameW), (WCHAR *)nameW };
+    OBJECT_ATTRIBUTES attr = { sizeof(attr), 0, &name_str };
+    size_t size = REGISTRY_GENERATION_SLOTS * sizeof(*registry_generations);
+    void *ptr = MAP_FAILED;
+    HANDLE section;
+    int fd, needs_close;
+
+    if (mapped) return registry_generations;
+
+    /* this can't be done while holding the cache mutex, since closing the section needs it */
+    if (!NtOpenSection( &section, SECTION_MAP_READ, &attr ))
+    {
+        if (!server_get_unix_fd( section, 0, &fd, &needs_close, NULL, NULL ))
+        {
+            ptr = mmap( NULL, size, PROT_READ, MAP_SHARED, fd, 0 );
+            if (needs_close) close( fd );
+        }
+        NtClose( section );
+    }
+    if (ptr != MAP_FAILED && InterlockedCompareExchangePointer( (void **)&registry_generations, ptr, NULL ))
+        munmap( ptr, size );  /* another thread got there first */
+    mapped = TRUE;
+    return registry_generations;
+}
+
+/* remember the key object that a newly opened handle refers to */
+/* handle_gen must have been retrieved before the handle was opened */
+static void add_key_handle( HANDLE handle, object_id_t key_id, ACCESS_MASK access, unsigned int handle_gen )
+{
+    struct reg_handle **entry, *new_handle, *old = NULL;
+    sigset_t sigset;
+
+    if (!get_registry_generations()) return;
+    if (!(new_handle = malloc( sizeof(*new_handle) ))) return;
+    new_handle->handle = handle;
+    new_handle->key_id = key_id;
+    new_handle->access = access;
+    new_handle->handle_gen = handle_gen;
+
+    server_enter_uninterrupted_section( &reg_cache_mutex, &sigset );
+    /* drop any stale entry for a handle that was closed behind our back */
+    for (entry = &reg_handles[reg_handle_hash( handle )]; *entry; entry = &(*entry)->next)
+    {
+        if ((*entry)->handle != handle) continue;
+        old = *entry;
+        *entry = old->next;
+        break;
+    }
+    new_handle->next = reg_handles[reg_handle_hash( handle )];
+    reg_handles[reg_handle_hash( handle )] = new_handle;
+    server_leave_uninterrupted_section( &reg_cache_mutex, &sigset );
+    free( old );
+}
+
+/* find the key object of a handle, if the handle grants the needed access */
+/* the cache mutex must be held */
+static object_id_t get_handle_key_id( HANDLE handle, ACCESS_MASK access )
+{
+    struct reg_handle **entry, *old;
+    unsigned int handle_gen;
+
+    for (entry = &reg_handles[reg_handle_hash( handle )]; *entry; entry = &(*entry)->next)
+    {
+        if ((*entry)->handle != handle) continue;
+        /* the table is already mapped since the entry was added, so this doesn't need the mutex */
+        if (get_handle_generation( &handle_gen ) && handle_gen == (*entry)->handle_gen)
+            return ((*entry)->access & access) == access ? (*entry)->key_id : 0;
+        /* the handle may have been closed by another process, and the value reused */
+        old = *entry;
+        *entry = old->next;
+        free( old );
+        return 0;
+    }
+    return 0;
+}
+
+/* retrieve a cached reply if it is still valid, and copy at most max_size bytes of its data */
+/* this also sets the key id that a new reply should be stored with */
+static BOOL get_cached_reply( struct reg_cache_key *key, void *reply, size_t reply_size,
+                              void *data, data_size_t max_size, NTSTATUS *status )
+{
+    struct reg_cache_entry **entry, *found = NULL;
+    sigset_t sigset;
+
+    key->key_id = 0;
+    if (!registry_generations) return FALSE;
+
+    server_enter_uninterrupted_section( &reg_cache_mutex, &sigset );
+    if (!(key->key_id = get_handle_key_id( key->handle, key->access )))
+    {
+        server_leave_uninterrupted_section( &reg_cache_mutex, &sigset );
+        return FALSE;
+    }
+    for (entry = &reg_cache[reg_cache_hash( key->key_id )]; *entry; entry = &(*entry)->next)
+    {
+        if (!reg_cache_key_matches( &(*entry)->key, key )) continue;
+        found = *entry;
+        if (found->generation != ((volatile const unsigned int *)registry_generations)[found->gen_slot])
+        {
+            *entry = found->next;
+            free( found );
+            found = NULL;
+        }
+        else if (min( max_size, found->total ) > found->size) found = NULL;  /* data was truncated */
+        break;
+    }
+    if (found)
+    {
+        memcpy( reply, &found->reply, reply_size );
+        if (data) memcpy( data, found->data + found->key.namelen, min( max_size, found->size ));
+        *status = found->status;
+    }
+    server_leave_uninterrupted_section( &reg_cache_mutex, &sigset );
+    return found != NULL;
+}
+
+/* store a reply in the cache */
+static void add_cached_reply( const struct reg_cache_key *key, NTSTATUS status, const void *reply,
+                              size_t reply_size, unsigned int gen_slot, unsigned int generation,
+                              const void *data, data_size_t size, data_size_t total )
+{
+    struct reg_cache_entry **entry, *new_entry;
+    unsigned int count = 0;
+    sigset_t sigset;
+
+    switch (status)
+    {
+    case STATUS_SUCCESS:
+    case STATUS_OBJECT_NAME_NOT_FOUND:
+    case STATUS_NO_MORE_ENTRIES:
+        break;
+    default:
+        return;
+    }
+    if (!data) size = 0;
+    if (!key->key_id || size > REG_CACHE_MAX_DATA || gen_slot >= REGISTRY_GENERATION_SLOTS) return;
+    if (!(new_entry = malloc( offsetof( struct reg_cache_entry, data[key->namelen + size] )))) return;
+
+    new_entry->key        = *key;
+    new_entry->key.handle = 0;
+    new_entry->key.name   = (const WCHAR *)new_entry->data;
+    new_entry->gen_slot   = gen_slot;
+    new_entry->generation = generation;
+    new_entry->status     = status;
+    new_entry->total      = total;
+    new_entry->size       = size;
+    memcpy( &new_entry->reply, reply, reply_size );
+    memcpy( new_entry->data, key->name, key->namelen );
+    memcpy( new_entry->data + key->namelen, data, size );
+
+    server_enter_uninterrupted_section( &reg_cache_mutex, &sigset );
+    entry = &reg_cache[reg_cache_hash( key->key_id )];
+    new_entry->next = *entry;
+    *entry = new_entry;
+    /* replace any previous entry for the same query, and drop the oldest ones */
+    while (*entry)
+    {
+        if ((*entry != new_entry && reg_cache_key_matches( &(*entry)->key, key )) ||
+            ++count > REG_CACHE_BUCKET_ENTRIES)
+        {
+            struct reg_cache_entry *old = *entry;
+            *entry = old->next;
+            free( old );
+        }
+        else entry = &(*entry)->next;
+    }
+    server_leave_uninterrupted_section( &reg_cache_mutex, &sigset );
+}
+
+/* forget about a handle that is being closed; the cached replies stay valid for the key object */
+void remove_key_from_cache( HANDLE handle )
+{
+    struct reg_handle **entry;
+    sigset_t sigset;
+
+    if (!registry_generations) return;
+
+    server_enter_uninterrupted_section( &reg_cache_mutex, &sigset );
+    entry = &reg_handles[reg_handle_hash( handle )];
+    while (*entry)
+    {
+        if ((*entry)->handle == handle)
+        {
+            struct reg_handle *old = *entry;
+            *entry = old->next;
+            free( old );
+        }
+        else entry = &(*entry)->next;
+    }
+    server_leave_uninterrupted_section( &reg_cache_mutex, &sigset );
+}
+
 
 NTSTATUS open_hkcu_key( const char *path, HANDLE *key )
 {
@@ -78,6 +354,10 @@ NTSTATUS WINAPI NtCreateKey( HANDLE *key, ACCESS_MASK access, const OBJECT_ATTRI
     NTSTATUS ret;
     data_size_t len;
     struct object_attributes *objattr;
+    object_id_t key_id = 0;
+    ACCESS_MASK granted = 0;
+    unsigned int handle_gen;
+    BOOL cacheable;
 
     if (!key || !attr) return STATUS_ACCESS_VIOLATION;
     if (attr->Length > sizeof(OBJECT_ATTRIBUTES)) return STATUS_INVALID_PARAMETER;
@@ -87,6 +367,7 @@ NTSTATUS WINAPI NtCreateKey( HANDLE *key, ACCESS_MASK access, const OBJECT_ATTRI
 
     if ((ret = alloc_object_attributes( attr, &objattr, &len ))) return ret;
 
+    cacheable = get_handle_generation( &handle_gen );
     SERVER_START_REQ( create_key )
     {
         req->access     = access;
@@ -96,8 +377,11 @@ NTSTATUS WINAPI NtCreateKey( HANDLE *key, ACCESS_MASK access, const OBJECT_ATTRI
         ret = wine_server_call( req );
         *key = wine_server_ptr_handle( reply->hkey );
         if (dispos && !ret) *dispos = reply->created ? REG_CREATED_NEW_KEY : REG_OPENED_EXISTING_KEY;
+        key_id = reply->key_id;
+        granted = reply->access;
     }
     SERVER_END_REQ;
+    if (!ret && cacheable) add_key_handle( *key, key_id, granted, handle_gen );
 
     TRACE( "<- %p\n", *key );
     free( objattr );
@@ -124,6 +408,10 @@ NTSTATUS WINAPI NtCreateKeyTransacted( HANDLE *key, ACCESS_MASK access, const OB
 NTSTATUS WINAPI NtOpenKeyEx( HANDLE *key, ACCESS_MASK access, const OBJECT_ATTRIBUTES *attr, ULONG options )
 {
     NTSTATUS ret;
+    object_id_t key_id = 0;
+    ACCESS_MASK granted = 0;
+    unsigned int handle_gen;
+    BOOL cacheable;
 
     if (!key || !attr || !attr->ObjectName) return STATUS_ACCESS_VIOLATION;
     if (attr->Length != sizeof(*attr)) return STATUS_INVALID_PARAMETER;
@@ -133,6 +421,7 @@ NTSTATUS WINAPI NtOpenKeyEx( HANDLE *key, ACCESS_MASK access, const OBJECT_ATTRI
 
     if (options & ~REG_OPTION_OPEN_LINK) FIXME( "options %x not implemented\n", options );
 
+    cacheable = get_handle_generation( &handle_gen );
     SERVER_START_REQ( open_key )
     {
         req->parent     = wine_server_obj_handle( attr->RootDirectory );
@@ -141,8 +430,11 @@ NTSTATUS WINAPI NtOpenKeyEx( HANDLE *key, ACCESS_MASK access, const OBJECT_ATTRI
         wine_server_add_data( req, attr->ObjectName->Buffer, attr->ObjectName->Length );
         ret = wine_server_call( req );
         *key = wine_server_ptr_handle( reply->hkey );
+        key_id = reply->key_id;
+        granted = reply->access;
     }
     SERVER_END_REQ;
+    if (!ret && cacheable) add_key_handle( *key, key_id, granted, handle_gen );
     TRACE("<- %p\n", *key);
     return ret;
 }
@@ -216,9 +508,13 @@ static NTSTATUS enumerate_key( HANDLE handle, int index, KEY_INFORMATION_CLASS i
                                void *info, DWORD length, DWORD *result_len )
 
 {
+    struct reg_cache_key cache_key = { handle, index == -1 ? KEY_QUERY_VALUE : KEY_ENUMERATE_SUB_KEYS,
+                                       REQ_enum_key, index, info_class, NULL, 0 };
+    struct enum_key_reply key_reply;
     NTSTATUS ret;
     void *data_ptr;
     size_t fixed_size;
+    data_size_t max_size, reply_size;
 
     switch (info_class)
     {
@@ -232,100 +528,112 @@ static NTSTATUS enumerate_key( HANDLE handle, int index, KEY_INFORMATION_CLASS i
         return STATUS_INVALID_PARAMETER;
     }
     fixed_size = (char *)data_ptr - (char *)info;
+    max_size = length > fixed_size ? length - fixed_size : 0;
 
-    SERVER_START_REQ( enum_key )
+    if (get_cached_reply( &cache_key, &key_reply, sizeof(key_reply), data_ptr, max_size, &ret ))
+        reply_size = min( max_size, key_reply.total );
+    else
     {
-        req->hkey       = wine_server_obj_handle( handle );
-        req->index      = index;
-        req->info_class = info_class;
-        if (length > fixed_size) wine_server_set_reply( req, data_ptr, length - fixed_size );
-        if (!(ret = wine_server_call( req )))
+        SERVER_START_REQ( enum_key )
         {
-            switch (info_class)
-            {
-            case KeyBasicInformation:
-            {
-                KEY_BASIC_INFORMATION keyinfo;
-                fixed_size = (char *)keyinfo.Name - (char *)&keyinfo;
-                keyinfo.LastWriteTime.QuadPart = reply->modif;
-                keyinfo.TitleIndex = 0;
-                keyinfo.NameLength = reply->namelen;
-                memcpy( info, &keyinfo, min( length, fixed_size ) );
+            req->hkey       = wine_server_obj_handle( handle );
+            req->index      = index;
+            req->info_class = info_class;
+            if (max_size) wine_server_set_reply( req, data_ptr, max_size );
+            ret = wine_server_call( req );
+            key_reply = *reply;
+            reply_size = wine_server_reply_size( reply );
+        }
+        SERVER_END_REQ;
+        add_cached_reply( &cache_key, ret, &key_reply, sizeof(key_reply), key_reply.gen_slot,
+                          key_reply.generation, data_ptr, reply_size, key_reply.total );
+    }
+
+    if (!ret)
+    {
+        switch (info_class)
+        {
+        case KeyBasicInformation:
+        {
+            KEY_BASIC_INFORMATION keyinfo;
+            fixed_size = (char *)keyinfo.Name - (char *)&keyinfo;
+            keyinfo.LastWriteTime.QuadPart = key_reply.modif;
+            keyinfo.TitleIndex = 0;
+            keyinfo.NameLength = key_reply.namelen;
+            memcpy( info, &keyinfo, min( length, fixed_size ) );
+        break;
+        }
+
+        case KeyFullInformation:
+        {
+            KEY_FULL_INFORMATION keyinfo;
+            fixed_size = (char *)keyinfo.Class - (char *)&keyinfo;
+            keyinfo.LastWriteTime.QuadPart = key_reply.modif;
+            keyinfo.TitleIndex = 0;
+            keyinfo.ClassLength = reply_size;
+            keyinfo.ClassOffset = keyinfo.ClassLength ? fixed_size : -1;
+            keyinfo.SubKeys = key_reply.subkeys;
+            keyinfo.MaxNameLen = key_reply.max_subkey;
+            keyinfo.MaxClassLen = key_reply.max_class;
+            keyinfo.Values = key_reply.values;
+            keyinfo.MaxValueNameLen = key_reply.max_value;
+            keyinfo.MaxValueDataLen = key_reply.max_data;
+            memcpy( info, &keyinfo, min( length, fixed_size ) );
             break;
-            }
+        }
 
-            case KeyFullInformation:
+        case KeyNodeInformation:
+        {
+            KEY_NODE_INFORMATION keyinfo;
+            fixed_size = (char *)keyinfo.Name - (char *)&keyinfo;
+            keyinfo.LastWriteTime.QuadPart = key_reply.modif;
+            keyinfo.TitleIndex = 0;
+            if (key_reply.namelen < reply_size)
             {
-                KEY_FULL_INFORMATION keyinfo;
-                fixed_size = (char *)keyinfo.Class - (char *)&keyinfo;
-                keyinfo.LastWriteTime.QuadPart = reply->modif;
-                keyinfo.TitleIndex = 0;
-                keyinfo.ClassLength = wine_server_reply_size(reply);
-                keyinfo.ClassOffset = keyinfo.ClassLength ? fixed_size : -1;
-                keyinfo.SubKeys = reply->subkeys;
-                keyinfo.MaxNameLen = reply->max_subkey;
-                keyinfo.MaxClassLen = reply->max_class;
-                keyinfo.Values = reply->values;
-                keyinfo.MaxValueNameLen = reply->max_value;
-                keyinfo.MaxValueDataLen = reply->max_data;
-                memcpy( info, &keyinfo, min( length, fixed_size ) );
-                break;
+                keyinfo.ClassLength = reply_size - key_reply.namelen;
+                keyinfo.ClassOffset = fixed_size + key_reply.namelen;
             }
-
-            case KeyNodeInformation:
+            else
             {
-                KEY_NODE_INFORMATION keyinfo;
-                fixed_size = (char *)keyinfo.Name - (char *)&keyinfo;
-                keyinfo.LastWriteTime.QuadPart = reply->modif;
-                keyinfo.TitleIndex = 0;
-                if (reply->namelen < wine_server_reply_size(reply))
-                {
-                    keyinfo.ClassLength = wine_server_reply_size(reply) - reply->namelen;
-                    keyinfo.ClassOffset = fixed_size + reply->namelen;
-                }
-                else
-                {
-                    keyinfo.ClassLength = 0;
-                    keyinfo.ClassOffset = -1;
-                }
-                keyinfo.NameLength = reply->namelen;
-                memcpy( info, &keyinfo, min( length, fixed_size ) );
-                break;
+                keyinfo.ClassLength = 0;
+                keyinfo.ClassOffset = -1;
             }
+            keyinfo.NameLength = key_reply.namelen;
+            memcpy( info, &keyinfo, min( length, fixed_size ) );
+            break;
+        }
 
-            case KeyNameInformation:
-            {
-                KEY_NAME_INFORMATION keyinfo;
-                fixed_size = (char *)keyinfo.Name - (char *)&keyinfo;
-                keyinfo.NameLength = reply->namelen;
-                memcpy( info, &keyinfo, min( length, fixed_size ) );
-                break;
-            }
+        case KeyNameInformation:
+        {
+            KEY_NAME_INFORMATION keyinfo;
+            fixed_size = (char *)keyinfo.Name - (char *)&keyinfo;
+            keyinfo.NameLength = key_reply.namelen;
+            memcpy( info, &keyinfo, min( length, fixed_size ) );
+            break;
+        }
 
-            case KeyCachedInformation:
-            {
-                KEY_CACHED_INFORMATION keyinfo;
-                fixed_size = sizeof(keyinfo);
-                keyinfo.LastWriteTime.QuadPart = reply->modif;
-                keyinfo.TitleIndex = 0;
-                keyinfo.SubKeys = reply->subkeys;
-                keyinfo.MaxNameLen = reply->max_subkey;
-                keyinfo.Values = reply->values;
-                keyinfo.MaxValueNameLen = reply->max_value;
-                keyinfo.MaxValueDataLen = reply->max_data;
-                keyinfo.NameLength = reply->namelen;
-                memcpy( info, &keyinfo, min( length, fixed_size ) );
-                break;
-            }
+        case KeyCachedInformation:
+        {
+            KEY_CACHED_INFORMATION keyinfo;
+            fixed_size = sizeof(keyinfo);
+            keyinfo.LastWriteTime.QuadPart = key_reply.modif;
+            keyinfo.TitleIndex = 0;
+            keyinfo.SubKeys = key_reply.subkeys;
+            keyinfo.MaxNameLen = key_reply.max_subkey;
+            keyinfo.Values = key_reply.values;
+            keyinfo.MaxValueNameLen = key_reply.max_value;
+            keyinfo.MaxValueDataLen = key_reply.max_data;
+            keyinfo.NameLength = key_reply.namelen;
+            memcpy( info, &keyinfo, min( length, fixed_size ) );
+            break;
+        }
 
-            default:
-                break;
-            }
-            *result_len = fixed_size + reply->total;
-            if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
+        default:
+            break;
         }
+        *result_len = fixed_size + key_reply.total;
+        if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
     }
-    SERVER_END_REQ;
     return ret;
 }
 
@@ -452,6 +760,51 @@ NTSTATUS WINAPI NtEnumerateValueKey( HANDLE handle, ULONG index, KEY_VALUE_INFOR
 }
 
 
+/******************************************************************************
+ *              enum_key_values
+ *
+ * Retrieve the full information of several consecutive values of a key with a
+ * single server call. The value at index + i is stored in infos[i], a buffer
+ * of length bytes, and its status in status[i].
+ */
+void enum_key_values( HANDLE handle, ULONG index, ULONG count, KEY_VALUE_FULL_INFORMATION **infos,
+                      DWORD length, NTSTATUS *status )
+{
+    static const size_t fixed_size = offsetof( KEY_VALUE_FULL_INFORMATION, Name );
+    struct __server_request_info reqs[8], *ptrs[8];
+    ULONG i;
+
+    assert( count <= ARRAY_SIZE(reqs) );
+    assert( length > fixed_size );
+
+    for (i = 0; i < count; i++)
+    {
+        struct enum_key_value_request *req = &reqs[i].u.req.enum_key_value_request;
+
+        memset( &reqs[i], 0, sizeof(reqs[i]) );
+        req->__header.req = REQ_enum_key_value;
+        req->hkey         = wine_server_obj_handle( handle );
+        req->index        = index + i;
+        req->info_class   = KeyValueFullInformation;
+        wine_server_set_reply( &reqs[i], infos[i]->Name, length - fixed_size );
+        ptrs[i] = &reqs[i];
+    }
+
+    if (count == 1) wine_server_call( ptrs[0] );
+    else if (count) server_call_batch( ptrs, count );
+
+    for (i = 0; i < count; i++)
+    {
+        const struct enum_key_value_reply *reply = &reqs[i].u.reply.enum_key_value_reply;
+
+        if ((status[i] = reply->__header.error)) continue;
+        copy_key_value_info( KeyValueFullInformation, infos[i], length, reply->type, reply->namelen,
+                             reply->__header.reply_size - reply->namelen );
+        if (length < fixed_size + reply->total) status[i] = STATUS_BUFFER_OVERFLOW;
+    }
+}
+
+
 /******************************************************************************
  *              NtQueryValueKey  (NTDLL.@)
  */
@@ -459,9 +812,12 @@ NTSTATUS WINAPI NtQueryValueKey( HANDLE handle, const UNICODE_STRING *name,
                                  KEY_VALUE_INFORMATION_CLASS info_class,
                                  void *info, DWORD length, DWORD *result_len )
 {
+    struct reg_cache_key cache_key = { handle, KEY_QUERY_VALUE, REQ_get_key_value, 0, 0, NULL, 0 };
+    struct get_key_value_reply value_reply;
     NTSTATUS ret;
     UCHAR *data_ptr;
     unsigned int fixed_size, min_size;
+    data_size_t max_size;
 
     TRACE( "(%p,%s,%d,%p,%d)\n", handle, debugstr_us(name), info_class, info, length );
 
@@ -502,21 +858,36 @@ NTSTATUS WINAPI NtQueryValueKey( HANDLE handle, const UNICODE_STRING *name,
         return STATUS_INVALID_PARAMETER;
     }
 
-    SERVER_START_REQ( get_key_value )
+    max_size = (length > fixed_size && data_ptr) ? length - fixed_size : 0;
+    cache_key.name = name->Buffer;
+    cache_key.namelen = name->Length;
+
+    if (!get_cached_reply( &cache_key, &value_reply, sizeof(value_reply), data_ptr, max_size, &ret ))
     {
-        req->hkey = wine_server_obj_handle( handle );
-        wine_server_add_data( req, name->Buffer, name->Length );
-        if (length > fixed_size && data_ptr) wine_server_set_reply( req, data_ptr, length - fixed_size );
-        if (!(ret = wine_server_call( req )))
+        data_size_t reply_size;
+
+        SERVER_START_REQ( get_key_value )
         {
-            copy_key_value_info( info_class, info, length, reply->type,
-                                 name->Length, reply->total );
-            *result_len = fixed_size + (info_class == KeyValueBasicInformation ? 0 : reply->total);
-            if (length < min_size) ret = STATUS_BUFFER_TOO_SMALL;
-            else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
+            req->hkey = wine_server_obj_handle( handle );
+            wine_server_add_data( req, name->Buffer, name->Length );
+            if (max_size) wine_server_set_reply( req, data_ptr, max_size );
+            ret = wine_server_call( req );
+            value_reply = *reply;
+            reply_size = wine_server_reply_size( reply );
         }
+        SERVER_END_REQ;
+        add_cached_reply( &cache_key, ret, &value_reply, sizeof(value_reply), value_reply.gen_slot,
+                          value_reply.generation, data_ptr, reply_size, value_reply.total );
+    }
+
+    if (!ret)
+    {
+        copy_key_value_info( info_class, info, length, value_reply.type,
+                             name->Length, value_reply.total );
+        *result_len = fixed_size + (info_class == KeyValueBasicInformation ? 0 : value_reply.total);
+        if (length < min_size) ret = STATUS_BUFFER_TOO_SMALL;
+        else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
     }
-    SERVER_END_REQ;
     return ret;
 }
 
@@ -55,6 +55,12 @@
 #ifdef HAVE_SYS_MMAN_H
 #include <sys/mman.h>
 #endif
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#ifdef HAVE_SYS_POLL_H
+# include <sys/poll.h>
+#endif
 #ifdef HAVE_SYS_PRCTL_H
 # include <sys/prctl.h>
 #endif
@@ -116,18 +122,6 @@ static int fd_socket = -1;  /* socket to exchange file descriptors with the serv
 static pid_t server_pid;
 static pthread_mutex_t fd_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-/* atomically exchange a 64-bit value */
-static inline LONG64 interlocked_xchg64( LONG64 *dest, LONG64 val )
-{
-#ifdef _WIN64
-    return (LONG64)InterlockedExchangePointer( (void **)dest, (void *)val );
-#else
-    LONG64 tmp = *dest;
-    while (InterlockedCompareExchange64( dest, val, tmp ) != tmp) tmp = *dest;
-    return tmp;
-#endif
-}
-
 #ifdef __GNUC__
 static void fatal_error( const char *err, ... ) __attribute__((noreturn, format(printf,1,2)));
 static void fatal_perror( const char *err, ... ) __attribute__((noreturn, format(printf,1,2)));
@@ -264,6 +258,63 @@ static inline unsigned int wait_reply( struct __server_request_info *req )
 }
 
 
+#ifdef __linux__
+
+/***********************************************************************
+ *           send_shared_request
+ *
+ * Send a request through the shared request buffer and wait for the reply.
+ */
+static unsigned int send_shared_request( struct __server_request_info *req )
+{
+    static const ULONG64 one = 1;
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    struct shared_request_buffer *buffer = thread_data->shared_req;
+    char *ptr = (char *)(buffer + 1);
+    unsigned int i;
+    int ret, state;
+
+    if (buffer->state == SHARED_REQUEST_CLOSED) abort_thread(0);
+
+    memcpy( buffer->header, &req->u.req, sizeof(req->u.req) );
+    for (i = 0; i < req->data_count; i++)
+    {
+        memcpy( ptr, req->data[i].ptr, req->data[i].size );
+        ptr += req->data[i].size;
+    }
+    InterlockedExchange( (LONG *)&buffer->state, SHARED_REQUEST_PENDING );
+
+    while ((ret = write( thread_data->doorbell_fd, &one, sizeof(one) )) != sizeof(one))
+    {
+        if (ret == -1 && errno == EINTR) continue;
+        server_protocol_perror( "doorbell write" );
+    }
+
+    while ((state = InterlockedCompareExchange( (LONG *)&buffer->state, 0, 0 )) == SHARED_REQUEST_PENDING)
+    {
+        struct timespec timeout = { 1, 0 };
+
+        if (!syscall( __NR_futex, &buffer->state, 0 /* FUTEX_WAIT */, state, &timeout, 0, 0 ) ||
+            errno != ETIMEDOUT)
+            continue;
+        /* the server may have died without waking us up */
+        {
+            struct pollfd pfd = { thread_data->reply_fd, POLLIN, 0 };
+            if (poll( &pfd, 1, 0 ) == 1 && (pfd.revents & (POLLHUP | POLLERR))) abort_thread(0);
+        }
+    }
+    if (state == SHARED_REQUEST_CLOSED) abort_thread(0);
+
+    memcpy( &req->u.reply, buffer->header, sizeof(req->u.reply) );
+    if (req->u.reply.reply_header.reply_size)
+        memcpy( req->reply_data, buffer + 1, req->u.reply.reply_header.reply_size );
+    buffer->state = SHARED_REQUEST_IDLE;
+    return req->u.reply.reply_header.error;
+}
+
+#endif  /* __linux__ */
+
+
 /***********************************************************************
  *           server_call_unlocked
  */
@@ -272,6 +323,13 @@ unsigned int server_call_unlocked( void *req_ptr )
     struct __server_request_info * const req = req_ptr;
     unsigned int ret;
 
+#ifdef __linux__
+    if (ntdll_get_thread_data()->shared_req &&
+        req->u.req.request_header.request_size <= SHARED_REQUEST_BUFFER_SIZE - sizeof(struct shared_request_buffer) &&
+        req->u.req.request_header.reply_size <= SHARED_REQUEST_BUFFER_SIZE - sizeof(struct shared_request_buffer))
+        return send_shared_request( req );
+#endif
+
     if ((ret = send_request( req ))) return ret;
     return wait_reply( req );
 }
@@ -294,6 +352,69 @@ unsigned int CDECL wine_server_call( void *req_ptr )
 }
 
 
+/***********************************************************************
+ *           server_call_batch
+ *
+ * Send several independent requests to the server in a single round trip.
+ * Requests are processed in order, and each one gets its own reply and
+ * status. Requests that pass file descriptors in either direction or that
+ * may block (select) cannot be batched.
+ */
+unsigned int server_call_batch( struct __server_request_info **reqs, unsigned int count )
+{
+    data_size_t req_size = 0, reply_size = 0;
+    unsigned int i, j, ret, done = 0;
+    char *buffer, *ptr;
+
+    for (i = 0; i < count; i++)
+    {
+        req_size += sizeof(reqs[i]->u.req) + ((reqs[i]->u.req.request_header.request_size + 7) & ~7);
+        reply_size += sizeof(reqs[i]->u.reply) + ((reqs[i]->u.req.request_header.reply_size + 7) & ~7);
+    }
+    if (!(buffer = malloc( max( req_size, reply_size )))) return STATUS_NO_MEMORY;
+
+    for (i = 0, ptr = buffer; i < count; i++)
+    {
+        memcpy( ptr, &reqs[i]->u.req, sizeof(reqs[i]->u.req) );
+        ptr += sizeof(reqs[i]->u.req);
+        for (j = 0; j < reqs[i]->data_count; j++)
+        {
+            memcpy( ptr, reqs[i]->data[j].ptr, reqs[i]->data[j].size );
+            ptr += reqs[i]->data[j].size;
+        }
+        while ((ptr - buffer) & 7) *ptr++ = 0;
+    }
+
+    SERVER_START_REQ( batch )
+    {
+        wine_server_add_data( req, buffer, req_size );
+        wine_server_set_reply( req, buffer, reply_size );
+        ret = wine_server_call( req );
+        done = reply->count;
+    }
+    SERVER_END_REQ;
+
+    for (i = 0, ptr = buffer; i < count; i++)
+    {
+        if (i >= done)
+        {
+            memset( &reqs[i]->u.reply, 0, sizeof(reqs[i]->u.reply) );
+            reqs[i]->u.reply.reply_header.error = ret ? ret : STATUS_INTERNAL_ERROR;
+            continue;
+        }
+        memcpy( &reqs[i]->u.reply, ptr, sizeof(reqs[i]->u.reply) );
+        ptr += sizeof(reqs[i]->u.reply);
+        if (reqs[i]->u.reply.reply_header.reply_size)
+        {
+            memcpy( reqs[i]->reply_data, ptr, reqs[i]->u.reply.reply_header.reply_size );
+            ptr += (reqs[i]->u.reply.reply_header.reply_size + 7) & ~7;
+        }
+    }
+    free( buffer );
+    return ret;
+}
+
+
 /***********************************************************************
  *           server_enter_uninterrupted_section
  */
@@ -988,6 +1109,52 @@ static int remove_fd_from_cache( HANDLE handle )
 }
 
 
+/***********************************************************************
+ *           get_handle_generation
+ *
+ * Retrieve the generation of the handle table of the current process. The server
+ * increments it whenever one of our handles is closed without us asking for it,
+ * for instance by another process using DUPLICATE_CLOSE_SOURCE, so that handle
+ * caches can detect their stale entries. Returns FALSE if it is not available.
+ * The first call maps the shared table, so it must be done without holding locks.
+ */
+BOOL get_handle_generation( unsigned int *generation )
+{
+    static const WCHAR nameW[] = {'\\','K','e','r','n','e','l','O','b','j','e','c','t','s','\\',
+                                  '_','_','w','i','n','e','_','h','a','n','d','l','e','_',
+                                  'g','e','n','e','r','a','t','i','o','n','s',0};
+    static const unsigned int *handle_generations;
+    static BOOL mapped;
+    size_t size = HANDLE_GENERATION_SLOTS * sizeof(*handle_generations);
+
+    if (!mapped)
+    {
+        UNICODE_STRING name_str = { sizeof(nameW) - sizeof(WCHAR), sizeof(nameW), (WCHAR *)nameW };
+        OBJECT_ATTRIBUTES attr = { sizeof(attr), 0, &name_str };
+        void *ptr = MAP_FAILED;
+        HANDLE section;
+        int fd, needs_close;
+
+        if (!NtOpenSection( &section, SECTION_MAP_READ, &attr ))
+        {
+            if (!server_get_unix_fd( section, 0, &fd, &needs_close, NULL, NULL ))
+            {
+                ptr = mmap( NULL, size, PROT_READ, MAP_SHARED, fd, 0 );
+                if (needs_close) close( fd );
+            }
+            NtClose( section );
+        }
+        if (ptr != MAP_FAILED && InterlockedCompareExchangePointer( (void **)&handle_generations, ptr, NULL ))
+            munmap( ptr, size );  /* another thread got there first */
+        mapped = TRUE;
+    }
+    if (!handle_generations) return FALSE;
+    *generation = ((volatile const unsigned int *)handle_generations)[(GetCurrentProcessId() / 4) %
+                                                                      HANDLE_GENERATION_SLOTS];
+    return TRUE;
+}
+
+
 /***********************************************************************
  *           server_get_unix_fd
  *
@@ -1425,6 +1592,67 @@ void process_exit_wrapper( int status )
 }
 
 
+/***********************************************************************
+ *           init_shared_request_buffer
+ *
+ * Set up a request buffer shared with the server for the current thread, if enabled.
+ */
+static void init_shared_request_buffer(void)
+{
+#if defined(__linux__) && defined(__NR_memfd_create)
+    static int enabled = -1;
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    int fd, doorbell_fd;
+    unsigned int ret;
+    void *ptr;
+
+    if (enabled == -1)
+    {
+        const char *env = getenv( "WINESHAREDREQUEST" );
+        enabled = env && atoi( env );
+    }
+    if (!enabled) return;
+
+    if ((fd = syscall( __NR_memfd_create, "wine-request", 3 /* MFD_CLOEXEC | MFD_ALLOW_SEALING */ )) == -1) return;
+    /* the server refuses buffers whose size could still change */
+    if (ftruncate( fd, SHARED_REQUEST_BUFFER_SIZE ) == -1 ||
+        fcntl( fd, 1033 /* F_ADD_SEALS */, 0x0002 | 0x0004 /* F_SEAL_SHRINK | F_SEAL_GROW */ ) == -1 ||
+        (ptr = mmap( NULL, SHARED_REQUEST_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        return;
+    }
+    if ((doorbell_fd = syscall( __NR_eventfd2, 0, O_CLOEXEC )) == -1)
+    {
+        munmap( ptr, SHARED_REQUEST_BUFFER_SIZE );
+        close( fd );
+        return;
+    }
+
+    wine_server_send_fd( fd );
+    wine_server_send_fd( doorbell_fd );
+    SERVER_START_REQ( set_shared_request_buffer )
+    {
+        req->buffer_fd   = fd;
+        req->doorbell_fd = doorbell_fd;
+        req->size        = SHARED_REQUEST_BUFFER_SIZE;
+        ret = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+    close( fd );
+
+    if (ret)
+    {
+        munmap( ptr, SHARED_REQUEST_BUFFER_SIZE );
+        close( doorbell_fd );
+        return;
+    }
+    thread_data->shared_req = ptr;
+    thread_data->doorbell_fd = doorbell_fd;
+#endif
+}
+
+
 /***********************************************************************
  *           server_init_process
  *
@@ -1545,6 +1773,7 @@ size_t server_init_process(void)
     }
 
     set_thread_id( NtCurrentTeb(), pid, tid );
+    init_shared_request_buffer();
 
     for (i = 0; i < supported_machines_count; i++)
         if (supported_machines[i] == current_machine) return info_size;
@@ -1629,6 +1858,7 @@ void server_init_thread( void *entry_point, BOOL *suspend )
     }
     SERVER_END_REQ;
     close( reply_pipe );
+    init_shared_request_buffer();
 }
 
 
@@ -1685,7 +1915,11 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source, HANDLE
     /* always remove the cached fd; if the server request fails we'll just
      * retrieve it again */
     if (options & DUPLICATE_CLOSE_SOURCE)
+    {
         fd = remove_fd_from_cache( source );
+        remove_inproc_sync_from_cache( source );
+        remove_key_from_cache( source );
+    }
 
     SERVER_START_REQ( dup_handle )
     {
@@ -1724,6 +1958,8 @@ NTSTATUS WINAPI NtClose( HANDLE handle )
     /* always remove the cached fd; if the server request fails we'll just
      * retrieve it again */
     fd = remove_fd_from_cache( handle );
+    remove_inproc_sync_from_cache( handle );
+    remove_key_from_cache( handle );
 
     SERVER_START_REQ( close_handle )
     {
@@ -1745,3 +1981,43 @@ NTSTATUS WINAPI NtClose( HANDLE handle )
     }
     return ret;
 }
+
+
+/***********************************************************************
+ *           server_close_handles
+ *
+ * Close several handles with a single server call.
+ */
+void server_close_handles( const HANDLE *handles, unsigned int count )
+{
+    struct __server_request_info reqs[8], *ptrs[8];
+    sigset_t sigset;
+    unsigned int i, nb = 0;
+    int fds[8];
+
+    assert( count <= ARRAY_SIZE(reqs) );
+
+    server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
+
+    for (i = 0; i < count; i++)
+    {
+        struct close_handle_request *req = &reqs[nb].u.req.close_handle_request;
+
+        if (!handles[i]) continue;
+        fds[nb] = remove_fd_from_cache( handles[i] );
+        remove_inproc_sync_from_cache( handles[i] );
+        remove_key_from_cache( handles[i] );
+
+        memset( &reqs[nb], 0, sizeof(reqs[nb]) );
+        req->__header.req = REQ_close_handle;
+        req->handle = wine_server_obj_handle( handles[i] );
+        ptrs[nb] = &reqs[nb];
+        nb++;
+    }
+    if (nb == 1) server_call_unlocked( ptrs[0] );
+    else if (nb) server_call_batch( ptrs, nb );
+
+    server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
+
+    for (i = 0; i < nb; i++) if (fds[i] != -1) close( fds[i] );
+}
@@ -32,6 +32,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <signal.h>
+#include <sys/mman.h>
 #ifdef HAVE_SYS_SYSCALL_H
 #include <sys/syscall.h>
 #endif
@@ -295,6 +296,188 @@ NTSTATUS alloc_object_attributes( const OBJECT_ATTRIBUTES *attr, struct object_a
 }
 
 
+/***********************************************************************/
+/* in-process synchronization support
+ *
+ * When enabled in the server, the state of events and semaphores is published
+ * in a table mapped read-only from the server. Operations that can be decided
+ * by only looking at the state are done here without a server round trip;
+ * anything that changes the state still goes through the server.
+ */
+
+union inproc_sync_cache_entry
+{
+    LONG64 data;
+    struct
+    {
+        unsigned int slot : 16;       /* index in the shared table */
+        unsigned int wait : 1;        /* handle has SYNCHRONIZE access */
+        unsigned int modify : 1;      /* handle has EVENT_MODIFY_STATE / SEMAPHORE_MODIFY_STATE access */
+        unsigned int handle_gen;      /* handle generation of the process when the entry was added */
+    } s;
+};
+
+C_ASSERT( sizeof(union inproc_sync_cache_entry) == sizeof(LONG64) );
+C_ASSERT( INPROC_SYNC_MAX_SLOTS <= 0x10000 );
+C_ASSERT( EVENT_MODIFY_STATE == SEMAPHORE_MODIFY_STATE );
+
+#define INPROC_SYNC_CACHE_BLOCK_SIZE  (65536 / sizeof(union inproc_sync_cache_entry))
+#define INPROC_SYNC_CACHE_ENTRIES     128
+
+static union inproc_sync_cache_entry *inproc_sync_cache[INPROC_SYNC_CACHE_ENTRIES];
+static union inproc_sync_cache_entry inproc_sync_cache_initial_block[INPROC_SYNC_CACHE_BLOCK_SIZE];
+static const struct inproc_sync *inproc_sync_slots;
+static pthread_mutex_t inproc_sync_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline unsigned int inproc_sync_handle_to_index( HANDLE handle, unsigned int *entry )
+{
+    unsigned int idx = (wine_server_obj_handle(handle) >> 2) - 1;
+    *entry = idx / INPROC_SYNC_CACHE_BLOCK_SIZE;
+    return idx % INPROC_SYNC_CACHE_BLOCK_SIZE;
+}
+
+/* map the shared table of objects; caller must hold inproc_sync_mutex */
+static void map_inproc_sync_slots(void)
+{
+    static const WCHAR nameW[] = {'\\','K','e','r','n','e','l','O','b','j','e','c','t','s',
+                                  '\\','_','_','w','i','n','e','_','i','n','p','r','o','c','_','s','y','n','c',0};
+    static BOOL mapped;
+    UNICODE_STRING name_str = { sizeof(nameW) - sizeof(WCHAR), sizeof(nameW), (WCHAR *)nameW };
+    OBJECT_ATTRIBUTES attr = { sizeof(attr), 0, &name_str };
+    void *ptr = MAP_FAILED;
+    HANDLE section;
+    int fd, needs_close;
+
+    if (mapped) return;
+    mapped = TRUE;
+
+    if (NtOpenSection( &section, SECTION_MAP_READ, &attr )) return;
+    if (!server_get_unix_fd( section, 0, &fd, &needs_close, NULL, NULL ))
+    {
+        ptr = mmap( NULL, INPROC_SYNC_MAX_SLOTS * sizeof(struct inproc_sync), PROT_READ, MAP_SHARED, fd, 0 );
+        if (needs_close) close( fd );
+    }
+    NtClose( section );
+    if (ptr != MAP_FAILED) inproc_sync_slots = ptr;
+    else WARN( "failed to map in-process sync table, falling back to server calls\n" );
+}
+
+/* remember the in-process sync slot of a newly created or opened handle */
+/* handle_gen must have been retrieved before the handle was created */
+static void add_inproc_sync_to_cache( HANDLE handle, unsigned int slot, unsigned int access,
+                                      unsigned int handle_gen )
+{
+    unsigned int entry, idx = inproc_sync_handle_to_index( handle, &entry );
+    union inproc_sync_cache_entry cache;
+    sigset_t sigset;
+
+    if (!slot || entry >= INPROC_SYNC_CACHE_ENTRIES) return;
+
+    server_enter_uninterrupted_section( &inproc_sync_mutex, &sigset );
+    map_inproc_sync_slots();
+    if (inproc_sync_slots && !inproc_sync_cache[entry])
+    {
+        if (!entry) inproc_sync_cache[0] = inproc_sync_cache_initial_block;
+        else
+        {
+            void *ptr = anon_mmap_alloc( INPROC_SYNC_CACHE_BLOCK_SIZE * sizeof(union inproc_sync_cache_entry),
+                                         PROT_READ | PROT_WRITE );
+            if (ptr != MAP_FAILED) inproc_sync_cache[entry] = ptr;
+        }
+    }
+    if (inproc_sync_slots && inproc_sync_cache[entry])
+    {
+        cache.data = 0;
+        cache.s.slot = slot;
+        cache.s.wait = !!(access & SYNCHRONIZE);
+        cache.s.modify = !!(access & EVENT_MODIFY_STATE);
+        cache.s.handle_gen = handle_gen;
+        interlocked_xchg64( &inproc_sync_cache[entry][idx].data, cache.data );
+    }
+    server_leave_uninterrupted_section( &inproc_sync_mutex, &sigset );
+}
+
+/* forget about a handle that is being closed */
+void remove_inproc_sync_from_cache( HANDLE handle )
+{
+    unsigned int entry, idx = inproc_sync_handle_to_index( handle, &entry );
+
+    if (entry < INPROC_SYNC_CACHE_ENTRIES && inproc_sync_cache[entry])
+        interlocked_xchg64( &inproc_sync_cache[entry][idx].data, 0 );
+}
+
+/* retrieve the shared state of a handle, if it can be accessed in-process */
+static const struct inproc_sync *get_cached_inproc_sync( HANDLE handle, BOOL modify )
+{
+    unsigned int entry, idx = inproc_sync_handle_to_index( handle, &entry );
+    union inproc_sync_cache_entry cache;
+    unsigned int handle_gen;
+
+    if (entry >= INPROC_SYNC_CACHE_ENTRIES || !inproc_sync_cache[entry]) return NULL;
+    cache.data = InterlockedCompareExchange64( &inproc_sync_cache[entry][idx].data, 0, 0 );
+    if (!cache.data) return NULL;
+    /* the handle may have been closed and reused behind our back */
+    if (!get_handle_generation( &handle_gen ) || handle_gen != cache.s.handle_gen)
+    {
+        InterlockedCompareExchange64( &inproc_sync_cache[entry][idx].data, 0, cache.data );
+        return NULL;
+    }
+    if (modify ? !cache.s.modify : !cache.s.wait) return NULL;
+    return &inproc_sync_slots[cache.s.slot];
+}
+
+/* wait on objects without blocking; STATUS_NOT_IMPLEMENTED means that the server must be called */
+static NTSTATUS inproc_sync_wait( DWORD count, const HANDLE *handles, BOOLEAN wait_any,
+                                  BOOLEAN alertable, const LARGE_INTEGER *timeout )
+{
+    const struct inproc_sync *syncs[MAXIMUM_WAIT_OBJECTS];
+    DWORD i;
+
+    if (alertable || (!wait_any && count > 1)) return STATUS_NOT_IMPLEMENTED;
+
+    for (i = 0; i < count; i++)
+        if (!(syncs[i] = get_cached_inproc_sync( handles[i], FALSE ))) return STATUS_NOT_IMPLEMENTED;
+
+    /* the first signaled object wins; only manual-reset events can be acquired without changing them */
+    for (i = 0; i < count; i++)
+    {
+        if (!*(volatile const unsigned int *)&syncs[i]->state) continue;
+        if (syncs[i]->type == INPROC_SYNC_MANUAL_EVENT) return STATUS_WAIT_0 + i;
+        return STATUS_NOT_IMPLEMENTED;
+    }
+    if (timeout && !timeout->QuadPart) return STATUS_TIMEOUT;
+    return STATUS_NOT_IMPLEMENTED;  /* let the server block */
+}
+
+/* set or reset an event that is already in that state; STATUS_NOT_IMPLEMENTED means that the server must be called */
+static NTSTATUS inproc_sync_set_event( HANDLE handle, LONG signaled, LONG *prev_state )
+{
+    const struct inproc_sync *sync;
+
+    if (!(sync = get_cached_inproc_sync( handle, TRUE ))) return STATUS_NOT_IMPLEMENTED;
+    if (sync->type != INPROC_SYNC_AUTO_EVENT && sync->type != INPROC_SYNC_MANUAL_EVENT)
+        return STATUS_NOT_IMPLEMENTED;
+    if (*(volatile const unsigned int *)&sync->state != signaled) return STATUS_NOT_IMPLEMENTED;
+
+    if (prev_state) *prev_state = signaled;
+    return STATUS_SUCCESS;
+}
+
+/* check a semaphore release against the maximum count; STATUS_NOT_IMPLEMENTED means that the server must be called */
+static NTSTATUS inproc_sync_release_semaphore( HANDLE handle, ULONG count )
+{
+    const struct inproc_sync *sync;
+    ULONG old;
+
+    if (!(sync = get_cached_inproc_sync( handle, TRUE ))) return STATUS_NOT_IMPLEMENTED;
+    if (sync->type != INPROC_SYNC_SEMAPHORE) return STATUS_NOT_IMPLEMENTED;
+
+    old = *(volatile const unsigned int *)&sync->state;
+    if (old + count < old || old + count > sync->max) return STATUS_SEMAPHORE_LIMIT_EXCEEDED;
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+
 static NTSTATUS validate_open_object_attributes( const OBJECT_ATTRIBUTES *attr )
 {
     if (!attr || attr->Length != sizeof(*attr)) return STATUS_INVALID_PARAMETER;
@@ -318,6 +501,8 @@ NTSTATUS WINAPI NtCreateSemaphore( HANDLE *handle, ACCESS_MASK access, const OBJ
     NTSTATUS ret;
     data_size_t len;
     struct object_attributes *objattr;
+    unsigned int slot = 0, granted = 0, handle_gen;
+    BOOL cacheable = get_handle_generation( &handle_gen );
 
     if (max <= 0 || initial < 0 || initial > max) return STATUS_INVALID_PARAMETER;
     if ((ret = alloc_object_attributes( attr, &objattr, &len ))) return ret;
@@ -330,9 +515,12 @@ NTSTATUS WINAPI NtCreateSemaphore( HANDLE *handle, ACCESS_MASK access, const OBJ
         wine_server_add_data( req, objattr, len );
         ret = wine_server_call( req );
         *handle = wine_server_ptr_handle( reply->handle );
+        slot = reply->inproc_sync;
+        granted = reply->access;
     }
     SERVER_END_REQ;
 
+    if (!ret && cacheable) add_inproc_sync_to_cache( *handle, slot, granted, handle_gen );
     free( objattr );
     return ret;
 }
@@ -344,6 +532,8 @@ NTSTATUS WINAPI NtCreateSemaphore( HANDLE *handle, ACCESS_MASK access, const OBJ
 NTSTATUS WINAPI NtOpenSemaphore( HANDLE *handle, ACCESS_MASK access, const OBJECT_ATTRIBUTES *attr )
 {
     NTSTATUS ret;
+    unsigned int slot = 0, granted = 0, handle_gen;
+    BOOL cacheable = get_handle_generation( &handle_gen );
 
     if ((ret = validate_open_object_attributes( attr ))) return ret;
 
@@ -356,8 +546,12 @@ NTSTATUS WINAPI NtOpenSemaphore( HANDLE *handle, ACCESS_MASK access, const OBJEC
             wine_server_add_data( req, attr->ObjectName->Buffer, attr->ObjectName->Length );
         ret = wine_server_call( req );
         *handle = wine_server_ptr_handle( reply->handle );
+        slot = reply->inproc_sync;
+        granted = reply->access;
     }
     SERVER_END_REQ;
+
+    if (!ret && cacheable) add_inproc_sync_to_cache( *handle, slot, granted, handle_gen );
     return ret;
 }
 
@@ -403,6 +597,8 @@ NTSTATUS WINAPI NtReleaseSemaphore( HANDLE handle, ULONG count, ULONG *previous
 {
     NTSTATUS ret;
 
+    if ((ret = inproc_sync_release_semaphore( handle, count )) != STATUS_NOT_IMPLEMENTED) return ret;
+
     SERVER_START_REQ( release_semaphore )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -426,6 +622,8 @@ NTSTATUS WINAPI NtCreateEvent( HANDLE *handle, ACCESS_MASK access, const OBJECT_
     NTSTATUS ret;
     data_size_t len;
     struct object_attributes *objattr;
+    unsigned int slot = 0, granted = 0, handle_gen;
+    BOOL cacheable = get_handle_generation( &handle_gen );
 
     if (type != NotificationEvent && type != SynchronizationEvent) return STATUS_INVALID_PARAMETER;
     if ((ret = alloc_object_attributes( attr, &objattr, &len ))) return ret;
@@ -438,9 +636,12 @@ NTSTATUS WINAPI NtCreateEvent( HANDLE *handle, ACCESS_MASK access, const OBJECT_
         wine_server_add_data( req, objattr, len );
         ret = wine_server_call( req );
         *handle = wine_server_ptr_handle( reply->handle );
+        slot = reply->inproc_sync;
+        granted = reply->access;
     }
     SERVER_END_REQ;
 
+    if (!ret && cacheable) add_inproc_sync_to_cache( *handle, slot, granted, handle_gen );
     free( objattr );
     return ret;
 }
@@ -452,6 +653,8 @@ NTSTATUS WINAPI NtCreateEvent( HANDLE *handle, ACCESS_MASK access, const OBJECT_
 NTSTATUS WINAPI NtOpenEvent( HANDLE *handle, ACCESS_MASK access, const OBJECT_ATTRIBUTES *attr )
 {
     NTSTATUS ret;
+    unsigned int slot = 0, granted = 0, handle_gen;
+    BOOL cacheable = get_handle_generation( &handle_gen );
 
     if ((ret = validate_open_object_attributes( attr ))) return ret;
 
@@ -464,8 +667,12 @@ NTSTATUS WINAPI NtOpenEvent( HANDLE *handle, ACCESS_MASK access, const OBJECT_AT
             wine_server_add_data( req, attr->ObjectName->Buffer, attr->ObjectName->Length );
         ret = wine_server_call( req );
         *handle = wine_server_ptr_handle( reply->handle );
+        slot = reply->inproc_sync;
+        granted = reply->access;
     }
     SERVER_END_REQ;
+
+    if (!ret && cacheable) add_inproc_sync_to_cache( *handle, slot, granted, handle_gen );
     return ret;
 }
 
@@ -477,6 +684,8 @@ NTSTATUS WINAPI NtSetEvent( HANDLE handle, LONG *prev_state )
 {
     NTSTATUS ret;
 
+    if ((ret = inproc_sync_set_event( handle, 1, prev_state )) != STATUS_NOT_IMPLEMENTED) return ret;
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -496,6 +705,8 @@ NTSTATUS WINAPI NtResetEvent( HANDLE handle, LONG *prev_state )
 {
     NTSTATUS ret;
 
+    if ((ret = inproc_sync_set_event( handle, 0, prev_state )) != STATUS_NOT_IMPLEMENTED) return ret;
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -1424,9 +1635,13 @@ NTSTATUS WINAPI NtWaitForMultipleObjects( DWORD count, const HANDLE *handles, BO
 {
     select_op_t select_op;
     UINT i, flags = SELECT_INTERRUPTIBLE;
+    NTSTATUS ret;
 
     if (!count || count > MAXIMUM_WAIT_OBJECTS) return STATUS_INVALID_PARAMETER_1;
 
+    if ((ret = inproc_sync_wait( count, handles, wait_any, alertable, timeout )) != STATUS_NOT_IMPLEMENTED)
+        return ret;
+
     if (alertable) flags |= SELECT_ALERTABLE;
     select_op.wait.op = wait_any ? SELECT_WAIT : SELECT_WAIT_ALL;
     for (i = 0; i < count; i++) select_op.wait.handles[i] = wine_server_obj_handle( handles[i] );
@@ -1806,6 +2021,52 @@ NTSTATUS WINAPI NtSetIoCompletion( HANDLE handle, ULONG_PTR key, ULONG_PTR value
 }
 
 
+/***********************************************************************
+ *             create_wait_completion
+ *
+ * Post a completion to the port once the object is signaled. The wait is
+ * one-shot; it can be cancelled with cancel_wait_completion().
+ */
+NTSTATUS CDECL create_wait_completion( HANDLE port, HANDLE handle, ULONG_PTR key, ULONG_PTR value,
+                                       HANDLE *wait )
+{
+    NTSTATUS ret;
+
+    TRACE( "(%p, %p, %lx, %lx)\n", port, handle, key, value );
+
+    SERVER_START_REQ( create_wait_completion )
+    {
+        req->port   = wine_server_obj_handle( port );
+        req->handle = wine_server_obj_handle( handle );
+        req->ckey   = key;
+        req->cvalue = value;
+        if (!(ret = wine_server_call( req ))) *wait = wine_server_ptr_handle( reply->wait );
+    }
+    SERVER_END_REQ;
+    return ret;
+}
+
+
+/***********************************************************************
+ *             cancel_wait_completion
+ *
+ * Cancel a wait, and tell whether its completion has already been posted.
+ */
+NTSTATUS CDECL cancel_wait_completion( HANDLE wait, BOOLEAN *signaled )
+{
+    NTSTATUS ret;
+
+    SERVER_START_REQ( cancel_wait_completion )
+    {
+        req->wait = wine_server_obj_handle( wait );
+        if (!(ret = wine_server_call( req ))) *signaled = reply->signaled;
+    }
+    SERVER_END_REQ;
+    if (!ret) NtClose( wait );
+    return ret;
+}
+
+
 /***********************************************************************
  *             NtRemoveIoCompletion (NTDLL.@)
  */
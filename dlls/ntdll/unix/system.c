@@ -1973,9 +1973,10 @@ static void find_reg_tz_info(RTL_DYNAMIC_TIME_ZONE_INFORMATION *tzi, const char*
 
         if (match_tz_info( tzi, &reg_tzi ) && match_tz_name( tz_name, &reg_tzi ))
         {
+            HANDLE handles[2] = { subkey, key };
+
             *tzi = reg_tzi;
-            NtClose( subkey );
-            NtClose( key );
+            server_close_handles( handles, ARRAY_SIZE(handles) );
             return;
         }
     next:
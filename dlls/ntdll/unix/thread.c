@@ -719,6 +719,11 @@ static void pthread_exit_wrapper( int status )
     close( ntdll_get_thread_data()->wait_fd[1] );
     close( ntdll_get_thread_data()->reply_fd );
     close( ntdll_get_thread_data()->request_fd );
+    if (ntdll_get_thread_data()->shared_req)
+    {
+        munmap( ntdll_get_thread_data()->shared_req, SHARED_REQUEST_BUFFER_SIZE );
+        close( ntdll_get_thread_data()->doorbell_fd );
+    }
     pthread_exit( UIntToPtr(status) );
 }
 
@@ -26,9 +26,12 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <signal.h>
 #include <sys/types.h>
 #ifdef HAVE_SYS_SOCKET_H
@@ -43,6 +46,11 @@
 #ifdef HAVE_SYS_SYSINFO_H
 # include <sys/sysinfo.h>
 #endif
+#ifdef HAVE_LINUX_USERFAULTFD_H
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <linux/userfaultfd.h>
+#endif
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
 #endif
@@ -143,6 +151,7 @@ struct file_view
 #define VPROT_WRITEWATCH 0x40
 /* per-mapping protection flags */
 #define VPROT_SYSTEM     0x0200  /* system view (underlying mmap not under our control) */
+#define VPROT_KERNELWATCH 0x0400 /* write watches are tracked by the kernel */
 
 /* Conversion from VPROT_* to Win32 flags */
 static const BYTE VIRTUAL_Win32Flags[16] =
@@ -914,6 +923,23 @@ static void set_page_vprot( const void *addr, size_t size, BYTE vprot )
 }
 
 
+/***********************************************************************
+ *           update_vprot_bytes
+ *
+ * Set or clear bits in a contiguous block of page protection bytes, a word at a time.
+ */
+static void update_vprot_bytes( BYTE *ptr, size_t count, BYTE set, BYTE clear )
+{
+    static const UINT_PTR word_from_byte = (UINT_PTR)0x0101010101010101;
+    UINT_PTR set_word = word_from_byte * set, keep_word = word_from_byte * (BYTE)~clear;
+
+    for ( ; count && ((UINT_PTR)ptr & (sizeof(UINT_PTR) - 1)); count--, ptr++) *ptr = (*ptr & ~clear) | set;
+    for ( ; count >= sizeof(UINT_PTR); count -= sizeof(UINT_PTR), ptr += sizeof(UINT_PTR))
+        *(UINT_PTR *)ptr = (*(UINT_PTR *)ptr & keep_word) | set_word;
+    for ( ; count; count--, ptr++) *ptr = (*ptr & ~clear) | set;
+}
+
+
 /***********************************************************************
  *           set_page_vprot_bits
  *
@@ -925,14 +951,66 @@ static void set_page_vprot_bits( const void *addr, size_t size, BYTE set, BYTE c
     size_t end = ((size_t)addr + size + page_mask) >> page_shift;
 
 #ifdef _WIN64
-    for ( ; idx < end; idx++)
+    while (idx >> pages_vprot_shift != end >> pages_vprot_shift)
     {
-        BYTE *ptr = pages_vprot[idx >> pages_vprot_shift] + (idx & pages_vprot_mask);
-        *ptr = (*ptr & ~clear) | set;
+        size_t dir_size = pages_vprot_mask + 1 - (idx & pages_vprot_mask);
+        update_vprot_bytes( pages_vprot[idx >> pages_vprot_shift] + (idx & pages_vprot_mask), dir_size, set, clear );
+        idx += dir_size;
     }
+    update_vprot_bytes( pages_vprot[idx >> pages_vprot_shift] + (idx & pages_vprot_mask), end - idx, set, clear );
+#else
+    update_vprot_bytes( pages_vprot + idx, end - idx, set, clear );
+#endif
+}
+
+
+/***********************************************************************
+ *           get_vprot_range_size
+ *
+ * Return the size of the range starting at base where all the pages have the same
+ * protection bits under the mask, and the protection byte of the first page.
+ * Page bytes are compared a word at a time; the blocks of the page byte table are
+ * multiples of the word size, so aligned words never cross a block boundary.
+ */
+static SIZE_T get_vprot_range_size( char *base, SIZE_T size, BYTE mask, BYTE *vprot )
+{
+    static const UINT_PTR word_from_byte = (UINT_PTR)0x0101010101010101;
+    static const size_t index_align_mask = sizeof(UINT_PTR) - 1;
+    size_t curr_idx, start_idx, end_idx, aligned_start_idx;
+    UINT_PTR vprot_word, mask_word;
+    const BYTE *vprot_ptr;
+
+    curr_idx = start_idx = (size_t)base >> page_shift;
+    end_idx = start_idx + (size >> page_shift);
+
+    aligned_start_idx = (start_idx + index_align_mask) & ~index_align_mask;
+    if (aligned_start_idx > end_idx) aligned_start_idx = end_idx;
+
+#ifdef _WIN64
+    vprot_ptr = pages_vprot[curr_idx >> pages_vprot_shift] + (curr_idx & pages_vprot_mask);
 #else
-    for ( ; idx < end; idx++) pages_vprot[idx] = (pages_vprot[idx] & ~clear) | set;
+    vprot_ptr = pages_vprot + curr_idx;
+#endif
+    *vprot = *vprot_ptr;
+
+    for ( ; curr_idx < aligned_start_idx; curr_idx++, vprot_ptr++)
+        if ((*vprot ^ *vprot_ptr) & mask) return (curr_idx - start_idx) << page_shift;
+
+    vprot_word = word_from_byte * *vprot;
+    mask_word = word_from_byte * mask;
+    for ( ; curr_idx < end_idx; curr_idx += sizeof(UINT_PTR), vprot_ptr += sizeof(UINT_PTR))
+    {
+#ifdef _WIN64
+        if (!(curr_idx & pages_vprot_mask)) vprot_ptr = pages_vprot[curr_idx >> pages_vprot_shift];
 #endif
+        if ((vprot_word ^ *(const UINT_PTR *)vprot_ptr) & mask_word)
+        {
+            for ( ; curr_idx < end_idx; curr_idx++, vprot_ptr++)
+                if ((*vprot ^ *vprot_ptr) & mask) break;
+            return (curr_idx - start_idx) << page_shift;
+        }
+    }
+    return size;
 }
 
 
@@ -1019,9 +1097,9 @@ static int get_unix_prot( BYTE vprot )
  */
 static void dump_view( struct file_view *view )
 {
-    UINT i, count;
-    char *addr = view->base;
-    BYTE prot = get_page_vprot( addr );
+    SIZE_T range_size;
+    char *addr = view->base, *end = addr + view->size;
+    BYTE prot;
 
     TRACE( "View: %p - %p", addr, addr + view->size - 1 );
     if (view->protect & VPROT_SYSTEM)
@@ -1035,19 +1113,12 @@ static void dump_view( struct file_view *view )
     else
         TRACE( " (valloc)\n");
 
-    for (count = i = 1; i < view->size >> page_shift; i++, count++)
+    for ( ; addr < end; addr += range_size)
     {
-        BYTE next = get_page_vprot( addr + (count << page_shift) );
-        if (next == prot) continue;
+        range_size = get_vprot_range_size( addr, end - addr, 0xff, &prot );
         TRACE( "      %p - %p %s\n",
-                 addr, addr + (count << page_shift) - 1, get_prot_str(prot) );
-        addr += (count << page_shift);
-        prot = next;
-        count = 0;
+                 addr, addr + range_size - 1, get_prot_str(prot) );
     }
-    if (count)
-        TRACE( "      %p - %p %s\n",
-                 addr, addr + (count << page_shift) - 1, get_prot_str(prot) );
 }
 
 
@@ -1640,22 +1711,26 @@ static inline int mprotect_exec( void *base, size_t size, int unix_prot )
  */
 static void mprotect_range( void *base, size_t size, BYTE set, BYTE clear )
 {
-    size_t i, count;
+    SIZE_T range_size, run_size = 0;
     char *addr = ROUND_ADDR( base, page_mask );
-    int prot, next;
+    char *end = addr + ROUND_SIZE( base, size );
+    int prot = 0, next;
+    BYTE vprot;
 
-    size = ROUND_SIZE( base, size );
-    prot = get_unix_prot( (get_page_vprot( addr ) & ~clear ) | set );
-    for (count = i = 1; i < size >> page_shift; i++, count++)
+    /* runs of different page bytes that end up with the same unix protection are coalesced */
+    for ( ; addr + run_size < end; run_size += range_size)
     {
-        next = get_unix_prot( (get_page_vprot( addr + (count << page_shift) ) & ~clear) | set );
-        if (next == prot) continue;
-        mprotect_exec( addr, count << page_shift, prot );
-        addr += count << page_shift;
+        range_size = get_vprot_range_size( addr + run_size, end - addr - run_size, 0xff, &vprot );
+        next = get_unix_prot( (vprot & ~clear) | set );
+        if (run_size && next != prot)
+        {
+            mprotect_exec( addr, run_size, prot );
+            addr += run_size;
+            run_size = 0;
+        }
         prot = next;
-        count = 0;
     }
-    if (count) mprotect_exec( addr, count << page_shift, prot );
+    if (run_size) mprotect_exec( addr, run_size, prot );
 }
 
 
@@ -1707,6 +1782,216 @@ static NTSTATUS set_protection( struct file_view *view, void *base, SIZE_T size,
 }
 
 
+#ifdef HAVE_LINUX_USERFAULTFD_H
+
+/* definitions from recent kernel headers */
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#endif
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_ASYNC       (1 << 15)
+#endif
+#ifndef PAGEMAP_SCAN
+struct page_region
+{
+    __u64 start;
+    __u64 end;
+    __u64 categories;
+};
+
+struct pm_scan_arg
+{
+    __u64 size;
+    __u64 flags;
+    __u64 start;
+    __u64 end;
+    __u64 walk_end;
+    __u64 vec;
+    __u64 vec_len;
+    __u64 max_pages;
+    __u64 category_inverted;
+    __u64 category_mask;
+    __u64 category_anyof_mask;
+    __u64 return_mask;
+};
+
+#define PAGEMAP_SCAN           _IOWR('f', 16, struct pm_scan_arg)
+#define PAGE_IS_WRITTEN        (1 << 1)
+#define PM_SCAN_WP_MATCHING    (1 << 0)
+#define PM_SCAN_CHECK_WPASYNC  (1 << 1)
+#endif
+
+static int uffd_fd = -1;     /* userfaultfd write-protecting the watched ranges */
+static int pagemap_fd = -1;  /* /proc/self/pagemap, to find and reset the written pages */
+
+#endif  /* HAVE_LINUX_USERFAULTFD_H */
+
+static BOOL use_kernel_writewatch;
+
+
+/***********************************************************************
+ *           kernel_writewatch_init
+ *
+ * Check whether the kernel can track written pages for us through asynchronous userfaultfd
+ * write protection, so that the first write to a page doesn't need to go through a signal.
+ * This can be disabled with WINEKERNELWRITEWATCH=0.
+ */
+static void kernel_writewatch_init(void)
+{
+#ifdef HAVE_LINUX_USERFAULTFD_H
+    static const __u64 features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+    const char *env = getenv( "WINEKERNELWRITEWATCH" );
+    struct uffdio_api api;
+    struct pm_scan_arg arg;
+
+    if (env && !atoi( env )) return;
+
+    if ((uffd_fd = syscall( __NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY )) == -1 &&
+        (uffd_fd = syscall( __NR_userfaultfd, O_CLOEXEC | O_NONBLOCK )) == -1)
+        return;
+
+    api.api = UFFD_API;
+    api.features = features;
+    if (ioctl( uffd_fd, UFFDIO_API, &api ) == -1 || (api.features & features) != features) goto failed;
+
+    if ((pagemap_fd = open( "/proc/self/pagemap", O_RDONLY | O_CLOEXEC )) == -1) goto failed;
+    memset( &arg, 0, sizeof(arg) );
+    arg.size = sizeof(arg);
+    if (ioctl( pagemap_fd, PAGEMAP_SCAN, &arg ) == -1) goto failed;
+
+    TRACE( "using kernel write watches\n" );
+    use_kernel_writewatch = TRUE;
+    return;
+
+failed:
+    if (pagemap_fd != -1) close( pagemap_fd );
+    close( uffd_fd );
+    uffd_fd = pagemap_fd = -1;
+#endif
+}
+
+
+/***********************************************************************
+ *           kernel_writewatch_reset
+ *
+ * Write-protect a range again, so that the kernel tracks the next writes.
+ */
+static void kernel_writewatch_reset( void *base, SIZE_T size )
+{
+#ifdef HAVE_LINUX_USERFAULTFD_H
+    struct uffdio_writeprotect wp;
+
+    wp.range.start = (UINT_PTR)base;
+    wp.range.len = size;
+    wp.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+    if (ioctl( uffd_fd, UFFDIO_WRITEPROTECT, &wp ) == -1)
+        ERR( "failed to write-protect %p-%p, errno %d\n", base, (char *)base + size, errno );
+#endif
+}
+
+
+/***********************************************************************
+ *           kernel_writewatch_register
+ *
+ * Let the kernel track the writes to a range of a write watch view.
+ */
+static BOOL kernel_writewatch_register( void *base, SIZE_T size )
+{
+#ifdef HAVE_LINUX_USERFAULTFD_H
+    struct uffdio_register reg;
+
+    reg.range.start = (UINT_PTR)base;
+    reg.range.len = size;
+    reg.mode = UFFDIO_REGISTER_MODE_WP;
+    if (ioctl( uffd_fd, UFFDIO_REGISTER, &reg ) == -1)
+    {
+        WARN( "failed to register %p-%p, errno %d\n", base, (char *)base + size, errno );
+        return FALSE;
+    }
+    kernel_writewatch_reset( base, size );
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+
+/***********************************************************************
+ *           kernel_writewatch_init_view
+ *
+ * Switch a new write watch view to kernel tracking if possible.
+ */
+static void kernel_writewatch_init_view( struct file_view *view )
+{
+    if (!use_kernel_writewatch) return;
+    if (!kernel_writewatch_register( view->base, view->size )) return;
+    view->protect |= VPROT_KERNELWATCH;
+    set_page_vprot_bits( view->base, view->size, 0, VPROT_WRITEWATCH );
+    mprotect_range( view->base, view->size, 0, 0 );
+}
+
+
+/***********************************************************************
+ *           kernel_get_write_watches
+ *
+ * Retrieve the pages written to since the last reset, and optionally reset them.
+ */
+static ULONG_PTR kernel_get_write_watches( void *base, SIZE_T size, void **addresses, ULONG_PTR count,
+                                           BOOL reset )
+{
+    ULONG_PTR pos = 0;
+#ifdef HAVE_LINUX_USERFAULTFD_H
+    struct page_region regions[64];
+    struct pm_scan_arg arg;
+    char *addr = base, *end = addr + size;
+    UINT_PTR page;
+    int i, ret;
+
+    while (pos < count && addr < end)
+    {
+        memset( &arg, 0, sizeof(arg) );
+        arg.size = sizeof(arg);
+        /* only the reported pages get write-protected again */
+        if (reset) arg.flags = PM_SCAN_WP_MATCHING | PM_SCAN_CHECK_WPASYNC;
+        arg.start = (UINT_PTR)addr;
+        arg.end = (UINT_PTR)end;
+        arg.vec = (UINT_PTR)regions;
+        arg.vec_len = ARRAY_SIZE(regions);
+        arg.max_pages = count - pos;
+        arg.category_mask = PAGE_IS_WRITTEN;
+        arg.return_mask = PAGE_IS_WRITTEN;
+        if ((ret = ioctl( pagemap_fd, PAGEMAP_SCAN, &arg )) == -1)
+        {
+            ERR( "failed to scan %p-%p, errno %d\n", addr, end, errno );
+            break;
+        }
+        for (i = 0; i < ret; i++)
+            for (page = regions[i].start; page < regions[i].end && pos < count; page += page_size)
+                addresses[pos++] = (void *)page;
+        if (ret < ARRAY_SIZE(regions)) break;
+        addr = (char *)(UINT_PTR)arg.walk_end;
+    }
+#endif
+    return pos;
+}
+
+
+/***********************************************************************
+ *           is_kernel_write_watch_range
+ */
+static inline BOOL is_kernel_write_watch_range( const void *addr, size_t size )
+{
+    struct file_view *view;
+
+    if (!use_kernel_writewatch) return FALSE;
+    view = find_view( addr, size );
+    return view && (view->protect & VPROT_KERNELWATCH);
+}
+
+
 /***********************************************************************
  *           update_write_watches
  */
@@ -1727,6 +2012,11 @@ static void update_write_watches( void *base, size_t size, size_t accessed_size
  */
 static void reset_write_watches( void *base, SIZE_T size )
 {
+    if (is_kernel_write_watch_range( base, size ))
+    {
+        kernel_writewatch_reset( base, size );
+        return;
+    }
     set_page_vprot_bits( base, size, VPROT_WRITEWATCH, 0 );
     mprotect_range( base, size, 0, 0 );
 }
@@ -1994,7 +2284,7 @@ done:
  */
 static SIZE_T get_committed_size( struct file_view *view, void *base, BYTE *vprot )
 {
-    SIZE_T i, start;
+    SIZE_T start;
 
     start = ((char *)base - (char *)view->base) >> page_shift;
     *vprot = get_page_vprot( base );
@@ -2019,9 +2309,7 @@ static SIZE_T get_committed_size( struct file_view *view, void *base, BYTE *vpro
         SERVER_END_REQ;
         return ret;
     }
-    for (i = start + 1; i < view->size >> page_shift; i++)
-        if ((*vprot ^ get_page_vprot( (char *)view->base + (i << page_shift) )) & VPROT_COMMITTED) break;
-    return (i - start) << page_shift;
+    return get_vprot_range_size( base, view->size - (start << page_shift), VPROT_COMMITTED, vprot );
 }
 
 
@@ -2036,6 +2324,9 @@ static NTSTATUS decommit_pages( struct file_view *view, size_t start, size_t siz
     if (anon_mmap_fixed( (char *)view->base + start, size, PROT_NONE, 0 ) != MAP_FAILED)
     {
         set_page_vprot_bits( (char *)view->base + start, size, 0, VPROT_COMMITTED );
+        /* the new mapping needs to be registered again */
+        if (view->protect & VPROT_KERNELWATCH)
+            kernel_writewatch_register( (char *)view->base + start, size );
         return STATUS_SUCCESS;
     }
     return STATUS_NO_MEMORY;
@@ -2130,14 +2421,430 @@ static NTSTATUS map_pe_header( void *ptr, size_t size, int fd, BOOL *removable )
 }
 
 
+/* header of the files caching the relocated pages of a DLL for a given load address */
+struct reloc_cache_header
+{
+    char     magic[8];      /* RELOC_CACHE_MAGIC */
+    ULONG64  dev;           /* device of the image file */
+    ULONG64  ino;           /* inode of the image file */
+    ULONG64  size;          /* size of the image file */
+    ULONG64  mtime;         /* modification time of the image file */
+    ULONG64  ctime;         /* change time of the image file */
+    ULONG64  mtime_nsec;    /* nanoseconds of the modification time */
+    ULONG64  ctime_nsec;    /* nanoseconds of the change time */
+    ULONG64  base;          /* address the pages have been relocated to */
+    ULONG64  map_size;      /* size of the image mapping */
+    ULONG64  data_offset;   /* offset of the image pages in the cache file */
+};
+
+#define RELOC_CACHE_MAGIC "WINERLC2"
+#define RELOC_CACHE_DATA_OFFSET 0x10000  /* keep the pages aligned for any page size */
+#define RELOC_CACHE_MAX_FILES   256      /* the oldest files are removed past this count */
+
+/***********************************************************************
+ *           use_reloc_cache
+ *
+ * Check whether relocated images should be cached on disk; can be disabled with WINERELOCCACHE=0.
+ */
+static BOOL use_reloc_cache(void)
+{
+    static int enabled = -1;
+
+    if (enabled == -1)
+    {
+        const char *env = getenv( "WINERELOCCACHE" );
+        enabled = !env || atoi( env );
+    }
+    return enabled && config_dir;
+}
+
+
+/***********************************************************************
+ *           get_reloc_cache_name
+ *
+ * Build the name of the cache file of an image relocated to a given base. Must be freed by caller.
+ */
+static char *get_reloc_cache_name( const struct stat *st, void *base )
+{
+    char *name;
+
+    if (!(name = malloc( strlen( config_dir ) + sizeof("/relocs/") + 3 * 16 + 3 ))) return NULL;
+    sprintf( name, "%s/relocs/%llx-%llx-%lx", config_dir, (unsigned long long)st->st_dev,
+             (unsigned long long)st->st_ino, (unsigned long)base );
+    return name;
+}
+
+
+/***********************************************************************
+ *           init_reloc_cache_header
+ */
+static void init_reloc_cache_header( struct reloc_cache_header *header, const struct stat *st,
+                                     void *base, SIZE_T map_size )
+{
+    memset( header, 0, sizeof(*header) );
+    memcpy( header->magic, RELOC_CACHE_MAGIC, sizeof(header->magic) );
+    header->dev         = st->st_dev;
+    header->ino         = st->st_ino;
+    header->size        = st->st_size;
+    header->mtime       = st->st_mtime;
+    header->ctime       = st->st_ctime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    header->mtime_nsec  = st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    header->mtime_nsec  = st->st_mtimespec.tv_nsec;
+#endif
+#ifdef HAVE_STRUCT_STAT_ST_CTIM
+    header->ctime_nsec  = st->st_ctim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_CTIMESPEC)
+    header->ctime_nsec  = st->st_ctimespec.tv_nsec;
+#endif
+    header->base        = (UINT_PTR)base;
+    header->map_size    = map_size;
+    header->data_offset = RELOC_CACHE_DATA_OFFSET;
+}
+
+
+/***********************************************************************
+ *           open_reloc_cache
+ *
+ * Open the cache file of an image relocated to a given base, if it is up to date.
+ */
+static int open_reloc_cache( const struct stat *st, void *base, SIZE_T map_size, off_t *data_offset )
+{
+    struct reloc_cache_header header, expect;
+    struct stat cache_st;
+    char *name;
+    int fd;
+
+    if (!(name = get_reloc_cache_name( st, base ))) return -1;
+    if ((fd = open( name, O_RDONLY )) == -1)
+    {
+        free( name );
+        return -1;
+    }
+
+    init_reloc_cache_header( &expect, st, base, map_size );
+    /* a truncated file would raise SIGBUS once mapped */
+    if (pread( fd, &header, sizeof(header), 0 ) != sizeof(header) || memcmp( &header, &expect, sizeof(header) ) ||
+        fstat( fd, &cache_st ) == -1 || cache_st.st_size < header.data_offset + map_size)
+    {
+        /* stale or broken, it will be written again */
+        close( fd );
+        unlink( name );
+        free( name );
+        return -1;
+    }
+    free( name );
+    *data_offset = header.data_offset;
+    return fd;
+}
+
+
+/* a file of the relocation cache directory, considered for removal */
+struct reloc_cache_file
+{
+    time_t mtime;
+    char   name[256];
+};
+
+/***********************************************************************
+ *           compare_reloc_cache_files
+ */
+static int compare_reloc_cache_files( const void *a, const void *b )
+{
+    const struct reloc_cache_file *file1 = a, *file2 = b;
+
+    if (file1->mtime < file2->mtime) return -1;
+    return file1->mtime > file2->mtime;
+}
+
+
+/***********************************************************************
+ *           prune_reloc_cache
+ *
+ * Remove the oldest cache files once there are too many of them, since files for older
+ * versions of the DLLs and for other load addresses are never used again.
+ */
+static void prune_reloc_cache( const char *dir )
+{
+    struct reloc_cache_file *files = NULL, *new_files;
+    unsigned int i, count = 0, size = 0;
+    struct dirent *de;
+    struct stat st;
+    DIR *dirp;
+    int dir_fd;
+
+    if (!(dirp = opendir( dir ))) return;
+    dir_fd = dirfd( dirp );
+    while ((de = readdir( dirp )))
+    {
+        if (de->d_name[0] == '.' || strlen( de->d_name ) >= sizeof(files->name)) continue;
+        if (fstatat( dir_fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW ) == -1 || !S_ISREG( st.st_mode )) continue;
+        if (count == size)
+        {
+            size = max( size * 2, RELOC_CACHE_MAX_FILES );
+            if (!(new_files = realloc( files, size * sizeof(*files) ))) break;
+            files = new_files;
+        }
+        files[count].mtime = st.st_mtime;
+        strcpy( files[count].name, de->d_name );
+        count++;
+    }
+
+    if (count > RELOC_CACHE_MAX_FILES)
+    {
+        /* make room for a while, so that this doesn't happen on every write */
+        qsort( files, count, sizeof(*files), compare_reloc_cache_files );
+        for (i = 0; i < count - RELOC_CACHE_MAX_FILES * 3 / 4; i++) unlinkat( dir_fd, files[i].name, 0 );
+    }
+    closedir( dirp );
+    free( files );
+}
+
+
+/***********************************************************************
+ *           get_section_sizes
+ *
+ * Compute the size of the mapping of a section, and the size of its data in the file.
+ */
+static void get_section_sizes( const IMAGE_SECTION_HEADER *sec, SIZE_T *map_size, SIZE_T *file_size )
+{
+    static const SIZE_T sector_align = 0x1ff;
+
+    if (!sec->Misc.VirtualSize)
+        *map_size = ROUND_SIZE( 0, sec->SizeOfRawData );
+    else
+        *map_size = ROUND_SIZE( 0, sec->Misc.VirtualSize );
+
+    /* file positions are rounded to sector boundaries regardless of OptionalHeader.FileAlignment */
+    *file_size = (sec->SizeOfRawData + (sec->PointerToRawData & sector_align) + sector_align) & ~sector_align;
+    if (*file_size > *map_size) *file_size = *map_size;
+}
+
+
+/***********************************************************************
+ *           get_file_backed_size
+ *
+ * Size of the file-backed range of a section, i.e. the part that is stored in the cache file.
+ */
+static SIZE_T get_file_backed_size( const IMAGE_SECTION_HEADER *sec )
+{
+    SIZE_T map_size, file_size;
+
+    if (!sec->PointerToRawData) return 0;
+    get_section_sizes( sec, &map_size, &file_size );
+    if (!file_size) return 0;
+    return min( ROUND_SIZE( 0, file_size ), map_size );
+}
+
+
+/* relocated pages of an image to store in the cache once virtual_mutex has been released */
+struct reloc_cache_write
+{
+    struct stat          st;             /* status of the image file */
+    char                *base;           /* base address of the image */
+    SIZE_T               map_size;       /* size of the image mapping */
+    SIZE_T               header_size;    /* size of the image headers */
+    int                  nb_sections;    /* number of sections */
+    IMAGE_SECTION_HEADER sections[1];    /* copy of the section headers */
+};
+
+/***********************************************************************
+ *           write_reloc_cache
+ *
+ * Store the relocated pages of an image, so that other processes can map them directly.
+ * This does file I/O on the whole image, so it must not be done while holding virtual_mutex.
+ */
+static void write_reloc_cache( const struct reloc_cache_write *write )
+{
+    const struct stat *st = &write->st;
+    const IMAGE_SECTION_HEADER *sections = write->sections;
+    char *base = write->base;
+    SIZE_T map_size = write->map_size;
+    struct reloc_cache_header header;
+    char *name, *tmp;
+    BOOL ret = TRUE;
+    int i, fd;
+
+    if (!(name = get_reloc_cache_name( st, base ))) return;
+    if (!(tmp = malloc( strlen( name ) + 16 )))
+    {
+        free( name );
+        return;
+    }
+    sprintf( tmp, "%s.%x", name, (int)getpid() );
+    fd = open( tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+    if (fd == -1 && errno == ENOENT)
+    {
+        strcpy( tmp, config_dir );
+        strcat( tmp, "/relocs" );
+        mkdir( tmp, 0700 );
+        sprintf( tmp, "%s.%x", name, (int)getpid() );
+        fd = open( tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+    }
+    if (fd == -1) goto done;
+
+    init_reloc_cache_header( &header, st, base, map_size );
+    /* the whole mapping is covered, even if the last pages are never written */
+    ret = !ftruncate( fd, header.data_offset + map_size ) &&
+          pwrite( fd, &header, sizeof(header), 0 ) == sizeof(header);
+    if (ret)
+    {
+        SIZE_T size = ROUND_SIZE( 0, write->header_size );
+        ret = pwrite( fd, base, size, header.data_offset ) == size;
+    }
+    for (i = 0; ret && i < write->nb_sections; i++)
+    {
+        SIZE_T size = get_file_backed_size( &sections[i] );
+
+        if (!size) continue;
+        ret = pwrite( fd, base + sections[i].VirtualAddress, size,
+                      header.data_offset + sections[i].VirtualAddress ) == size;
+    }
+    close( fd );
+    if (!ret || rename( tmp, name ) == -1) unlink( tmp );
+    else
+    {
+        strcpy( tmp, config_dir );
+        strcat( tmp, "/relocs" );
+        prune_reloc_cache( tmp );
+    }
+
+done:
+    free( tmp );
+    free( name );
+}
+
+
+/***********************************************************************
+ *           check_relocations
+ *
+ * Check that all the relocations of an image are supported, and only touch file-backed pages.
+ */
+static BOOL check_relocations( char *base, const IMAGE_DATA_DIRECTORY *relocs, SIZE_T map_size, SIZE_T header_size,
+                               const IMAGE_SECTION_HEADER *sections, int nb_sections )
+{
+    IMAGE_BASE_RELOCATION *rel, *end;
+
+    if (relocs->VirtualAddress >= map_size || relocs->Size > map_size - relocs->VirtualAddress) return FALSE;
+
+    rel = (IMAGE_BASE_RELOCATION *)(base + relocs->VirtualAddress);
+    end = (IMAGE_BASE_RELOCATION *)(base + relocs->VirtualAddress + relocs->Size);
+
+    while (rel < end - 1 && rel->SizeOfBlock)
+    {
+        UINT count;
+        USHORT *entry;
+
+        if (rel->SizeOfBlock < sizeof(*rel) || rel->SizeOfBlock > (char *)end - (char *)rel) return FALSE;
+        count = (rel->SizeOfBlock - sizeof(*rel)) / sizeof(USHORT);
+        for (entry = (USHORT *)(rel + 1); count--; entry++)
+        {
+            ULONG_PTR addr = (ULONG_PTR)rel->VirtualAddress + (*entry & 0xfff);
+            SIZE_T size;
+            int i;
+
+            switch (*entry >> 12)
+            {
+            case IMAGE_REL_BASED_ABSOLUTE:
+                continue;
+            case IMAGE_REL_BASED_HIGH:
+            case IMAGE_REL_BASED_LOW:
+                size = sizeof(short);
+                break;
+            case IMAGE_REL_BASED_HIGHLOW:
+                size = sizeof(int);
+                break;
+#ifdef _WIN64
+            case IMAGE_REL_BASED_DIR64:
+                size = sizeof(INT_PTR);
+                break;
+#elif defined(__arm__)
+            case IMAGE_REL_BASED_THUMB_MOV32:
+                size = 2 * sizeof(DWORD);
+                break;
+#endif
+            default:
+                return FALSE;
+            }
+            if (addr + size <= ROUND_SIZE( 0, header_size )) continue;
+            for (i = 0; i < nb_sections; i++)
+            {
+                if (addr < sections[i].VirtualAddress) continue;
+                if (addr + size <= sections[i].VirtualAddress + get_file_backed_size( &sections[i] )) break;
+            }
+            if (i == nb_sections) return FALSE;
+        }
+        rel = (IMAGE_BASE_RELOCATION *)((char *)rel + rel->SizeOfBlock);
+    }
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           relocate_image
+ *
+ * Relocate a freshly mapped DLL to its actual load address, the way the Windows kernel does it;
+ * the loader then finds the image already at its base. Return FALSE if it has to be left to the loader.
+ */
+static BOOL relocate_image( char *base, IMAGE_NT_HEADERS *nt, SIZE_T map_size, SIZE_T header_size,
+                            const IMAGE_SECTION_HEADER *sections, int nb_sections )
+{
+    const IMAGE_DATA_DIRECTORY *relocs = &nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+    IMAGE_BASE_RELOCATION *rel, *end;
+    INT_PTR delta = base - (char *)nt->OptionalHeader.ImageBase;
+
+    if (!check_relocations( base, relocs, map_size, header_size, sections, nb_sections )) return FALSE;
+
+    TRACE_(module)( "relocating %p to %p\n", (void *)nt->OptionalHeader.ImageBase, base );
+
+    rel = (IMAGE_BASE_RELOCATION *)(base + relocs->VirtualAddress);
+    end = (IMAGE_BASE_RELOCATION *)(base + relocs->VirtualAddress + relocs->Size);
+    while (rel && rel < end - 1 && rel->SizeOfBlock) rel = process_relocation_block( base, rel, delta );
+    nt->OptionalHeader.ImageBase = (ULONG_PTR)base;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           can_relocate_image
+ *
+ * Check whether an image can be relocated at mapping time.
+ */
+static BOOL can_relocate_image( char *base, const IMAGE_NT_HEADERS *nt,
+                                const IMAGE_SECTION_HEADER *sections, int nb_sections )
+{
+    const IMAGE_DATA_DIRECTORY *relocs = &nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+    int i;
+
+    if (base == (char *)nt->OptionalHeader.ImageBase) return FALSE;
+    if (nt->OptionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR_MAGIC) return FALSE;
+    if (!(nt->FileHeader.Characteristics & IMAGE_FILE_DLL)) return FALSE;
+    if (nt->FileHeader.Characteristics & IMAGE_FILE_RELOCS_STRIPPED) return FALSE;
+    if (nt->OptionalHeader.SectionAlignment < page_size) return FALSE;
+    if (!relocs->Size || !relocs->VirtualAddress) return FALSE;
+
+    for (i = 0; i < nb_sections; i++)
+    {
+        if ((sections[i].Characteristics & IMAGE_SCN_MEM_SHARED) &&
+            (sections[i].Characteristics & IMAGE_SCN_MEM_WRITE)) return FALSE;
+        if (sections[i].VirtualAddress & page_mask) return FALSE;
+    }
+    return TRUE;
+}
+
+
 /***********************************************************************
  *           map_image_into_view
  *
  * Map an executable (PE format) image into an existing view.
- * virtual_mutex must be held by caller.
+ * virtual_mutex must be held by caller. If the relocated pages should be
+ * cached, cache_write is set and the caller must pass it to write_reloc_cache()
+ * once the mutex is released.
  */
 static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filename, int fd, void *orig_base,
-                                     SIZE_T header_size, ULONG image_flags, int shared_fd, BOOL removable )
+                                     SIZE_T header_size, ULONG image_flags, int shared_fd, BOOL removable,
+                                     struct reloc_cache_write **cache_write )
 {
     IMAGE_DOS_HEADER *dos;
     IMAGE_NT_HEADERS *nt;
@@ -2145,9 +2852,10 @@ static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filena
     IMAGE_SECTION_HEADER *sec;
     IMAGE_DATA_DIRECTORY *imports;
     NTSTATUS status = STATUS_CONFLICTING_ADDRESSES;
-    int i;
-    off_t pos;
+    int i, cache_fd = -1;
+    off_t pos, cache_offset = 0;
     struct stat st;
+    BOOL relocate;
     char *header_end, *header_start;
     char *ptr = view->base;
     SIZE_T total_size = view->size;
@@ -2204,6 +2912,22 @@ static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filena
     }
 
 
+    /* DLLs not loaded at their preferred base are relocated here, and the relocated pages
+     * are kept on disk so that other processes loading them at the same address can share them */
+
+    relocate = can_relocate_image( ptr, nt, sections, nt->FileHeader.NumberOfSections );
+    if (relocate && !removable && use_reloc_cache() &&
+        (cache_fd = open_reloc_cache( &st, ptr, total_size, &cache_offset )) != -1)
+    {
+        TRACE_(module)( "using cached relocated pages for %s\n", debugstr_w(filename) );
+        if (map_file_into_view( view, cache_fd, 0, ROUND_SIZE( 0, header_size ), cache_offset,
+                                VPROT_COMMITTED | VPROT_READ | VPROT_WRITECOPY, FALSE ) != STATUS_SUCCESS)
+        {
+            close( cache_fd );
+            return status;
+        }
+    }
+
     /* map all the sections */
 
     for (i = pos = 0; i < nt->FileHeader.NumberOfSections; i++, sec++)
@@ -2211,15 +2935,8 @@ static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filena
         static const SIZE_T sector_align = 0x1ff;
         SIZE_T map_size, file_start, file_size, end;
 
-        if (!sec->Misc.VirtualSize)
-            map_size = ROUND_SIZE( 0, sec->SizeOfRawData );
-        else
-            map_size = ROUND_SIZE( 0, sec->Misc.VirtualSize );
-
-        /* file positions are rounded to sector boundaries regardless of OptionalHeader.FileAlignment */
+        get_section_sizes( sec, &map_size, &file_size );
         file_start = sec->PointerToRawData & ~sector_align;
-        file_size = (sec->SizeOfRawData + (sec->PointerToRawData & sector_align) + sector_align) & ~sector_align;
-        if (file_size > map_size) file_size = map_size;
 
         /* a few sanity checks */
         end = sec->VirtualAddress + ROUND_SIZE( sec->VirtualAddress, map_size );
@@ -2227,6 +2944,7 @@ static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filena
         {
             WARN_(module)( "%s section %.8s too large (%x+%lx/%lx)\n",
                            debugstr_w(filename), sec->Name, sec->VirtualAddress, map_size, total_size );
+            if (cache_fd != -1) close( cache_fd );
             return status;
         }
 
@@ -2267,6 +2985,21 @@ static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filena
 
         if (!sec->PointerToRawData || !file_size) continue;
 
+        if (cache_fd != -1)
+        {
+            /* the cached pages are already relocated and zero-padded */
+            if (map_file_into_view( view, cache_fd, sec->VirtualAddress, get_file_backed_size( sec ),
+                                    cache_offset + sec->VirtualAddress,
+                                    VPROT_COMMITTED | VPROT_READ | VPROT_WRITECOPY, FALSE ) != STATUS_SUCCESS)
+            {
+                ERR_(module)( "Could not map %s section %.8s from the relocation cache\n",
+                              debugstr_w(filename), sec->Name );
+                close( cache_fd );
+                return status;
+            }
+            continue;
+        }
+
         /* Note: if the section is not aligned properly map_file_into_view will magically
          *       fall back to read(), so we don't need to check anything here.
          */
@@ -2294,6 +3027,21 @@ static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filena
         }
     }
 
+    if (cache_fd != -1) close( cache_fd );
+    else if (relocate && relocate_image( ptr, nt, total_size, header_size,
+                                         sections, nt->FileHeader.NumberOfSections ) &&
+             !removable && use_reloc_cache() &&
+             (*cache_write = malloc( offsetof( struct reloc_cache_write,
+                                               sections[nt->FileHeader.NumberOfSections] ))))
+    {
+        (*cache_write)->st          = st;
+        (*cache_write)->base        = ptr;
+        (*cache_write)->map_size    = total_size;
+        (*cache_write)->header_size = header_size;
+        (*cache_write)->nb_sections = nt->FileHeader.NumberOfSections;
+        memcpy( (*cache_write)->sections, sections, nt->FileHeader.NumberOfSections * sizeof(*sections) );
+    }
+
     /* set the image protections */
 
     set_vprot( view, ptr, ROUND_SIZE( 0, header_size ), VPROT_COMMITTED | VPROT_READ );
@@ -2391,6 +3139,7 @@ static NTSTATUS virtual_map_image( HANDLE mapping, ACCESS_MASK access, void **ad
     int unix_fd = -1, needs_close;
     int shared_fd = -1, shared_needs_close = 0;
     SIZE_T size = image_info->map_size;
+    struct reloc_cache_write *cache_write = NULL;
     struct file_view *view;
     NTSTATUS status;
     sigset_t sigset;
@@ -2419,7 +3168,7 @@ static NTSTATUS virtual_map_image( HANDLE mapping, ACCESS_MASK access, void **ad
     if (status) goto done;
 
     status = map_image_into_view( view, filename, unix_fd, base, image_info->header_size,
-                                  image_info->image_flags, shared_fd, needs_close );
+                                  image_info->image_flags, shared_fd, needs_close, &cache_write );
     if (status == STATUS_SUCCESS)
     {
         SERVER_START_REQ( map_view )
@@ -2445,6 +3194,12 @@ done:
     server_leave_uninterrupted_section( &virtual_mutex, &sigset );
     if (needs_close) close( unix_fd );
     if (shared_needs_close) close( shared_fd );
+    if (cache_write)
+    {
+        /* the view isn't known to the application yet, so its pages can still be read safely */
+        if (status >= 0) write_reloc_cache( cache_write );
+        free( cache_write );
+    }
     return status;
 }
 
@@ -2666,6 +3421,8 @@ void virtual_init(void)
     size = (char *)address_space_start - (char *)0x10000;
     if (size && mmap_is_in_reserved_area( (void*)0x10000, size ) == 1)
         anon_mmap_fixed( (void *)0x10000, size, PROT_READ | PROT_WRITE, 0 );
+
+    kernel_writewatch_init();
 }
 
 
@@ -3770,7 +4527,11 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG_PTR z
             else if (is_dos_memory) status = allocate_dos_memory( &view, vprot );
             else status = map_view( &view, base, size, type & MEM_TOP_DOWN, vprot, zero_bits );
 
-            if (status == STATUS_SUCCESS) base = view->base;
+            if (status == STATUS_SUCCESS)
+            {
+                if (vprot & VPROT_WRITEWATCH) kernel_writewatch_init_view( view );
+                base = view->base;
+            }
         }
     }
     else if (type & MEM_RESET)
@@ -4123,7 +4884,6 @@ static NTSTATUS get_basic_memory_info( HANDLE process, LPCVOID addr,
     else
     {
         BYTE vprot;
-        char *ptr;
         SIZE_T range_size = get_committed_size( view, base, &vprot );
 
         info->State = (vprot & VPROT_COMMITTED) ? MEM_COMMIT : MEM_RESERVE;
@@ -4132,9 +4892,7 @@ static NTSTATUS get_basic_memory_info( HANDLE process, LPCVOID addr,
         if (view->protect & SEC_IMAGE) info->Type = MEM_IMAGE;
         else if (view->protect & (SEC_FILE | SEC_RESERVE | SEC_COMMIT)) info->Type = MEM_MAPPED;
         else info->Type = MEM_PRIVATE;
-        for (ptr = base; ptr < base + range_size; ptr += page_size)
-            if ((get_page_vprot( ptr ) ^ vprot) & ~VPROT_WRITEWATCH) break;
-        info->RegionSize = ptr - base;
+        info->RegionSize = get_vprot_range_size( base, range_size, ~VPROT_WRITEWATCH, &vprot );
     }
     server_leave_uninterrupted_section( &virtual_mutex, &sigset );
 
@@ -4644,12 +5402,17 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
         char *addr = base;
         char *end = addr + size;
 
-        while (pos < *count && addr < end)
+        if (is_kernel_write_watch_range( base, size ))
+            pos = kernel_get_write_watches( base, size, addresses, *count, flags & WRITE_WATCH_FLAG_RESET );
+        else
         {
-            if (!(get_page_vprot( addr ) & VPROT_WRITEWATCH)) addresses[pos++] = addr;
-            addr += page_size;
+            while (pos < *count && addr < end)
+            {
+                if (!(get_page_vprot( addr ) & VPROT_WRITEWATCH)) addresses[pos++] = addr;
+                addr += page_size;
+            }
+            if (flags & WRITE_WATCH_FLAG_RESET) reset_write_watches( base, addr - (char *)base );
         }
-        if (flags & WRITE_WATCH_FLAG_RESET) reset_write_watches( base, addr - (char *)base );
         *count = pos;
         *granularity = page_size;
     }
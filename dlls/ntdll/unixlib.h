@@ -26,7 +26,7 @@
 struct _DISPATCHER_CONTEXT;
 
 /* increment this when you change the function table */
-#define NTDLL_UNIXLIB_VERSION 123
+#define NTDLL_UNIXLIB_VERSION 125
 
 struct unix_funcs
 {
@@ -57,6 +57,11 @@ struct unix_funcs
     NTSTATUS      (CDECL *fast_wait_cv)( RTL_CONDITION_VARIABLE *variable, const void *value,
                                          const LARGE_INTEGER *timeout );
 
+    /* wait completions */
+    NTSTATUS      (CDECL *create_wait_completion)( HANDLE port, HANDLE handle, ULONG_PTR key,
+                                                   ULONG_PTR value, HANDLE *wait );
+    NTSTATUS      (CDECL *cancel_wait_completion)( HANDLE wait, BOOLEAN *signaled );
+
     /* math functions */
     double        (CDECL *atan)( double d );
     double        (CDECL *ceil)( double d );
@@ -78,6 +83,7 @@ struct unix_funcs
     NTSTATUS      (CDECL *init_unix_lib)( void *module, DWORD reason, const void *ptr_in, void *ptr_out );
     NTSTATUS      (CDECL *unwind_builtin_dll)( ULONG type, struct _DISPATCHER_CONTEXT *dispatch,
                                                CONTEXT *context );
+    void          (CDECL *prefetch_dlls)( void *module, const WCHAR *load_path );
 };
 
 #endif /* __NTDLL_UNIXLIB_H */
@@ -28,6 +28,7 @@ typedef unsigned __int64 mem_size_t;
 typedef unsigned __int64 file_pos_t;
 typedef unsigned __int64 client_ptr_t;
 typedef unsigned __int64 affinity_t;
+typedef unsigned __int64 object_id_t;
 typedef client_ptr_t mod_handle_t;
 
 struct request_header
@@ -455,6 +456,44 @@ typedef union
     } keyed_event;
 } select_op_t;
 
+
+struct inproc_sync
+{
+    unsigned int    state;
+    unsigned int    type;
+    unsigned int    max;
+    unsigned int    __pad;
+};
+enum inproc_sync_type
+{
+    INPROC_SYNC_NONE,
+    INPROC_SYNC_AUTO_EVENT,
+    INPROC_SYNC_MANUAL_EVENT,
+    INPROC_SYNC_SEMAPHORE
+};
+#define INPROC_SYNC_MAX_SLOTS    65536
+
+
+
+#define REGISTRY_GENERATION_SLOTS 16384
+
+
+
+#define HANDLE_GENERATION_SLOTS 4096
+
+
+struct shared_request_buffer
+{
+    int          state;
+    int          __pad[15];
+    char         header[64];
+
+};
+#define SHARED_REQUEST_IDLE     0
+#define SHARED_REQUEST_PENDING  1
+#define SHARED_REQUEST_DONE     2
+#define SHARED_REQUEST_CLOSED   3
+
 enum apc_type
 {
     APC_NONE,
@@ -960,6 +999,20 @@ struct init_thread_reply
 
 
 
+struct set_shared_request_buffer_request
+{
+    struct request_header __header;
+    int          buffer_fd;
+    int          doorbell_fd;
+    data_size_t  size;
+};
+struct set_shared_request_buffer_reply
+{
+    struct reply_header __header;
+};
+
+
+
 struct terminate_process_request
 {
     struct request_header __header;
@@ -1334,7 +1387,9 @@ struct create_event_reply
 {
     struct reply_header __header;
     obj_handle_t handle;
-    char __pad_12[4];
+    unsigned int inproc_sync;
+    unsigned int access;
+    char __pad_20[4];
 };
 
 
@@ -1378,7 +1433,9 @@ struct open_event_reply
 {
     struct reply_header __header;
     obj_handle_t handle;
-    char __pad_12[4];
+    unsigned int inproc_sync;
+    unsigned int access;
+    char __pad_20[4];
 };
 
 
@@ -1490,7 +1547,9 @@ struct create_semaphore_reply
 {
     struct reply_header __header;
     obj_handle_t handle;
-    char __pad_12[4];
+    unsigned int inproc_sync;
+    unsigned int access;
+    char __pad_20[4];
 };
 
 
@@ -1534,7 +1593,9 @@ struct open_semaphore_reply
 {
     struct reply_header __header;
     obj_handle_t handle;
-    char __pad_12[4];
+    unsigned int inproc_sync;
+    unsigned int access;
+    char __pad_20[4];
 };
 
 
@@ -1653,6 +1714,36 @@ struct get_directory_cache_entry_reply
 
 
 
+struct get_directory_snapshot_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct get_directory_snapshot_reply
+{
+    struct reply_header __header;
+    data_size_t  total;
+    /* VARARG(data,bytes); */
+    char __pad_12[4];
+};
+
+
+
+struct set_directory_snapshot_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+    timeout_t    mtime;
+    timeout_t    ctime;
+    /* VARARG(data,bytes); */
+};
+struct set_directory_snapshot_reply
+{
+    struct reply_header __header;
+};
+
+
+
 struct flush_request
 {
     struct request_header __header;
@@ -2202,6 +2293,9 @@ struct create_key_reply
     struct reply_header __header;
     obj_handle_t hkey;
     int          created;
+    object_id_t  key_id;
+    unsigned int access;
+    char __pad_28[4];
 };
 
 
@@ -2217,7 +2311,8 @@ struct open_key_reply
 {
     struct reply_header __header;
     obj_handle_t hkey;
-    char __pad_12[4];
+    unsigned int access;
+    object_id_t  key_id;
 };
 
 
@@ -2265,6 +2360,8 @@ struct enum_key_reply
     timeout_t    modif;
     data_size_t  total;
     data_size_t  namelen;
+    unsigned int gen_slot;
+    unsigned int generation;
     /* VARARG(name,unicode_str,namelen); */
     /* VARARG(class,unicode_str); */
 };
@@ -2298,6 +2395,8 @@ struct get_key_value_reply
     struct reply_header __header;
     int          type;
     data_size_t  total;
+    unsigned int gen_slot;
+    unsigned int generation;
     /* VARARG(data,bytes); */
 };
 
@@ -5066,6 +5165,38 @@ struct set_fd_completion_mode_reply
 
 
 
+struct create_wait_completion_request
+{
+    struct request_header __header;
+    obj_handle_t  port;
+    obj_handle_t  handle;
+    char __pad_20[4];
+    apc_param_t   ckey;
+    apc_param_t   cvalue;
+};
+struct create_wait_completion_reply
+{
+    struct reply_header __header;
+    obj_handle_t  wait;
+    char __pad_12[4];
+};
+
+
+
+struct cancel_wait_completion_request
+{
+    struct request_header __header;
+    obj_handle_t  wait;
+};
+struct cancel_wait_completion_reply
+{
+    struct reply_header __header;
+    int           signaled;
+    char __pad_12[4];
+};
+
+
+
 struct set_fd_disp_info_request
 {
     struct request_header __header;
@@ -5401,6 +5532,22 @@ struct get_next_thread_reply
 };
 
 
+
+struct batch_request
+{
+    struct request_header __header;
+    /* VARARG(requests,bytes); */
+    char __pad_12[4];
+};
+struct batch_reply
+{
+    struct reply_header __header;
+    unsigned int count;
+    /* VARARG(replies,bytes); */
+    char __pad_12[4];
+};
+
+
 enum request
 {
     REQ_new_process,
@@ -5410,6 +5557,7 @@ enum request
     REQ_init_process_done,
     REQ_init_first_thread,
     REQ_init_thread,
+    REQ_set_shared_request_buffer,
     REQ_terminate_process,
     REQ_terminate_thread,
     REQ_get_process_info,
@@ -5451,6 +5599,8 @@ enum request
     REQ_get_handle_unix_name,
     REQ_get_handle_fd,
     REQ_get_directory_cache_entry,
+    REQ_get_directory_snapshot,
+    REQ_set_directory_snapshot,
     REQ_flush,
     REQ_get_file_info,
     REQ_get_volume_info,
@@ -5654,6 +5804,8 @@ enum request
     REQ_set_completion_info,
     REQ_add_fd_completion,
     REQ_set_fd_completion_mode,
+    REQ_create_wait_completion,
+    REQ_cancel_wait_completion,
     REQ_set_fd_disp_info,
     REQ_set_fd_name_info,
     REQ_get_window_layered_info,
@@ -5676,6 +5828,7 @@ enum request
     REQ_suspend_process,
     REQ_resume_process,
     REQ_get_next_thread,
+    REQ_batch,
     REQ_NB_REQUESTS
 };
 
@@ -5690,6 +5843,7 @@ union generic_request
     struct init_process_done_request init_process_done_request;
     struct init_first_thread_request init_first_thread_request;
     struct init_thread_request init_thread_request;
+    struct set_shared_request_buffer_request set_shared_request_buffer_request;
     struct terminate_process_request terminate_process_request;
     struct terminate_thread_request terminate_thread_request;
     struct get_process_info_request get_process_info_request;
@@ -5731,6 +5885,8 @@ union generic_request
     struct get_handle_unix_name_request get_handle_unix_name_request;
     struct get_handle_fd_request get_handle_fd_request;
     struct get_directory_cache_entry_request get_directory_cache_entry_request;
+    struct get_directory_snapshot_request get_directory_snapshot_request;
+    struct set_directory_snapshot_request set_directory_snapshot_request;
     struct flush_request flush_request;
     struct get_file_info_request get_file_info_request;
     struct get_volume_info_request get_volume_info_request;
@@ -5934,6 +6090,8 @@ union generic_request
     struct set_completion_info_request set_completion_info_request;
     struct add_fd_completion_request add_fd_completion_request;
     struct set_fd_completion_mode_request set_fd_completion_mode_request;
+    struct create_wait_completion_request create_wait_completion_request;
+    struct cancel_wait_completion_request cancel_wait_completion_request;
     struct set_fd_disp_info_request set_fd_disp_info_request;
     struct set_fd_name_info_request set_fd_name_info_request;
     struct get_window_layered_info_request get_window_layered_info_request;
@@ -5956,6 +6114,7 @@ union generic_request
     struct suspend_process_request suspend_process_request;
     struct resume_process_request resume_process_request;
     struct get_next_thread_request get_next_thread_request;
+    struct batch_request batch_request;
 };
 union generic_reply
 {
@@ -5968,6 +6127,7 @@ union generic_reply
     struct init_process_done_reply init_process_done_reply;
     struct init_first_thread_reply init_first_thread_reply;
     struct init_thread_reply init_thread_reply;
+    struct set_shared_request_buffer_reply set_shared_request_buffer_reply;
     struct terminate_process_reply terminate_process_reply;
     struct terminate_thread_reply terminate_thread_reply;
     struct get_process_info_reply get_process_info_reply;
@@ -6009,6 +6169,8 @@ union generic_reply
     struct get_handle_unix_name_reply get_handle_unix_name_reply;
     struct get_handle_fd_reply get_handle_fd_reply;
     struct get_directory_cache_entry_reply get_directory_cache_entry_reply;
+    struct get_directory_snapshot_reply get_directory_snapshot_reply;
+    struct set_directory_snapshot_reply set_directory_snapshot_reply;
     struct flush_reply flush_reply;
     struct get_file_info_reply get_file_info_reply;
     struct get_volume_info_reply get_volume_info_reply;
@@ -6212,6 +6374,8 @@ union generic_reply
     struct set_completion_info_reply set_completion_info_reply;
     struct add_fd_completion_reply add_fd_completion_reply;
     struct set_fd_completion_mode_reply set_fd_completion_mode_reply;
+    struct create_wait_completion_reply create_wait_completion_reply;
+    struct cancel_wait_completion_reply cancel_wait_completion_reply;
     struct set_fd_disp_info_reply set_fd_disp_info_reply;
     struct set_fd_name_info_reply set_fd_name_info_reply;
     struct get_window_layered_info_reply get_window_layered_info_reply;
@@ -6234,11 +6398,12 @@ union generic_reply
     struct suspend_process_reply suspend_process_reply;
     struct resume_process_reply resume_process_reply;
     struct get_next_thread_reply get_next_thread_reply;
+    struct batch_reply batch_reply;
 };
 
 /* ### protocol_version begin ### */
 
-#define SERVER_PROTOCOL_VERSION 715
+#define SERVER_PROTOCOL_VERSION 723
 
 /* ### protocol_version end ### */
 
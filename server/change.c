@@ -51,6 +51,27 @@
 #include "security.h"
 #include "winternl.h"
 
+/* snapshots of directory contents, shared by all the client processes; */
+/* the data format is private to the clients */
+struct dir_snapshot
+{
+    struct list   entry;     /* entry in the snapshots list, most recently used first */
+    dev_t         dev;       /* directory device */
+    ino_t         ino;       /* directory inode */
+    timeout_t     mtime;     /* directory modification time when the snapshot was taken */
+    timeout_t     ctime;     /* directory change time when the snapshot was taken */
+    data_size_t   size;      /* size of the snapshot data */
+    void         *data;      /* snapshot data */
+};
+
+#define MAX_DIR_SNAPSHOTS           256
+#define MAX_DIR_SNAPSHOT_SIZE       (4 * 1024 * 1024)   /* max size of a single snapshot */
+#define MAX_DIR_SNAPSHOT_TOTAL_SIZE (32 * 1024 * 1024)  /* max size of all the snapshots */
+
+static struct list dir_snapshots = LIST_INIT( dir_snapshots );
+static unsigned int dir_snapshot_count;
+static data_size_t dir_snapshot_total_size;
+
 /* dnotify support */
 
 #ifdef linux
@@ -260,6 +281,53 @@ static void dnotify_adjust_changes( struct dir *dir )
 #endif
 }
 
+/* get the directory times in the format used by the clients */
+static void get_dir_times( const struct stat *st, timeout_t *mtime, timeout_t *ctime )
+{
+    static const timeout_t ticks_1601_to_1970 = (timeout_t)86400 * (369 * 365 + 89) * TICKS_PER_SEC;
+
+    *mtime = (timeout_t)st->st_mtime * TICKS_PER_SEC + ticks_1601_to_1970;
+    *ctime = (timeout_t)st->st_ctime * TICKS_PER_SEC + ticks_1601_to_1970;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    *mtime += st->st_mtim.tv_nsec / 100;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    *mtime += st->st_mtimespec.tv_nsec / 100;
+#endif
+#ifdef HAVE_STRUCT_STAT_ST_CTIM
+    *ctime += st->st_ctim.tv_nsec / 100;
+#elif defined(HAVE_STRUCT_STAT_ST_CTIMESPEC)
+    *ctime += st->st_ctimespec.tv_nsec / 100;
+#endif
+}
+
+/* remove a snapshot from the list and free it */
+static void free_dir_snapshot( struct dir_snapshot *snapshot )
+{
+    list_remove( &snapshot->entry );
+    dir_snapshot_count--;
+    dir_snapshot_total_size -= snapshot->size;
+    free( snapshot->data );
+    free( snapshot );
+}
+
+/* find the snapshot of a directory from its device and inode */
+static struct dir_snapshot *find_dir_snapshot( dev_t dev, ino_t ino )
+{
+    struct dir_snapshot *snapshot;
+
+    LIST_FOR_EACH_ENTRY( snapshot, &dir_snapshots, struct dir_snapshot, entry )
+        if (snapshot->dev == dev && snapshot->ino == ino) return snapshot;
+    return NULL;
+}
+
+/* discard the snapshot of a directory whose contents changed */
+static void invalidate_dir_snapshot( dev_t dev, ino_t ino )
+{
+    struct dir_snapshot *snapshot = find_dir_snapshot( dev, ino );
+
+    if (snapshot) free_dir_snapshot( snapshot );
+}
+
 /* insert change in the global list */
 static inline void insert_change( struct dir *dir )
 {
@@ -832,6 +900,8 @@ static void inotify_notify_all( struct inotify_event *ie )
     }
 
     filter = filter_from_event( ie );
+    if (ie->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))
+        invalidate_dir_snapshot( inode->dev, inode->ino );
     
     if (ie->mask & IN_CREATE)
     {
@@ -1288,3 +1358,81 @@ DECL_HANDLER(read_change)
         free( record );
     }
 }
+
+/* retrieve the shared snapshot of a directory */
+DECL_HANDLER(get_directory_snapshot)
+{
+    struct dir_snapshot *snapshot;
+    timeout_t mtime, ctime;
+    struct stat st;
+    struct dir *dir;
+
+    if (!(dir = get_dir_obj( current->process, req->handle, 0 ))) return;
+
+    if (fstat( get_dir_unix_fd( dir ), &st ) == -1) file_set_error();
+    else if (!(snapshot = find_dir_snapshot( st.st_dev, st.st_ino ))) set_error( STATUS_NOT_FOUND );
+    else
+    {
+        get_dir_times( &st, &mtime, &ctime );
+        if (snapshot->mtime != mtime || snapshot->ctime != ctime)
+        {
+            free_dir_snapshot( snapshot );
+            set_error( STATUS_NOT_FOUND );
+        }
+        else
+        {
+            list_remove( &snapshot->entry );
+            list_add_head( &dir_snapshots, &snapshot->entry );
+            reply->total = snapshot->size;
+            if (snapshot->size > get_reply_max_size()) set_error( STATUS_BUFFER_TOO_SMALL );
+            else set_reply_data( snapshot->data, snapshot->size );
+        }
+    }
+    release_object( dir );
+}
+
+/* store the snapshot of a directory */
+DECL_HANDLER(set_directory_snapshot)
+{
+    struct dir_snapshot *snapshot;
+    timeout_t mtime, ctime;
+    struct stat st;
+    struct dir *dir;
+
+    if (!(dir = get_dir_obj( current->process, req->handle, 0 ))) return;
+
+    if (fstat( get_dir_unix_fd( dir ), &st ) == -1)
+    {
+        file_set_error();
+        goto done;
+    }
+    get_dir_times( &st, &mtime, &ctime );
+
+    /* ignore the data if the directory changed while the client was reading it, */
+    /* or if it was changed too recently for a further change to be noticed */
+    if (req->mtime != mtime || req->ctime != ctime) goto done;
+    if (mtime > current_time - TICKS_PER_SEC || ctime > current_time - TICKS_PER_SEC) goto done;
+    if (!get_req_data_size() || get_req_data_size() > MAX_DIR_SNAPSHOT_SIZE) goto done;
+
+    invalidate_dir_snapshot( st.st_dev, st.st_ino );
+    if (!(snapshot = mem_alloc( sizeof(*snapshot) ))) goto done;
+    if (!(snapshot->data = memdup( get_req_data(), get_req_data_size() )))
+    {
+        free( snapshot );
+        goto done;
+    }
+    snapshot->dev   = st.st_dev;
+    snapshot->ino   = st.st_ino;
+    snapshot->mtime = mtime;
+    snapshot->ctime = ctime;
+    snapshot->size  = get_req_data_size();
+    list_add_head( &dir_snapshots, &snapshot->entry );
+    dir_snapshot_count++;
+    dir_snapshot_total_size += snapshot->size;
+
+    while (dir_snapshot_count > MAX_DIR_SNAPSHOTS || dir_snapshot_total_size > MAX_DIR_SNAPSHOT_TOTAL_SIZE)
+        free_dir_snapshot( LIST_ENTRY( list_tail( &dir_snapshots ), struct dir_snapshot, entry ));
+
+done:
+    release_object( dir );
+}
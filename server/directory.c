@@ -439,7 +439,15 @@ void init_directories( struct fd *intl_fd )
     static const WCHAR intlW[] = {'N','l','s','S','e','c','t','i','o','n','L','A','N','G','_','I','N','T','L'};
     static const WCHAR user_dataW[] = {'_','_','w','i','n','e','_','u','s','e','r','_','s','h','a','r','e','d','_','d','a','t','a'};
     static const struct unicode_str intl_str = {intlW, sizeof(intlW)};
+    static const WCHAR inproc_syncW[] = {'_','_','w','i','n','e','_','i','n','p','r','o','c','_','s','y','n','c'};
     static const struct unicode_str user_data_str = {user_dataW, sizeof(user_dataW)};
+    static const struct unicode_str inproc_sync_str = {inproc_syncW, sizeof(inproc_syncW)};
+    static const WCHAR registry_genW[] = {'_','_','w','i','n','e','_','r','e','g','i','s','t','r','y','_',
+                                          'g','e','n','e','r','a','t','i','o','n','s'};
+    static const struct unicode_str registry_gen_str = {registry_genW, sizeof(registry_genW)};
+    static const WCHAR handle_genW[] = {'_','_','w','i','n','e','_','h','a','n','d','l','e','_',
+                                        'g','e','n','e','r','a','t','i','o','n','s'};
+    static const struct unicode_str handle_gen_str = {handle_genW, sizeof(handle_genW)};
 
     struct directory *dir_driver, *dir_device, *dir_global, *dir_kernel, *dir_nls;
     struct object *named_pipe_device, *mailslot_device, *null_device;
@@ -479,6 +487,10 @@ void init_directories( struct fd *intl_fd )
     release_object( create_symlink( &dir_global->obj, &link_conout_str, OBJ_PERMANENT, &link_currentout_str, NULL ));
     release_object( create_symlink( &dir_global->obj, &link_con_str, OBJ_PERMANENT, &link_console_str, NULL ));
 
+    /* in-process synchronization, needs to be set up before any event is created */
+    if (is_inproc_sync_enabled())
+        release_object( create_inproc_sync_mapping( &dir_kernel->obj, &inproc_sync_str, OBJ_PERMANENT, NULL ));
+
     /* events */
     for (i = 0; i < ARRAY_SIZE( kernel_events ); i++)
         release_object( create_event( &dir_kernel->obj, &kernel_events[i], OBJ_PERMANENT, 1, 0, NULL ));
@@ -487,6 +499,8 @@ void init_directories( struct fd *intl_fd )
     /* mappings */
     release_object( create_fd_mapping( &dir_nls->obj, &intl_str, intl_fd, OBJ_PERMANENT, NULL ));
     release_object( create_user_data_mapping( &dir_kernel->obj, &user_data_str, OBJ_PERMANENT, NULL ));
+    release_object( create_registry_generation_mapping( &dir_kernel->obj, &registry_gen_str, OBJ_PERMANENT, NULL ));
+    release_object( create_handle_generation_mapping( &dir_kernel->obj, &handle_gen_str, OBJ_PERMANENT, NULL ));
     release_object( intl_fd );
 
     release_object( named_pipe_device );
@@ -56,6 +56,7 @@ struct event
     struct list    kernel_object;   /* list of kernel object pointers */
     int            manual_reset;    /* is it a manual reset event? */
     int            signaled;        /* event has been signaled */
+    unsigned int   inproc_sync;     /* in-process sync slot publishing the signaled state */
 };
 
 static void event_dump( struct object *obj, int verbose );
@@ -63,6 +64,7 @@ static int event_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void event_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static int event_signal( struct object *obj, unsigned int access);
 static struct list *event_get_kernel_obj_list( struct object *obj );
+static void event_destroy( struct object *obj );
 
 static const struct object_ops event_ops =
 {
@@ -85,7 +87,7 @@ static const struct object_ops event_ops =
     no_open_file,              /* open_file */
     event_get_kernel_obj_list, /* get_kernel_obj_list */
     no_close_handle,           /* close_handle */
-    no_destroy                 /* destroy */
+    event_destroy              /* destroy */
 };
 
 
@@ -150,6 +152,8 @@ struct event *create_event( struct object *root, const struct unicode_str *name,
             list_init( &event->kernel_object );
             event->manual_reset = manual_reset;
             event->signaled     = initial_state;
+            event->inproc_sync  = alloc_inproc_sync( manual_reset ? INPROC_SYNC_MANUAL_EVENT : INPROC_SYNC_AUTO_EVENT,
+                                                     !!initial_state, 1 );
         }
     }
     return event;
@@ -160,24 +164,30 @@ struct event *get_event_obj( struct process *process, obj_handle_t handle, unsig
     return (struct event *)get_handle_obj( process, handle, access, &event_ops );
 }
 
+static void set_event_state( struct event *event, int signaled )
+{
+    event->signaled = signaled;
+    set_inproc_sync_state( event->inproc_sync, signaled );
+}
+
 static void pulse_event( struct event *event )
 {
-    event->signaled = 1;
+    set_event_state( event, 1 );
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
-    event->signaled = 0;
+    set_event_state( event, 0 );
 }
 
 void set_event( struct event *event )
 {
-    event->signaled = 1;
+    set_event_state( event, 1 );
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
 }
 
 void reset_event( struct event *event )
 {
-    event->signaled = 0;
+    set_event_state( event, 0 );
 }
 
 static void event_dump( struct object *obj, int verbose )
@@ -200,7 +210,7 @@ static void event_satisfied( struct object *obj, struct wait_queue_entry *entry
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
     /* Reset if it's an auto-reset event */
-    if (!event->manual_reset) event->signaled = 0;
+    if (!event->manual_reset) set_event_state( event, 0 );
 }
 
 static int event_signal( struct object *obj, unsigned int access )
@@ -223,6 +233,13 @@ static struct list *event_get_kernel_obj_list( struct object *obj )
     return &event->kernel_object;
 }
 
+static void event_destroy( struct object *obj )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    free_inproc_sync( event->inproc_sync );
+}
+
 struct keyed_event *create_keyed_event( struct object *root, const struct unicode_str *name,
                                         unsigned int attr, const struct security_descriptor *sd )
 {
@@ -295,6 +312,11 @@ DECL_HANDLER(create_event)
         else
             reply->handle = alloc_handle_no_access_check( current->process, event,
                                                           req->access, objattr->attributes );
+        if (reply->handle && event->inproc_sync)
+        {
+            reply->inproc_sync = event->inproc_sync;
+            reply->access = get_handle_access( current->process, reply->handle );
+        }
         release_object( event );
     }
 
@@ -305,9 +327,16 @@ DECL_HANDLER(create_event)
 DECL_HANDLER(open_event)
 {
     struct unicode_str name = get_req_unicode_str();
+    struct event *event;
 
     reply->handle = open_object( current->process, req->rootdir, req->access,
                                  &event_ops, &name, req->attributes );
+    if (reply->handle && (event = get_event_obj( current->process, reply->handle, 0 )))
+    {
+        reply->inproc_sync = event->inproc_sync;
+        reply->access = get_handle_access( current->process, reply->handle );
+        release_object( event );
+    }
 }
 
 /* do an event operation */
@@ -179,6 +179,12 @@ extern struct mapping *create_fd_mapping( struct object *root, const struct unic
                                           unsigned int attr, const struct security_descriptor *sd );
 extern struct object *create_user_data_mapping( struct object *root, const struct unicode_str *name,
                                                 unsigned int attr, const struct security_descriptor *sd );
+extern struct object *create_inproc_sync_mapping( struct object *root, const struct unicode_str *name,
+                                                  unsigned int attr, const struct security_descriptor *sd );
+extern struct object *create_registry_generation_mapping( struct object *root, const struct unicode_str *name,
+                                                          unsigned int attr, const struct security_descriptor *sd );
+extern struct object *create_handle_generation_mapping( struct object *root, const struct unicode_str *name,
+                                                        unsigned int attr, const struct security_descriptor *sd );
 
 /* device functions */
 
@@ -42,30 +42,38 @@
 struct handle_entry
 {
     struct object *ptr;       /* object */
-    unsigned int   access;    /* access rights */
+    unsigned int   access;    /* access rights, or index of the next free entry if ptr is NULL */
 };
 
+/* The entries are stored in fixed-size pages that never move once allocated, */
+/* so growing the table only reallocates the page directory. */
 struct handle_table
 {
-    struct object        obj;         /* object header */
-    struct process      *process;     /* process owning this table */
-    int                  count;       /* number of allocated entries */
-    int                  last;        /* last used entry */
-    int                  free;        /* first entry that may be free */
-    struct handle_entry *entries;     /* handle entries */
+    struct object         obj;         /* object header */
+    struct process       *process;     /* process owning this table */
+    int                   count;       /* number of allocated entries */
+    int                   last;        /* last used entry */
+    int                   free;        /* first entry of the free list, or -1 */
+    int                   dir_size;    /* size of the page directory */
+    struct handle_entry **pages;       /* page directory */
 };
 
 static struct handle_table *global_table;
 
+unsigned int *handle_generations;   /* table of per-process generations shared with the clients */
+
 /* reserved handle access rights */
 #define RESERVED_SHIFT         26
 #define RESERVED_INHERIT       (HANDLE_FLAG_INHERIT << RESERVED_SHIFT)
 #define RESERVED_CLOSE_PROTECT (HANDLE_FLAG_PROTECT_FROM_CLOSE << RESERVED_SHIFT)
 #define RESERVED_ALL           (RESERVED_INHERIT | RESERVED_CLOSE_PROTECT)
 
-#define MIN_HANDLE_ENTRIES  32
 #define MAX_HANDLE_ENTRIES  0x00ffffff
 
+#define HANDLE_PAGE_SHIFT   8
+#define HANDLE_PAGE_ENTRIES (1 << HANDLE_PAGE_SHIFT)
+#define HANDLE_PAGE_MASK    (HANDLE_PAGE_ENTRIES - 1)
+
 
 /* handle to table index conversion */
 
@@ -79,6 +87,12 @@ static inline int handle_to_index( obj_handle_t handle )
     return (handle >> 2) - 1;
 }
 
+/* return the entry for a given index, which must be below the table count */
+static inline struct handle_entry *get_entry( struct handle_table *table, int index )
+{
+    return table->pages[index >> HANDLE_PAGE_SHIFT] + (index & HANDLE_PAGE_MASK);
+}
+
 /* global handle conversion */
 
 #define HANDLE_OBFUSCATOR 0x544a4def
@@ -154,9 +168,9 @@ static void handle_table_dump( struct object *obj, int verbose )
     fprintf( stderr, "Handle table last=%d count=%d process=%p\n",
              table->last, table->count, table->process );
     if (!verbose) return;
-    entry = table->entries;
-    for (i = 0; i <= table->last; i++, entry++)
+    for (i = 0; i <= table->last; i++)
     {
+        entry = get_entry( table, i );
         if (!entry->ptr) continue;
         fprintf( stderr, "    %04x: %p %08x ",
                  index_to_handle(i), entry->ptr, entry->access );
@@ -177,20 +191,23 @@ static void handle_table_destroy( struct object *obj )
     /* first notify all objects that handles are being closed */
     if (table->process)
     {
-        for (i = 0, entry = table->entries; i <= table->last; i++, entry++)
+        for (i = 0; i <= table->last; i++)
         {
-            struct object *obj = entry->ptr;
+            struct object *obj = get_entry( table, i )->ptr;
             if (obj) obj->ops->close_handle( obj, table->process, index_to_handle(i) );
         }
     }
 
-    for (i = 0, entry = table->entries; i <= table->last; i++, entry++)
+    for (i = 0; i <= table->last; i++)
     {
-        struct object *obj = entry->ptr;
+        struct object *obj;
+        entry = get_entry( table, i );
+        obj = entry->ptr;
         entry->ptr = NULL;
         if (obj) release_object_from_handle( obj );
     }
-    free( table->entries );
+    for (i = 0; i < table->count >> HANDLE_PAGE_SHIFT; i++) free( table->pages[i] );
+    free( table->pages );
 }
 
 /* close all the process handles and free the handle table */
@@ -202,60 +219,110 @@ void close_process_handles( struct process *process )
     if (table) release_object( table );
 }
 
+/* grow a handle table until it contains a given index */
+static int grow_handle_table( struct handle_table *table, int index )
+{
+    struct handle_entry *page;
+
+    if (index >= MAX_HANDLE_ENTRIES)
+    {
+        set_error( STATUS_INSUFFICIENT_RESOURCES );
+        return 0;
+    }
+    while (index >= table->count)
+    {
+        int nb_pages = table->count >> HANDLE_PAGE_SHIFT;
+
+        if (nb_pages == table->dir_size)
+        {
+            int size = max( table->dir_size * 2, 8 );
+            struct handle_entry **new_pages = realloc( table->pages, size * sizeof(*new_pages) );
+
+            if (!new_pages)
+            {
+                set_error( STATUS_INSUFFICIENT_RESOURCES );
+                return 0;
+            }
+            table->pages    = new_pages;
+            table->dir_size = size;
+        }
+        if (!(page = calloc( HANDLE_PAGE_ENTRIES, sizeof(*page) )))
+        {
+            set_error( STATUS_INSUFFICIENT_RESOURCES );
+            return 0;
+        }
+        table->pages[nb_pages] = page;
+        table->count += HANDLE_PAGE_ENTRIES;
+    }
+    return 1;
+}
+
 /* allocate a new handle table */
 struct handle_table *alloc_handle_table( struct process *process, int count )
 {
     struct handle_table *table;
 
-    if (count < MIN_HANDLE_ENTRIES) count = MIN_HANDLE_ENTRIES;
     if (!(table = alloc_object( &handle_table_ops )))
         return NULL;
-    table->process = process;
-    table->count   = count;
-    table->last    = -1;
-    table->free    = 0;
-    if ((table->entries = mem_alloc( count * sizeof(*table->entries) ))) return table;
+    table->process  = process;
+    table->count    = 0;
+    table->last     = -1;
+    table->free     = -1;
+    table->dir_size = 0;
+    table->pages    = NULL;
+    if (grow_handle_table( table, max( count, 1 ) - 1 )) return table;
     release_object( table );
     return NULL;
 }
 
-/* grow a handle table */
-static int grow_handle_table( struct handle_table *table )
+/* rebuild the free list, and trim the unused entries at the end of the table */
+static void reset_free_list( struct handle_table *table )
 {
-    struct handle_entry *new_entries;
-    int count = min( table->count * 2, MAX_HANDLE_ENTRIES );
+    struct handle_entry *entry;
+    int i;
 
-    if (count == table->count ||
-        !(new_entries = realloc( table->entries, count * sizeof(struct handle_entry) )))
+    while (table->last >= 0 && !get_entry( table, table->last )->ptr) table->last--;
+    table->free = -1;
+    for (i = table->last; i >= 0; i--)
     {
-        set_error( STATUS_INSUFFICIENT_RESOURCES );
-        return 0;
+        entry = get_entry( table, i );
+        if (entry->ptr) continue;
+        entry->access = table->free;
+        table->free = i;
     }
-    table->entries = new_entries;
-    table->count   = count;
-    return 1;
 }
 
-/* allocate the first free entry in the handle table */
+/* allocate a free entry in the handle table */
 static obj_handle_t alloc_entry( struct handle_table *table, void *obj, unsigned int access )
 {
-    struct handle_entry *entry = table->entries + table->free;
+    struct handle_entry *entry;
     int i;
 
-    for (i = table->free; i <= table->last; i++, entry++) if (!entry->ptr) goto found;
-    if (i >= table->count)
+    if ((i = table->free) != -1)
     {
-        if (!grow_handle_table( table )) return 0;
-        entry = table->entries + i;  /* the entries may have moved */
+        entry = get_entry( table, i );
+        table->free = entry->access;
+    }
+    else
+    {
+        i = table->last + 1;
+        if (i >= table->count && !grow_handle_table( table, i )) return 0;
+        entry = get_entry( table, i );
+        table->last = i;
     }
-    table->last = i;
- found:
-    table->free = i + 1;
     entry->ptr    = grab_object_for_handle( obj );
     entry->access = access;
     return index_to_handle(i);
 }
 
+/* put an entry back on the free list */
+static void free_entry( struct handle_table *table, struct handle_entry *entry, int index )
+{
+    entry->ptr    = NULL;
+    entry->access = table->free;
+    table->free   = index;
+}
+
 /* allocate a handle for an object, incrementing its refcount */
 static obj_handle_t alloc_handle_entry( struct process *process, void *ptr,
                                         unsigned int access, unsigned int attr )
@@ -331,45 +398,23 @@ static struct handle_entry *get_handle( struct process *process, obj_handle_t ha
     index = handle_to_index( handle );
     if (index < 0) return NULL;
     if (index > table->last) return NULL;
-    entry = table->entries + index;
+    entry = get_entry( table, index );
     if (!entry->ptr) return NULL;
     return entry;
 }
 
-/* attempt to shrink a table */
-static void shrink_handle_table( struct handle_table *table )
-{
-    struct handle_entry *entry = table->entries + table->last;
-    struct handle_entry *new_entries;
-    int count = table->count;
-
-    while (table->last >= 0)
-    {
-        if (entry->ptr) break;
-        table->last--;
-        entry--;
-    }
-    if (table->last >= count / 4) return;  /* no need to shrink */
-    if (count < MIN_HANDLE_ENTRIES * 2) return;  /* too small to shrink */
-    count /= 2;
-    if (!(new_entries = realloc( table->entries, count * sizeof(*new_entries) ))) return;
-    table->count   = count;
-    table->entries = new_entries;
-}
-
 static void inherit_handle( struct process *parent, const obj_handle_t handle, struct handle_table *table )
 {
     struct handle_entry *dst, *src;
     int index;
 
-    dst = table->entries;
-
     src = get_handle( parent, handle );
     if (!src || !(src->access & RESERVED_INHERIT)) return;
     index = handle_to_index( handle );
-    if (dst[index].ptr) return;
+    dst = get_entry( table, index );
+    if (dst->ptr) return;
     grab_object_for_handle( src->ptr );
-    dst[index] = *src;
+    *dst = *src;
     table->last = max( table->last, index );
 }
 
@@ -386,13 +431,11 @@ struct handle_table *copy_handle_table( struct process *process, struct process
     assert( parent_table );
     assert( parent_table->obj.ops == &handle_table_ops );
 
-    if (!(table = alloc_handle_table( process, parent_table->count )))
+    if (!(table = alloc_handle_table( process, parent_table->last + 1 )))
         return NULL;
 
     if (handles)
     {
-        memset( table->entries, 0, parent_table->count * sizeof(*table->entries) );
-
         for (i = 0; i < handle_count; i++)
         {
             inherit_handle( parent, handles[i], table );
@@ -407,18 +450,18 @@ struct handle_table *copy_handle_table( struct process *process, struct process
     {
         if ((table->last = parent_table->last) >= 0)
         {
-            struct handle_entry *ptr = table->entries;
-            memcpy( ptr, parent_table->entries, (table->last + 1) * sizeof(struct handle_entry) );
-            for (i = 0; i <= table->last; i++, ptr++)
+            for (i = 0; i <= table->last >> HANDLE_PAGE_SHIFT; i++)
+                memcpy( table->pages[i], parent_table->pages[i], HANDLE_PAGE_ENTRIES * sizeof(struct handle_entry) );
+            for (i = 0; i <= table->last; i++)
             {
+                struct handle_entry *ptr = get_entry( table, i );
                 if (!ptr->ptr) continue;
                 if (ptr->access & RESERVED_INHERIT) grab_object_for_handle( ptr->ptr );
                 else ptr->ptr = NULL; /* don't inherit this entry */
             }
         }
     }
-    /* attempt to shrink the table */
-    shrink_handle_table( table );
+    reset_free_list( table );
     return table;
 }
 
@@ -433,11 +476,17 @@ unsigned int close_handle( struct process *process, obj_handle_t handle )
     if (entry->access & RESERVED_CLOSE_PROTECT) return STATUS_HANDLE_NOT_CLOSABLE;
     obj = entry->ptr;
     if (!obj->ops->close_handle( obj, process, handle )) return STATUS_HANDLE_NOT_CLOSABLE;
-    entry->ptr = NULL;
-    table = handle_is_global(handle) ? global_table : process->handles;
-    if (entry < table->entries + table->free) table->free = entry - table->entries;
-    if (entry == table->entries + table->last) shrink_handle_table( table );
+    if (handle_is_global(handle))
+    {
+        table = global_table;
+        handle = handle_global_to_local( handle );
+    }
+    else table = process->handles;
+    free_entry( table, entry, handle_to_index( handle ));
     release_object_from_handle( obj );
+    /* the client can only update its handle caches for the closes it asked for itself */
+    if (handle_generations && (!current || current->process != process))
+        __atomic_fetch_add( &handle_generations[(process->id / 4) % HANDLE_GENERATION_SLOTS], 1, __ATOMIC_SEQ_CST );
     return STATUS_SUCCESS;
 }
 
@@ -516,8 +565,9 @@ obj_handle_t find_inherited_handle( struct process *process, const struct object
 
     if (!table) return 0;
 
-    for (i = 0, ptr = table->entries; i <= table->last; i++, ptr++)
+    for (i = 0; i <= table->last; i++)
     {
+        ptr = get_entry( table, i );
         if (!ptr->ptr) continue;
         if (ptr->ptr->ops != ops) continue;
         if (ptr->access & RESERVED_INHERIT) return index_to_handle(i);
@@ -819,8 +869,9 @@ static int enum_handles( struct process *process, void *user )
     if (!table)
         return 0;
 
-    for (i = 0, entry = table->entries; i <= table->last; i++, entry++)
+    for (i = 0; i <= table->last; i++)
     {
+        entry = get_entry( table, i );
         if (!entry->ptr) continue;
         if (!info->handle)
         {
@@ -55,4 +55,6 @@ extern struct handle_table *copy_handle_table( struct process *process, struct p
                                                const obj_handle_t *std_handles );
 extern unsigned int get_handle_table_count( struct process *process);
 
+extern unsigned int *handle_generations;
+
 #endif  /* __WINE_SERVER_HANDLE_H */
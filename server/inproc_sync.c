@@ -0,0 +1,86 @@
+/*
+ * Server-side support for in-process synchronization objects
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * The state of events and semaphores is published in a table mapped
+ * read-only into every client, so that clients can check it without a server
+ * round trip.  The server remains the only one to change the state, and
+ * stores it here every time it changes.
+ */
+
+#include "config.h"
+#include "wine/port.h"
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "object.h"
+#include "thread.h"
+
+struct inproc_sync *inproc_sync_slots;      /* shared table of objects, NULL if disabled */
+static unsigned int *free_slots;            /* stack of released slots */
+static unsigned int nb_free_slots;          /* number of released slots */
+static unsigned int next_slot = 1;          /* first never used slot; slot 0 means none */
+
+/* check if in-process synchronization has been enabled for this server */
+int is_inproc_sync_enabled(void)
+{
+    const char *env = getenv( "WINEINPROCSYNC" );
+
+    return env && atoi( env );
+}
+
+/* allocate a slot for an object; return 0 if none is available */
+unsigned int alloc_inproc_sync( enum inproc_sync_type type, unsigned int state, unsigned int max )
+{
+    struct inproc_sync *sync;
+    unsigned int index;
+
+    if (!inproc_sync_slots) return 0;
+    if (nb_free_slots) index = free_slots[--nb_free_slots];
+    else if (next_slot < INPROC_SYNC_MAX_SLOTS) index = next_slot++;
+    else return 0;
+
+    sync = &inproc_sync_slots[index];
+    sync->max = max;
+    __atomic_store_n( &sync->state, state, __ATOMIC_SEQ_CST );
+    __atomic_store_n( &sync->type, type, __ATOMIC_SEQ_CST );
+    return index;
+}
+
+/* release the slot of a destroyed object */
+void free_inproc_sync( unsigned int index )
+{
+    if (!index) return;
+    __atomic_store_n( &inproc_sync_slots[index].type, INPROC_SYNC_NONE, __ATOMIC_SEQ_CST );
+    if (!free_slots && !(free_slots = mem_alloc( INPROC_SYNC_MAX_SLOTS * sizeof(*free_slots) ))) return;
+    free_slots[nb_free_slots++] = index;
+}
+
+/* publish the new state of an object */
+void set_inproc_sync_state( unsigned int index, unsigned int state )
+{
+    if (index) __atomic_store_n( &inproc_sync_slots[index].state, state, __ATOMIC_SEQ_CST );
+}
@@ -1089,6 +1089,45 @@ struct object *create_user_data_mapping( struct object *root, const struct unico
     return &mapping->obj;
 }
 
+struct object *create_inproc_sync_mapping( struct object *root, const struct unicode_str *name,
+                                           unsigned int attr, const struct security_descriptor *sd )
+{
+    void *ptr;
+    struct mapping *mapping;
+
+    if (!(mapping = create_mapping( root, name, attr, INPROC_SYNC_MAX_SLOTS * sizeof(struct inproc_sync),
+                                    SEC_COMMIT, 0, FILE_READ_DATA, sd ))) return NULL;
+    ptr = mmap( NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, get_unix_fd( mapping->fd ), 0 );
+    if (ptr != MAP_FAILED) inproc_sync_slots = ptr;
+    return &mapping->obj;
+}
+
+struct object *create_registry_generation_mapping( struct object *root, const struct unicode_str *name,
+                                                   unsigned int attr, const struct security_descriptor *sd )
+{
+    void *ptr;
+    struct mapping *mapping;
+
+    if (!(mapping = create_mapping( root, name, attr, REGISTRY_GENERATION_SLOTS * sizeof(*registry_generations),
+                                    SEC_COMMIT, 0, FILE_READ_DATA, sd ))) return NULL;
+    ptr = mmap( NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, get_unix_fd( mapping->fd ), 0 );
+    if (ptr != MAP_FAILED) registry_generations = ptr;
+    return &mapping->obj;
+}
+
+struct object *create_handle_generation_mapping( struct object *root, const struct unicode_str *name,
+                                                 unsigned int attr, const struct security_descriptor *sd )
+{
+    void *ptr;
+    struct mapping *mapping;
+
+    if (!(mapping = create_mapping( root, name, attr, HANDLE_GENERATION_SLOTS * sizeof(*handle_generations),
+                                    SEC_COMMIT, 0, FILE_READ_DATA, sd ))) return NULL;
+    ptr = mmap( NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, get_unix_fd( mapping->fd ), 0 );
+    if (ptr != MAP_FAILED) handle_generations = ptr;
+    return &mapping->obj;
+}
+
 /* create a file mapping */
 DECL_HANDLER(create_mapping)
 {
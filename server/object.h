@@ -218,6 +218,14 @@ extern struct keyed_event *get_keyed_event_obj( struct process *process, obj_han
 extern void set_event( struct event *event );
 extern void reset_event( struct event *event );
 
+/* in-process synchronization functions */
+
+extern struct inproc_sync *inproc_sync_slots;
+extern int is_inproc_sync_enabled(void);
+extern unsigned int alloc_inproc_sync( enum inproc_sync_type type, unsigned int state, unsigned int max );
+extern void free_inproc_sync( unsigned int index );
+extern void set_inproc_sync_state( unsigned int index, unsigned int state );
+
 /* mutex functions */
 
 extern void abandon_mutexes( struct thread *thread );
@@ -240,6 +248,7 @@ extern void generate_startup_debug_events( struct process *process );
 
 extern unsigned int supported_machines_count;
 extern unsigned short supported_machines[8];
+extern unsigned int *registry_generations;
 extern void init_registry(void);
 extern void flush_registry(void);
 
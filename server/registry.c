@@ -34,6 +34,9 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -86,12 +89,18 @@ struct key
     int               last_subkey; /* last in use subkey */
     int               nb_subkeys;  /* count of allocated subkeys */
     struct key      **subkeys;     /* subkeys array */
+    struct key      **subkey_hash; /* hash index of subkeys by name, for keys with many subkeys */
+    unsigned int      subkey_hash_size; /* size of the subkey hash index */
+    struct key       *hash_next;   /* next key in the parent hash index bucket */
     int               last_value;  /* last in use value */
     int               nb_values;   /* count of allocated values in array */
     struct key_value *values;      /* values array */
     unsigned int      flags;       /* flags */
     timeout_t         modif;       /* last modification time */
     struct list       notify_list; /* list of notifications */
+    const struct hive_key *image;  /* record in the binary image, if the contents haven't been loaded yet */
+    unsigned int      gen_slot;    /* slot in the shared table of generations */
+    object_id_t       id;          /* unique id, for clients to recognize the key across handles */
 };
 
 /* key flags */
@@ -101,6 +110,8 @@ struct key
 #define KEY_SYMLINK  0x0008  /* key is a symbolic link */
 #define KEY_WOW64    0x0010  /* key contains a Wow6432Node subkey */
 #define KEY_WOWSHARE 0x0020  /* key is a Wow64 shared key (used for Software\Classes) */
+#define KEY_CHANGED  0x0040  /* key itself has been modified since last saved */
+#define KEY_UNSORTED 0x0080  /* subkeys array isn't sorted (only for keys with a subkey hash index) */
 
 /* a key value */
 struct key_value
@@ -113,6 +124,7 @@ struct key_value
 };
 
 #define MIN_SUBKEYS  8   /* min. number of allocated subkeys per key */
+#define MIN_HASHED_SUBKEYS 64  /* min. number of subkeys to build a hash index */
 #define MIN_VALUES   8   /* min. number of allocated values per key */
 
 #define MAX_NAME_LEN  256    /* max. length of a key name */
@@ -121,6 +133,10 @@ struct key_value
 /* the root of the registry tree */
 static struct key *root_key;
 
+unsigned int *registry_generations;    /* table of generations shared with the clients */
+static unsigned int next_gen_slot;     /* generation slot of the next allocated key */
+static object_id_t next_key_id;        /* id of the last allocated key */
+
 static const timeout_t ticks_1601_to_1970 = (timeout_t)86400 * (369 * 365 + 89) * TICKS_PER_SEC;
 static const timeout_t save_period = 30 * -TICKS_PER_SEC;  /* delay between periodic saves */
 static struct timeout_user *save_timeout_user;  /* saving timer */
@@ -132,15 +148,93 @@ static const WCHAR symlink_value[] = {'S','y','m','b','o','l','i','c','L','i','n
 static const struct unicode_str symlink_str = { symlink_value, sizeof(symlink_value) };
 
 static void set_periodic_save_timer(void);
-static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index );
+static struct key_value *find_value( struct key *key, const struct unicode_str *name, int *index );
+static void materialize_key( struct key *key );
+
+/* a deleted key waiting to be written to the journal */
+struct deleted_key
+{
+    struct list   entry;     /* entry in the branch list of deleted keys */
+    data_size_t   len;       /* length of the path */
+    WCHAR         path[1];   /* path relative to the branch root */
+};
 
 /* information about where to save a registry branch */
 struct save_branch_info
 {
     struct key  *key;
     const char  *path;
+    char        *journal;    /* path of the journal file, NULL if not available */
+    struct list  deleted;    /* keys deleted since the last save */
+    int          full_save;  /* the journal can't be used, the whole branch must be saved */
+    unsigned int generation; /* generation of the branch file, a journal is only valid for the same one */
+    char        *image;      /* path of the binary image file, NULL if not available */
+    int          need_image; /* the branch has been loaded from the text file, the image must be rebuilt */
+};
+
+/* The binary image of a branch is a cache of the text file, written along with it on full
+ * saves and mapped at startup instead of parsing the text; the keys are only created when
+ * they are first accessed.  All offsets in a key record are relative to the record itself. */
+
+#define HIVE_MAGIC   "WINEHIVE"
+#define HIVE_VERSION 2
+#define HIVE_MAX_DEPTH 512  /* max. nesting of keys in an image */
+
+struct hive_header
+{
+    char             magic[8];    /* HIVE_MAGIC */
+    unsigned int     version;     /* HIVE_VERSION */
+    unsigned int     size;        /* total size of the image */
+    unsigned __int64 text_size;   /* size of the text file the image has been built with */
+    __int64          text_mtime;  /* modification time of the text file, in nanoseconds */
+    unsigned __int64 text_ino;    /* inode of the text file */
+    unsigned int     root;        /* offset of the root key record */
+    int              prefix_type; /* prefix type of the registry */
+};
+
+struct hive_key
+{
+    timeout_t        modif;       /* last modification time */
+    unsigned int     flags;       /* key flags (KEY_SYMLINK and KEY_WOW64 only) */
+    unsigned short   namelen;     /* length of key name */
+    unsigned short   classlen;    /* length of class name */
+    unsigned int     name;        /* offset of the key name */
+    unsigned int     class;       /* offset of the class name */
+    unsigned int     nb_subkeys;  /* number of subkeys */
+    unsigned int     subkeys;     /* offset of the array of subkey record offsets, sorted by name */
+    unsigned int     nb_values;   /* number of values */
+    unsigned int     values;      /* offset of the array of values, sorted by name */
 };
 
+struct hive_value
+{
+    unsigned int     name;        /* offset of the value name */
+    unsigned int     namelen;     /* length of value name */
+    unsigned int     type;        /* value type */
+    unsigned int     data;        /* offset of the value data */
+    data_size_t      len;         /* value data length in bytes */
+    unsigned int     __pad;
+};
+
+/* get a pointer to data of a binary image, from an offset relative to a record */
+static inline const void *hive_ptr( const void *record, unsigned int offset )
+{
+    return (const char *)record + offset;
+}
+
+/* buffer used to build a binary image */
+struct hive_buffer
+{
+    char        *data;
+    size_t       size;
+    size_t       pos;
+};
+
+/* journal files are compacted once they reach half the size of the branch file */
+#define MIN_JOURNAL_COMPACT_SIZE 0x10000
+static const char journal_commit[] = ";; commit";
+static const char generation_option[] = "#generation=";
+
 #define MAX_SAVE_BRANCH_INFO 3
 static int save_branch_count;
 static struct save_branch_info save_branch_info[MAX_SAVE_BRANCH_INFO];
@@ -198,6 +292,25 @@ static inline int is_wow6432node( const WCHAR *name, unsigned int len )
     return (len == sizeof(wow6432node) && !memicmp_strW( name, wow6432node, sizeof( wow6432node )));
 }
 
+/* compare the names of two subkeys, in the order of the subkeys array */
+static int compare_subkeys( const void *ptr1, const void *ptr2 )
+{
+    const struct key *key1 = *(const struct key * const *)ptr1;
+    const struct key *key2 = *(const struct key * const *)ptr2;
+    int res = memicmp_strW( key1->name, key2->name, min( key1->namelen, key2->namelen ));
+
+    if (!res) res = key1->namelen - key2->namelen;
+    return res;
+}
+
+/* sort the subkeys array of a key that had subkeys appended to it */
+static void sort_subkeys( struct key *key )
+{
+    if (!(key->flags & KEY_UNSORTED)) return;
+    qsort( key->subkeys, key->last_subkey + 1, sizeof(*key->subkeys), compare_subkeys );
+    key->flags &= ~KEY_UNSORTED;
+}
+
 /*
  * The registry text file format v2 used by this code is similar to the one
  * used by REGEDIT import/export functionality, with the following differences:
@@ -272,32 +385,117 @@ static void dump_value( const struct key_value *value, FILE *f )
     fputc( '\n', f );
 }
 
-/* save a registry and all its subkeys to a text file */
-static void save_subkeys( const struct key *key, const struct key *base, FILE *f )
+/* save a registry key and its values to a text file */
+static void save_key( struct key *key, const struct key *base, FILE *f )
 {
     int i;
 
-    if (key->flags & KEY_VOLATILE) return;
-    /* save key if it has either some values or no subkeys, or needs special options */
-    /* keys with no values but subkeys are saved implicitly by saving the subkeys */
-    if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
+    materialize_key( key );
+    fprintf( f, "\n[" );
+    if (key != base) dump_path( key, base, f );
+    fprintf( f, "] %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
+    fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
+    if (key->class)
+    {
+        fprintf( f, "#class=\"" );
+        dump_strW( key->class, key->classlen, f, "\"\"" );
+        fprintf( f, "\"\n" );
+    }
+    if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
+    for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
+}
+
+/* path of a key record in a binary image, below a key that hasn't been loaded */
+struct image_path
+{
+    const struct image_path *parent;
+    const struct hive_key   *image;
+};
+
+/* dump the full path of a key record of a binary image */
+static void dump_image_path( const struct key *key, const struct image_path *path,
+                             const struct key *base, FILE *f )
+{
+    if (!path->parent)  /* the record of the key itself */
     {
-        fprintf( f, "\n[" );
         if (key != base) dump_path( key, base, f );
-        fprintf( f, "] %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
-        fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
-        if (key->class)
+        return;
+    }
+    if (path->parent->parent || key != base)
+    {
+        dump_image_path( key, path->parent, base, f );
+        fprintf( f, "\\\\" );
+    }
+    dump_strW( hive_ptr( path->image, path->image->name ), path->image->namelen, f, "[]" );
+}
+
+/* save a key record of a binary image and all its subkeys to a text file, without loading them */
+static void save_image_subkeys( const struct key *key, const struct image_path *parent,
+                                const struct hive_key *image, const struct key *base, FILE *f )
+{
+    const struct hive_value *values = hive_ptr( image, image->values );
+    const unsigned int *offsets = hive_ptr( image, image->subkeys );
+    struct image_path path = { parent, image };
+    struct key_value value;
+    unsigned int i;
+
+    if (image->nb_values || !image->nb_subkeys || image->classlen || (image->flags & KEY_SYMLINK))
+    {
+        fprintf( f, "\n[" );
+        dump_image_path( key, &path, base, f );
+        fprintf( f, "] %u\n", (unsigned int)((image->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
+        fprintf( f, "#time=%x%08x\n", (unsigned int)(image->modif >> 32), (unsigned int)image->modif );
+        if (image->classlen)
         {
             fprintf( f, "#class=\"" );
-            dump_strW( key->class, key->classlen, f, "\"\"" );
+            dump_strW( hive_ptr( image, image->class ), image->classlen, f, "\"\"" );
             fprintf( f, "\"\n" );
         }
-        if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
-        for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
+        if (image->flags & KEY_SYMLINK) fputs( "#link\n", f );
+        for (i = 0; i < image->nb_values; i++)
+        {
+            value.name    = (WCHAR *)hive_ptr( image, values[i].name );
+            value.namelen = values[i].namelen;
+            value.type    = values[i].type;
+            value.len     = values[i].len;
+            value.data    = (void *)hive_ptr( image, values[i].data );
+            dump_value( &value, f );
+        }
     }
+    for (i = 0; i < image->nb_subkeys; i++)
+        save_image_subkeys( key, &path, hive_ptr( image, offsets[i] ), base, f );
+}
+
+/* save a registry and all its subkeys to a text file */
+static void save_subkeys( struct key *key, const struct key *base, FILE *f )
+{
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return;
+    if (key->image)  /* contents haven't been loaded, save them straight from the image */
+    {
+        save_image_subkeys( key, NULL, key->image, base, f );
+        return;
+    }
+    /* save key if it has either some values or no subkeys, or needs special options */
+    /* keys with no values but subkeys are saved implicitly by saving the subkeys */
+    if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
+        save_key( key, base, f );
+    sort_subkeys( key );
     for (i = 0; i <= key->last_subkey; i++) save_subkeys( key->subkeys[i], base, f );
 }
 
+/* save the keys that have been modified since the last save to a text file */
+static void save_changed_keys( struct key *key, const struct key *base, FILE *f )
+{
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return;
+    if (!(key->flags & KEY_DIRTY)) return;
+    if (key->flags & KEY_CHANGED) save_key( key, base, f );
+    for (i = 0; i <= key->last_subkey; i++) save_changed_keys( key->subkeys[i], base, f );
+}
+
 static void dump_operation( const struct key *key, const struct key_value *value, const char *op )
 {
     fprintf( stderr, "%s key ", op );
@@ -457,6 +655,7 @@ static void key_destroy( struct object *obj )
         release_object( key->subkeys[i] );
     }
     free( key->subkeys );
+    free( key->subkey_hash );
     /* unconditionally notify everything waiting on this key */
     while ((ptr = list_head( &key->notify_list )))
     {
@@ -519,11 +718,17 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
         key->last_subkey = -1;
         key->nb_subkeys  = 0;
         key->subkeys     = NULL;
+        key->subkey_hash = NULL;
+        key->subkey_hash_size = 0;
+        key->hash_next   = NULL;
         key->nb_values   = 0;
         key->last_value  = -1;
         key->values      = NULL;
         key->modif       = modif;
         key->parent      = NULL;
+        key->image       = NULL;
+        key->gen_slot    = next_gen_slot++ % REGISTRY_GENERATION_SLOTS;
+        key->id          = ++next_key_id;
         list_init( &key->notify_list );
         if (name->len && !(key->name = memdup( name->str, name->len )))
         {
@@ -537,6 +742,7 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
 /* mark a key and all its parents as dirty (modified) */
 static void make_dirty( struct key *key )
 {
+    if (!(key->flags & KEY_VOLATILE)) key->flags |= KEY_CHANGED;
     while (key)
     {
         if (key->flags & (KEY_DIRTY|KEY_VOLATILE)) return;  /* nothing to do */
@@ -552,10 +758,23 @@ static void make_clean( struct key *key )
 
     if (key->flags & KEY_VOLATILE) return;
     if (!(key->flags & KEY_DIRTY)) return;
-    key->flags &= ~KEY_DIRTY;
+    key->flags &= ~(KEY_DIRTY | KEY_CHANGED);
     for (i = 0; i <= key->last_subkey; i++) make_clean( key->subkeys[i] );
 }
 
+/* invalidate the contents of a key cached by the clients */
+static void bump_key_generation( struct key *key )
+{
+    if (registry_generations) __atomic_fetch_add( &registry_generations[key->gen_slot], 1, __ATOMIC_SEQ_CST );
+}
+
+/* retrieve the generation of a key for a client to cache a reply */
+static void get_key_generation( const struct key *key, unsigned int *slot, unsigned int *generation )
+{
+    *slot = key->gen_slot;
+    *generation = registry_generations ? __atomic_load_n( &registry_generations[key->gen_slot], __ATOMIC_SEQ_CST ) : 0;
+}
+
 /* go through all the notifications and send them if necessary */
 static void check_notify( struct key *key, unsigned int change, int not_subtree )
 {
@@ -577,6 +796,10 @@ static void touch_key( struct key *key, unsigned int change )
     key->modif = current_time;
     make_dirty( key );
 
+    /* the parent caches the information about its subkeys too */
+    bump_key_generation( key );
+    if (key->parent) bump_key_generation( key->parent );
+
     /* do notifications */
     check_notify( key, change, 1 );
     for ( k = key->parent; k; k = k->parent )
@@ -608,6 +831,41 @@ static int grow_subkeys( struct key *key )
     return 1;
 }
 
+/* add a subkey to the hash index of its parent */
+static void hash_subkey( struct key *parent, struct key *key )
+{
+    unsigned int hash = hash_strW( key->name, key->namelen, parent->subkey_hash_size );
+
+    key->hash_next = parent->subkey_hash[hash];
+    parent->subkey_hash[hash] = key;
+}
+
+/* remove a subkey from the hash index of its parent */
+static void unhash_subkey( struct key *parent, struct key *key )
+{
+    struct key **ptr = &parent->subkey_hash[hash_strW( key->name, key->namelen, parent->subkey_hash_size )];
+
+    while (*ptr != key) ptr = &(*ptr)->hash_next;
+    *ptr = key->hash_next;
+    key->hash_next = NULL;
+}
+
+/* build or grow the subkey hash index once it gets too loaded; return 1 if it has been rebuilt */
+static int update_subkey_hash( struct key *key )
+{
+    unsigned int i, count = key->last_subkey + 1;
+    struct key **hash;
+
+    if (count < MIN_HASHED_SUBKEYS || count <= key->subkey_hash_size) return 0;
+    /* on failure simply keep the current index, or none at all */
+    if (!(hash = calloc( count * 2, sizeof(*hash) ))) return 0;
+    free( key->subkey_hash );
+    key->subkey_hash = hash;
+    key->subkey_hash_size = count * 2;
+    for (i = 0; i < count; i++) hash_subkey( key, key->subkeys[i] );
+    return 1;
+}
+
 /* allocate a subkey for a given key, and return its index */
 static struct key *alloc_subkey( struct key *parent, const struct unicode_str *name,
                                  int index, timeout_t modif )
@@ -620,6 +878,11 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
         set_error( STATUS_INVALID_PARAMETER );
         return NULL;
     }
+    if (parent->image)  /* contents could not be loaded */
+    {
+        set_error( STATUS_NO_MEMORY );
+        return NULL;
+    }
     if (parent->last_subkey + 1 == parent->nb_subkeys)
     {
         /* need to grow the array */
@@ -631,6 +894,9 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
         for (i = ++parent->last_subkey; i > index; i--)
             parent->subkeys[i] = parent->subkeys[i-1];
         parent->subkeys[index] = key;
+        if (index && compare_subkeys( &parent->subkeys[index - 1], &parent->subkeys[index] ) > 0)
+            parent->flags |= KEY_UNSORTED;
+        if (!update_subkey_hash( parent ) && parent->subkey_hash) hash_subkey( parent, key );
         if (is_wow6432node( key->name, key->namelen ) && !is_wow6432node( parent->name, parent->namelen ))
             parent->flags |= KEY_WOW64;
     }
@@ -649,7 +915,9 @@ static void free_subkey( struct key *parent, int index )
     key = parent->subkeys[index];
     for (i = index; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
     parent->last_subkey--;
+    if (parent->subkey_hash) unhash_subkey( parent, key );
     key->flags |= KEY_DELETED;
+    bump_key_generation( key );
     key->parent = NULL;
     if (is_wow6432node( key->name, key->namelen )) parent->flags &= ~KEY_WOW64;
     release_object( key );
@@ -667,12 +935,183 @@ static void free_subkey( struct key *parent, int index )
     }
 }
 
-/* find the named child of a given key and return its index */
-static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
+/* check that a range of a binary image lies within it */
+static inline int hive_range_valid( unsigned int size, unsigned int pos, unsigned int offset,
+                                    unsigned __int64 len )
+{
+    unsigned __int64 start = (unsigned __int64)pos + offset;
+    return start <= size && len <= size - start;
+}
+
+/* check a key record of a binary image and all the records it refers to, before anything uses them */
+/* child records always follow their parent, which also prevents loops */
+static int validate_hive_key( const void *base, unsigned int size, unsigned int pos, unsigned int depth )
+{
+    const struct hive_key *image = hive_ptr( base, pos );
+    const struct hive_value *values;
+    const unsigned int *offsets;
+    unsigned int i;
+
+    if (depth > HIVE_MAX_DEPTH || (pos & 7) || !hive_range_valid( size, pos, 0, sizeof(*image) )) return 0;
+    if ((image->namelen & 1) || image->namelen > MAX_NAME_LEN * sizeof(WCHAR) ||
+        !hive_range_valid( size, pos, image->name, image->namelen ))
+        return 0;
+    if ((image->classlen & 1) || !hive_range_valid( size, pos, image->class, image->classlen ))
+        return 0;
+
+    if (image->nb_values)
+    {
+        if ((image->values & 7) ||
+            !hive_range_valid( size, pos, image->values, (unsigned __int64)image->nb_values * sizeof(*values) ))
+            return 0;
+        values = hive_ptr( image, image->values );
+        for (i = 0; i < image->nb_values; i++)
+        {
+            if ((values[i].namelen & 1) || values[i].namelen > MAX_VALUE_LEN * sizeof(WCHAR) ||
+                !hive_range_valid( size, pos, values[i].name, values[i].namelen ) ||
+                !hive_range_valid( size, pos, values[i].data, values[i].len ))
+                return 0;
+        }
+    }
+
+    if (image->nb_subkeys)
+    {
+        if ((image->subkeys & 3) ||
+            !hive_range_valid( size, pos, image->subkeys, (unsigned __int64)image->nb_subkeys * sizeof(*offsets) ))
+            return 0;
+        offsets = hive_ptr( image, image->subkeys );
+        for (i = 0; i < image->nb_subkeys; i++)
+        {
+            if (!offsets[i] || !hive_range_valid( size, pos, offsets[i], 0 )) return 0;
+            if (!validate_hive_key( base, size, pos + offsets[i], depth + 1 )) return 0;
+        }
+    }
+    return 1;
+}
+
+/* set the attributes of a key from its record in a binary image, and mark it as not loaded */
+static int init_key_from_image( struct key *key, const struct hive_key *image )
+{
+    if (image->classlen)
+    {
+        WCHAR *class = memdup( hive_ptr( image, image->class ), image->classlen );
+        if (!class) return 0;
+        free( key->class );
+        key->class = class;
+        key->classlen = image->classlen;
+    }
+    key->flags |= image->flags & (KEY_SYMLINK | KEY_WOW64);
+    key->modif = image->modif;
+    key->image = image;
+    return 1;
+}
+
+/* create the values and subkeys of a key from its record in the binary image */
+/* the subkeys are created without their own contents */
+static void materialize_key( struct key *key )
+{
+    const struct hive_key *image = key->image;
+    const struct hive_value *values;
+    const unsigned int *offsets;
+    struct key_value *new_values = NULL;
+    struct key **new_subkeys = NULL;
+    unsigned int i, nb_values = 0, nb_subkeys = 0;
+
+    if (!image) return;
+
+    if (image->nb_values &&
+        !(new_values = mem_alloc( max( image->nb_values, MIN_VALUES ) * sizeof(*new_values) )))
+        return;
+    if (image->nb_subkeys &&
+        !(new_subkeys = mem_alloc( max( image->nb_subkeys, MIN_SUBKEYS ) * sizeof(*new_subkeys) )))
+        goto failed;
+
+    values = hive_ptr( image, image->values );
+    for (nb_values = 0; nb_values < image->nb_values; nb_values++)
+    {
+        struct key_value *value = &new_values[nb_values];
+
+        value->name    = NULL;
+        value->namelen = values[nb_values].namelen;
+        value->type    = values[nb_values].type;
+        value->len     = values[nb_values].len;
+        value->data    = NULL;
+        if (value->namelen && !(value->name = memdup( hive_ptr( image, values[nb_values].name ), value->namelen )))
+            goto failed;
+        if (value->len && !(value->data = memdup( hive_ptr( image, values[nb_values].data ), value->len )))
+        {
+            free( value->name );
+            goto failed;
+        }
+    }
+
+    offsets = hive_ptr( image, image->subkeys );
+    for (nb_subkeys = 0; nb_subkeys < image->nb_subkeys; nb_subkeys++)
+    {
+        const struct hive_key *child = hive_ptr( image, offsets[nb_subkeys] );
+        struct unicode_str name;
+        struct key *subkey;
+
+        name.str = hive_ptr( child, child->name );
+        name.len = child->namelen;
+        if (!(subkey = alloc_key( &name, child->modif ))) goto failed;
+        subkey->parent = key;
+        new_subkeys[nb_subkeys] = subkey;
+        if (!init_key_from_image( subkey, child ))
+        {
+            nb_subkeys++;
+            goto failed;
+        }
+    }
+
+    key->values      = new_values;
+    key->nb_values   = new_values ? max( nb_values, MIN_VALUES ) : 0;
+    key->last_value  = nb_values - 1;
+    key->subkeys     = new_subkeys;
+    key->nb_subkeys  = new_subkeys ? max( nb_subkeys, MIN_SUBKEYS ) : 0;
+    key->last_subkey = nb_subkeys - 1;
+    key->image       = NULL;
+    update_subkey_hash( key );
+    return;
+
+failed:
+    /* leave the key empty and not loaded, nothing can be added to it */
+    for (i = 0; i < nb_values; i++)
+    {
+        free( new_values[i].name );
+        free( new_values[i].data );
+    }
+    for (i = 0; i < nb_subkeys; i++)
+    {
+        new_subkeys[i]->parent = NULL;
+        release_object( new_subkeys[i] );
+    }
+    free( new_values );
+    free( new_subkeys );
+}
+
+/* find the named child of a given key */
+/* if not found, index is set to where it should be inserted */
+static struct key *find_subkey( struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
     data_size_t len;
 
+    materialize_key( key );
+    if (key->subkey_hash)
+    {
+        struct key *subkey = key->subkey_hash[hash_strW( name->str, name->len, key->subkey_hash_size )];
+
+        for ( ; subkey; subkey = subkey->hash_next)
+        {
+            if (subkey->namelen != name->len) continue;
+            if (!memicmp_strW( subkey->name, name->str, name->len )) return subkey;
+        }
+        /* append new subkeys, the array gets sorted when it needs to be */
+        *index = key->last_subkey + 1;
+        return NULL;
+    }
+
     min = 0;
     max = key->last_subkey;
     while (min <= max)
@@ -848,7 +1287,7 @@ static struct key *create_key( struct key *key, const struct unicode_str *name,
 
     if (options & REG_OPTION_CREATE_LINK) key->flags |= KEY_SYMLINK;
     if (options & REG_OPTION_VOLATILE) key->flags |= KEY_VOLATILE;
-    else key->flags |= KEY_DIRTY;
+    else key->flags |= KEY_DIRTY | KEY_CHANGED;
 
     if (sd) default_set_sd( &key->obj, sd, OWNER_SECURITY_INFORMATION | GROUP_SECURITY_INFORMATION |
                             DACL_SECURITY_INFORMATION | SACL_SECURITY_INFORMATION );
@@ -918,6 +1357,7 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
     WCHAR *fullname = NULL;
     char *data;
 
+    materialize_key( key );
     if (index != -1)  /* -1 means use the specified key directly */
     {
         if ((index < 0) || (index > key->last_subkey))
@@ -925,9 +1365,11 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
             set_error( STATUS_NO_MORE_ENTRIES );
             return;
         }
+        sort_subkeys( key );
         key = key->subkeys[index];
     }
 
+    materialize_key( key );
     namelen = key->namelen;
     classlen = key->classlen;
 
@@ -999,6 +1441,52 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
     if (debug_level > 1) dump_operation( key, NULL, "Enum" );
 }
 
+/* remember a deleted key so that the deletion can be written to the journal */
+static void record_deleted_key( const struct key *key )
+{
+    struct deleted_key *deleted;
+    const struct key *k;
+    data_size_t len = key->namelen;
+    WCHAR *p;
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return;
+    for (k = key->parent; k; k = k->parent)
+    {
+        for (i = 0; i < save_branch_count; i++) if (save_branch_info[i].key == k) break;
+        if (i < save_branch_count) break;
+        len += k->namelen + sizeof(WCHAR);
+    }
+    if (!k || !save_branch_info[i].journal || save_branch_info[i].full_save) return;
+
+    if (!(deleted = malloc( offsetof( struct deleted_key, path[len / sizeof(WCHAR)] ))))
+    {
+        save_branch_info[i].full_save = 1;
+        return;
+    }
+    deleted->len = len;
+    p = deleted->path + len / sizeof(WCHAR);
+    for (k = key; k != save_branch_info[i].key; k = k->parent)
+    {
+        p -= k->namelen / sizeof(WCHAR);
+        memcpy( p, k->name, k->namelen );
+        if (p > deleted->path) *--p = '\\';
+    }
+    list_add_tail( &save_branch_info[i].deleted, &deleted->entry );
+}
+
+/* free the list of deleted keys of a branch */
+static void free_deleted_keys( struct save_branch_info *info )
+{
+    struct deleted_key *deleted, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE( deleted, next, &info->deleted, struct deleted_key, entry )
+    {
+        list_remove( &deleted->entry );
+        free( deleted );
+    }
+}
+
 /* delete a key and its values */
 static int delete_key( struct key *key, int recurse )
 {
@@ -1013,6 +1501,7 @@ static int delete_key( struct key *key, int recurse )
     }
     assert( parent );
 
+    materialize_key( key );
     while (recurse && (key->last_subkey>=0))
         if (0 > delete_key(key->subkeys[key->last_subkey], 1))
             return -1;
@@ -1029,6 +1518,7 @@ static int delete_key( struct key *key, int recurse )
     }
 
     if (debug_level > 1) dump_operation( key, NULL, "Delete" );
+    record_deleted_key( key );
     free_subkey( parent, index );
     touch_key( parent, REG_NOTIFY_CHANGE_NAME );
     return 0;
@@ -1060,11 +1550,12 @@ static int grow_values( struct key *key )
 }
 
 /* find the named value of a given key and return its index in the array */
-static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index )
+static struct key_value *find_value( struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
     data_size_t len;
 
+    materialize_key( key );
     min = 0;
     max = key->last_value;
     while (min <= max)
@@ -1097,6 +1588,11 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
         set_error( STATUS_NAME_TOO_LONG );
         return NULL;
     }
+    if (key->image)  /* contents could not be loaded */
+    {
+        set_error( STATUS_NO_MEMORY );
+        return NULL;
+    }
     if (key->last_value + 1 == key->nb_values)
     {
         if (!grow_values( key )) return NULL;
@@ -1184,6 +1680,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
 {
     struct key_value *value;
 
+    materialize_key( key );
     if (i < 0 || i > key->last_value) set_error( STATUS_NO_MORE_ENTRIES );
     else
     {
@@ -1638,13 +2135,74 @@ static int get_prefix_len( struct key *key, const char *name, struct file_load_i
     return res;
 }
 
+/* remove all the values of a key */
+static void clear_values( struct key *key )
+{
+    int i;
+
+    materialize_key( key );
+    for (i = 0; i <= key->last_value; i++)
+    {
+        free( key->values[i].name );
+        free( key->values[i].data );
+    }
+    key->last_value = -1;
+}
+
+/* delete a key listed in a journal file */
+static void load_deleted_key( struct key *base, const char *buffer, struct file_load_info *info )
+{
+    struct unicode_str path, token;
+    struct key *key = base, *parent;
+    data_size_t len;
+    int index;
+
+    if (!get_file_tmp_space( info, strlen(buffer) * sizeof(WCHAR) )) return;
+
+    len = info->tmplen;
+    if (parse_strW( info->tmp, &len, buffer, ']' ) == -1)
+    {
+        file_read_error( "Malformed key", info );
+        return;
+    }
+    path.str = info->tmp;
+    path.len = len - sizeof(WCHAR);
+    token.str = NULL;
+    if (!get_path_token( &path, &token )) return;
+    while (token.len)
+    {
+        if (!(key = find_subkey( key, &token, &index ))) return;  /* already gone */
+        get_path_token( &path, &token );
+    }
+    if (key == base) return;
+
+    parent = key->parent;
+    for (index = 0; index <= parent->last_subkey; index++)
+        if (parent->subkeys[index] == key) break;
+    free_subkey( parent, index );
+}
+
+/* find the end of the last complete transaction of a journal file */
+static long get_journal_end( struct file_load_info *info )
+{
+    long end = 0;
+
+    while (read_next_line( info ) == 1)
+        if (!strcmp( info->buffer, journal_commit )) end = ftell( info->file );
+    fseek( info->file, 0, SEEK_SET );
+    info->line = 0;
+    return end;
+}
+
 /* load all the keys from the input file */
 /* prefix_len is the number of key name prefixes to skip, or -1 for autodetection */
-static void load_keys( struct key *key, const char *filename, FILE *f, int prefix_len )
+/* for journal files, return the offset of the data that has been replayed */
+static long load_keys( struct key *key, const char *filename, FILE *f, int prefix_len, int journal )
 {
     struct key *subkey = NULL;
     struct file_load_info info;
     timeout_t modif = current_time;
+    long end = 0;
     char *p;
 
     info.filename = filename;
@@ -1652,12 +2210,14 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
     info.len    = 4;
     info.tmplen = 4;
     info.line   = 0;
-    if (!(info.buffer = mem_alloc( info.len ))) return;
+    if (!(info.buffer = mem_alloc( info.len ))) return 0;
     if (!(info.tmp = mem_alloc( info.tmplen )))
     {
         free( info.buffer );
-        return;
+        return 0;
     }
+    /* ignore the last transaction if it has not been completely written */
+    if (journal) end = get_journal_end( &info );
 
     if ((read_next_line( &info ) != 1) ||
         strcmp( info.buffer, "WINE REGISTRY Version 2" ))
@@ -1668,6 +2228,7 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
 
     while (read_next_line( &info ) == 1)
     {
+        if (journal && ftell( f ) > end) break;
         p = info.buffer;
         while (*p && isspace(*p)) p++;
         switch(*p)
@@ -1681,6 +2242,18 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
             if (prefix_len == -1) prefix_len = get_prefix_len( key, p + 1, &info );
             if (!(subkey = load_key( key, p + 1, prefix_len, &info, &modif )))
                 file_read_error( "Error creating key", &info );
+            else if (journal)  /* the journal contains the full contents of the key */
+                clear_values( subkey );
+            break;
+        case '-':   /* deleted key */
+            if (!journal || p[1] != '[') goto unrecognized;
+            if (subkey)
+            {
+                update_key_time( subkey, modif );
+                release_object( subkey );
+                subkey = NULL;
+            }
+            load_deleted_key( key, p + 2, &info );
             break;
         case '@':   /* default value */
         case '\"':  /* value */
@@ -1695,6 +2268,7 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
         case 0:     /* empty line */
             break;
         default:
+        unrecognized:
             file_read_error( "Unrecognized input", &info );
             break;
         }
@@ -1708,6 +2282,7 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
     }
     free( info.buffer );
     free( info.tmp );
+    return end;
 }
 
 /* load a part of the registry from a file */
@@ -1724,35 +2299,162 @@ static void load_registry( struct key *key, obj_handle_t handle )
         FILE *f = fdopen( fd, "r" );
         if (f)
         {
-            load_keys( key, NULL, f, -1 );
+            load_keys( key, NULL, f, -1, 0 );
             fclose( f );
         }
         else file_set_error();
     }
 }
 
+/* read the generation option from the header of a branch or journal file */
+static unsigned int read_generation( FILE *f )
+{
+    char buffer[64];
+    unsigned int generation = 0;
+
+    while (fgets( buffer, sizeof(buffer), f ) && buffer[0] != '[')
+    {
+        if (strncmp( buffer, generation_option, sizeof(generation_option) - 1 )) continue;
+        generation = strtoul( buffer + sizeof(generation_option) - 1, NULL, 10 );
+        break;
+    }
+    fseek( f, 0, SEEK_SET );
+    return generation;
+}
+
+/* replay the changes from the journal of a branch */
+static void load_journal( struct save_branch_info *info )
+{
+    struct stat st;
+    FILE *f;
+    long end;
+
+    if (!(f = fopen( info->journal, "r" ))) return;
+    if (read_generation( f ) != info->generation)
+    {
+        /* left over from before the branch file was last saved, its changes are already in there */
+        if (debug_level > 1) fprintf( stderr, "%s: ignoring stale journal\n", info->journal );
+        fclose( f );
+        unlink( info->journal );
+        return;
+    }
+    end = load_keys( info->key, info->journal, f, 0, 1 );
+    /* drop any incomplete transaction so that new ones can be appended */
+    if (!fstat( fileno( f ), &st ) && st.st_size > end && truncate( info->journal, end ) == -1)
+        info->full_save = 1;
+    fclose( f );
+    clear_error();
+}
+
+/* get the modification time of a file in nanoseconds, so that a rewrite within the same second is noticed */
+static __int64 get_stat_mtime_ns( const struct stat *st )
+{
+    __int64 ret = (__int64)st->st_mtime * 1000000000;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    ret += st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    ret += st->st_mtimespec.tv_nsec;
+#endif
+    return ret;
+}
+
+/* map the binary image of a branch if it is up to date, and attach it to the branch root */
+static int load_branch_image( struct key *key, const char *filename, const char *image )
+{
+#ifdef HAVE_SYS_MMAN_H
+    const struct hive_header *header;
+    const struct hive_key *root;
+    struct stat st, st_image;
+    void *ptr;
+    int fd;
+
+    if (key->last_subkey >= 0 || key->last_value >= 0 || key->image) return 0;
+    if (stat( filename, &st ) == -1) return 0;
+    if ((fd = open( image, O_RDONLY )) == -1) return 0;
+    if (fstat( fd, &st_image ) == -1 || st_image.st_size < sizeof(*header) ||
+        (ptr = mmap( NULL, st_image.st_size, PROT_READ, MAP_PRIVATE, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        return 0;
+    }
+    close( fd );
+
+    header = ptr;
+    if (memcmp( header->magic, HIVE_MAGIC, sizeof(header->magic) ) ||
+        header->version != HIVE_VERSION ||
+        header->size != st_image.st_size ||
+        header->text_size != st.st_size ||
+        header->text_mtime != get_stat_mtime_ns( &st ) ||
+        header->text_ino != st.st_ino ||
+        header->root < sizeof(*header) ||
+        (prefix_type != PREFIX_UNKNOWN && header->prefix_type != prefix_type))
+        goto failed;
+
+    /* a corrupt image is ignored and the text file is loaded instead */
+    if (!validate_hive_key( header, header->size, header->root, 0 ))
+    {
+        fprintf( stderr, "%s: ignoring corrupt binary image %s\n", filename, image );
+        goto failed;
+    }
+
+    /* the mapping stays around for as long as the keys reference it */
+    root = hive_ptr( header, header->root );
+    if (!init_key_from_image( key, root )) goto failed;
+    if (prefix_type == PREFIX_UNKNOWN) prefix_type = header->prefix_type;
+    if (debug_level > 1) fprintf( stderr, "%s: using binary image %s\n", filename, image );
+    return 1;
+
+failed:
+    munmap( ptr, st_image.st_size );
+#endif
+    return 0;
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
+    struct save_branch_info *info;
+    char *image;
     FILE *f;
+    unsigned int generation = 0;
+    int loaded = 0, from_text = 0;
+
+    if ((image = malloc( strlen( filename ) + sizeof(".bin") ))) sprintf( image, "%s.bin", filename );
 
     if ((f = fopen( filename, "r" )))
     {
-        load_keys( key, filename, f, 0 );
-        fclose( f );
-        if (get_error() == STATUS_NOT_REGISTRY_FILE)
+        generation = read_generation( f );
+        if (!(loaded = image && load_branch_image( key, filename, image )))
         {
-            fprintf( stderr, "%s is not a valid registry file\n", filename );
-            return 1;
+            load_keys( key, filename, f, 0, 0 );
+            if (get_error() == STATUS_NOT_REGISTRY_FILE)
+            {
+                fprintf( stderr, "%s is not a valid registry file\n", filename );
+                fclose( f );
+                free( image );
+                return 1;
+            }
+            loaded = from_text = 1;
         }
+        fclose( f );
     }
 
     assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
 
-    save_branch_info[save_branch_count].path = filename;
-    save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
+    info = &save_branch_info[save_branch_count++];
+    info->path = filename;
+    info->key = (struct key *)grab_object( key );
+    info->image = image;
+    info->need_image = image && from_text;
+    info->generation = generation;
+    list_init( &info->deleted );
+    if ((info->journal = malloc( strlen( filename ) + sizeof(".journal") )))
+    {
+        sprintf( info->journal, "%s.journal", filename );
+        load_journal( info );
+    }
     make_object_permanent( &key->obj );
-    return (f != NULL);
+    return loaded;
 }
 
 static WCHAR *format_user_registry_path( const SID *sid, struct unicode_str *path )
@@ -1911,7 +2613,7 @@ void init_registry(void)
 }
 
 /* save a registry branch to a file */
-static void save_all_subkeys( struct key *key, FILE *f )
+static void save_all_subkeys( struct key *key, FILE *f, unsigned int generation )
 {
     fprintf( f, "WINE REGISTRY Version 2\n" );
     fprintf( f, ";; All keys relative to " );
@@ -1928,6 +2630,7 @@ static void save_all_subkeys( struct key *key, FILE *f )
     default:
         break;
     }
+    if (generation) fprintf( f, "%s%u\n", generation_option, generation );
     save_subkeys( key, key, f );
 }
 
@@ -1945,7 +2648,7 @@ static void save_registry( struct key *key, obj_handle_t handle )
         FILE *f = fdopen( fd, "w" );
         if (f)
         {
-            save_all_subkeys( key, f );
+            save_all_subkeys( key, f, 0 );
             if (fclose( f )) file_set_error();
         }
         else
@@ -1956,15 +2659,229 @@ static void save_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* reserve some space in a binary image; return its offset, or 0 on error */
+static unsigned int hive_alloc( struct hive_buffer *buf, size_t size )
+{
+    size_t pos = (buf->pos + 7) & ~7;
+
+    if (pos + size > buf->size)
+    {
+        size_t new_size = max( buf->size * 2, pos + size );
+        char *new_data;
+
+        if (new_size > UINT_MAX || !(new_data = realloc( buf->data, new_size ))) return 0;
+        buf->data = new_data;
+        buf->size = new_size;
+    }
+    memset( buf->data + buf->pos, 0, pos + size - buf->pos );
+    buf->pos = pos + size;
+    return pos;
+}
+
+/* copy some data to a binary image; return its offset, or 0 on error */
+static unsigned int hive_add_data( struct hive_buffer *buf, const void *data, size_t size )
+{
+    unsigned int pos = hive_alloc( buf, size );
+
+    if (pos) memcpy( buf->data + pos, data, size );
+    return pos;
+}
+
+/* copy a key record of the previous binary image and all its subkeys to a new one;
+ * return the offset of the new record, or 0 on error */
+static unsigned int copy_hive_key( struct hive_buffer *buf, const struct hive_key *image )
+{
+    const struct hive_value *values = hive_ptr( image, image->values );
+    const unsigned int *offsets = hive_ptr( image, image->subkeys );
+    struct hive_key rec = *image;
+    unsigned int pos, off, child, i;
+
+    if (!(pos = hive_alloc( buf, sizeof(rec) ))) return 0;
+    if (rec.namelen)
+    {
+        if (!(off = hive_add_data( buf, hive_ptr( image, image->name ), image->namelen ))) return 0;
+        rec.name = off - pos;
+    }
+    if (rec.classlen)
+    {
+        if (!(off = hive_add_data( buf, hive_ptr( image, image->class ), image->classlen ))) return 0;
+        rec.class = off - pos;
+    }
+
+    if (rec.nb_values)
+    {
+        if (!(off = hive_alloc( buf, rec.nb_values * sizeof(struct hive_value) ))) return 0;
+        rec.values = off - pos;
+        for (i = 0; i < rec.nb_values; i++)
+        {
+            struct hive_value val = values[i];
+
+            if (val.namelen)
+            {
+                if (!(val.name = hive_add_data( buf, hive_ptr( image, values[i].name ), val.namelen ))) return 0;
+                val.name -= pos;
+            }
+            if (val.len)
+            {
+                if (!(val.data = hive_add_data( buf, hive_ptr( image, values[i].data ), val.len ))) return 0;
+                val.data -= pos;
+            }
+            memcpy( buf->data + off + i * sizeof(val), &val, sizeof(val) );
+        }
+    }
+
+    if (rec.nb_subkeys)
+    {
+        if (!(off = hive_alloc( buf, rec.nb_subkeys * sizeof(unsigned int) ))) return 0;
+        rec.subkeys = off - pos;
+        for (i = 0; i < rec.nb_subkeys; i++)
+        {
+            if (!(child = copy_hive_key( buf, hive_ptr( image, offsets[i] )))) return 0;
+            ((unsigned int *)(buf->data + off))[i] = child - pos;
+        }
+    }
+
+    memcpy( buf->data + pos, &rec, sizeof(rec) );
+    return pos;
+}
+
+/* add a key and all its subkeys to a binary image; return the offset of its record, or 0 on error */
+static unsigned int save_hive_key( struct hive_buffer *buf, struct key *key )
+{
+    struct hive_key rec;
+    unsigned int pos, off, child;
+    int i, j;
+
+    /* contents that haven't been loaded are copied from the previous image */
+    if (key->image) return copy_hive_key( buf, key->image );
+    if (!(pos = hive_alloc( buf, sizeof(rec) ))) return 0;
+
+    memset( &rec, 0, sizeof(rec) );
+    rec.modif    = key->modif;
+    rec.flags    = key->flags & (KEY_SYMLINK | KEY_WOW64);
+    rec.namelen  = key->namelen;
+    rec.classlen = key->classlen;
+    if (key->namelen)
+    {
+        if (!(off = hive_add_data( buf, key->name, key->namelen ))) return 0;
+        rec.name = off - pos;
+    }
+    if (key->classlen)
+    {
+        if (!(off = hive_add_data( buf, key->class, key->classlen ))) return 0;
+        rec.class = off - pos;
+    }
+
+    if ((rec.nb_values = key->last_value + 1))
+    {
+        if (!(off = hive_alloc( buf, rec.nb_values * sizeof(struct hive_value) ))) return 0;
+        rec.values = off - pos;
+        for (i = 0; i <= key->last_value; i++)
+        {
+            struct key_value *value = &key->values[i];
+            struct hive_value val;
+
+            memset( &val, 0, sizeof(val) );
+            val.namelen = value->namelen;
+            val.type    = value->type;
+            val.len     = value->len;
+            if (value->namelen)
+            {
+                if (!(val.name = hive_add_data( buf, value->name, value->namelen ))) return 0;
+                val.name -= pos;
+            }
+            if (value->len)
+            {
+                if (!(val.data = hive_add_data( buf, value->data, value->len ))) return 0;
+                val.data -= pos;
+            }
+            memcpy( buf->data + off + i * sizeof(val), &val, sizeof(val) );
+        }
+    }
+
+    sort_subkeys( key );  /* the image is searched with a binary search once loaded */
+    for (i = 0; i <= key->last_subkey; i++)
+        if (!(key->subkeys[i]->flags & KEY_VOLATILE)) rec.nb_subkeys++;
+    if (rec.nb_subkeys)
+    {
+        if (!(off = hive_alloc( buf, rec.nb_subkeys * sizeof(unsigned int) ))) return 0;
+        rec.subkeys = off - pos;
+        for (i = j = 0; i <= key->last_subkey; i++)
+        {
+            if (key->subkeys[i]->flags & KEY_VOLATILE) continue;
+            if (!(child = save_hive_key( buf, key->subkeys[i] ))) return 0;
+            ((unsigned int *)(buf->data + off))[j++] = child - pos;
+        }
+    }
+
+    memcpy( buf->data + pos, &rec, sizeof(rec) );
+    return pos;
+}
+
+/* write the binary image of a branch that has just been saved to its text file */
+static void save_branch_image( struct save_branch_info *info )
+{
+    struct hive_buffer buf;
+    struct hive_header header;
+    struct stat st;
+    char *tmp = NULL;
+    size_t pos;
+    ssize_t ret;
+    int fd = -1;
+
+    buf.size = 0x10000;
+    buf.pos = sizeof(header);
+    if (!(buf.data = malloc( buf.size ))) return;
+    if (stat( info->path, &st ) == -1) goto failed;
+
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, HIVE_MAGIC, sizeof(header.magic) );
+    header.version     = HIVE_VERSION;
+    header.text_size   = st.st_size;
+    header.text_mtime  = get_stat_mtime_ns( &st );
+    header.text_ino    = st.st_ino;
+    header.prefix_type = prefix_type;
+    if (!(header.root = save_hive_key( &buf, info->key ))) goto failed;
+    header.size = buf.pos;
+    memcpy( buf.data, &header, sizeof(header) );
+
+    if (!(tmp = malloc( strlen( info->image ) + sizeof(".tmp") ))) goto failed;
+    sprintf( tmp, "%s.tmp", info->image );
+    if ((fd = open( tmp, O_CREAT | O_TRUNC | O_WRONLY, 0666 )) == -1) goto failed;
+    for (pos = 0; pos < buf.pos; pos += ret)
+    {
+        if ((ret = write( fd, buf.data + pos, buf.pos - pos )) == -1 && errno == EINTR) ret = 0;
+        else if (ret <= 0) goto failed;
+    }
+    if (close( fd ) == -1 || rename( tmp, info->image ) == -1)
+    {
+        fd = -1;
+        goto failed;
+    }
+    free( tmp );
+    free( buf.data );
+    return;
+
+failed:
+    /* make sure that no stale image is left behind */
+    if (fd != -1) close( fd );
+    if (tmp) unlink( tmp );
+    unlink( info->image );
+    free( tmp );
+    free( buf.data );
+}
+
 /* save a registry branch to a file */
-static int save_branch( struct key *key, const char *path )
+static int save_branch( struct save_branch_info *info )
 {
+    struct key *key = info->key;
+    const char *path = info->path;
     struct stat st;
     char *p, *tmp = NULL;
     int fd, count = 0, ret = 0;
     FILE *f;
 
-    if (!(key->flags & KEY_DIRTY))
+    if (!(key->flags & KEY_DIRTY) && !info->need_image)
     {
         if (debug_level > 1) dump_operation( key, NULL, "Not saving clean" );
         return 1;
@@ -2014,8 +2931,10 @@ static int save_branch( struct key *key, const char *path )
         dump_operation( key, NULL, "saving" );
     }
 
-    save_all_subkeys( key, f );
-    ret = !fclose(f);
+    save_all_subkeys( key, f, info->generation + 1 );
+    /* the file must be on disk before the journal it replaces is removed */
+    ret = !fflush( f ) && (!info->journal || !fsync( fileno( f )));
+    ret = !fclose(f) && ret;
 
     if (tmp)
     {
@@ -2026,19 +2945,83 @@ static int save_branch( struct key *key, const char *path )
 
 done:
     free( tmp );
-    if (ret) make_clean( key );
+    if (ret)
+    {
+        /* the journal contents are now part of the branch file; if the journal is left behind
+         * after a crash, its generation no longer matches and it is ignored on the next start */
+        info->generation++;
+        info->full_save = 0;
+        if (info->journal && unlink( info->journal ) == -1 && errno != ENOENT) info->full_save = 1;
+        if (info->image) save_branch_image( info );
+        free_deleted_keys( info );
+        info->need_image = 0;
+        make_clean( key );
+    }
     return ret;
 }
 
+/* append the changes to a registry branch to its journal file */
+/* return 0 if the whole branch needs to be saved instead */
+static int save_branch_journal( struct save_branch_info *info )
+{
+    struct deleted_key *deleted;
+    struct stat st;
+    off_t size;
+    FILE *f;
+    int ret;
+
+    if (!(info->key->flags & KEY_DIRTY)) return 1;
+    if (!info->journal || info->full_save) return 0;
+    if (stat( info->path, &st ) == -1) return 0;
+    size = max( st.st_size / 2, MIN_JOURNAL_COMPACT_SIZE );
+
+    if (!(f = fopen( info->journal, "a" ))) return 0;
+    if (fstat( fileno( f ), &st ) == -1 || st.st_size >= size)
+    {
+        fclose( f );
+        return 0;  /* time to compact it */
+    }
+
+    if (debug_level > 1)
+    {
+        fprintf( stderr, "%s: ", info->journal );
+        dump_operation( info->key, NULL, "saving changes" );
+    }
+
+    if (!st.st_size) fprintf( f, "WINE REGISTRY Version 2\n%s%u\n", generation_option, info->generation );
+    LIST_FOR_EACH_ENTRY( deleted, &info->deleted, struct deleted_key, entry )
+    {
+        fprintf( f, "\n-[" );
+        dump_strW( deleted->path, deleted->len, f, "[]" );
+        fprintf( f, "]\n" );
+    }
+    save_changed_keys( info->key, info->key, f );
+    fprintf( f, "\n%s\n", journal_commit );
+    /* a transaction is only committed once it is on disk */
+    ret = !fflush( f ) && !fsync( fileno( f ));
+    ret = !fclose( f ) && ret;
+
+    if (!ret)
+    {
+        /* don't leave a partial transaction behind */
+        if (truncate( info->journal, st.st_size ) == -1) info->full_save = 1;
+        return 0;
+    }
+    free_deleted_keys( info );
+    make_clean( info->key );
+    return 1;
+}
+
 /* periodic saving of the registry */
 static void periodic_save( void *arg )
 {
     int i;
 
-    if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
+    if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].path );
+        if (save_branch_info[i].need_image || !save_branch_journal( &save_branch_info[i] ))
+            save_branch( &save_branch_info[i] );
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
     set_periodic_save_timer();
 }
@@ -2058,7 +3041,8 @@ void flush_registry(void)
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
-        if (!save_branch( save_branch_info[i].key, save_branch_info[i].path ))
+        if ((save_branch_info[i].need_image || !save_branch_journal( &save_branch_info[i] )) &&
+            !save_branch( &save_branch_info[i] ))
         {
             fprintf( stderr, "wineserver: could not save registry branch to %s",
                      save_branch_info[i].path );
@@ -2105,6 +3089,8 @@ DECL_HANDLER(create_key)
                                objattr->attributes, sd, &reply->created )))
         {
             reply->hkey = alloc_handle( current->process, key, access, objattr->attributes );
+            reply->key_id = key->id;
+            reply->access = get_handle_access( current->process, reply->hkey );
             release_object( key );
         }
         release_object( parent );
@@ -2128,6 +3114,8 @@ DECL_HANDLER(open_key)
         if ((key = open_key( parent, &name, access, req->attributes )))
         {
             reply->hkey = alloc_handle( current->process, key, access, req->attributes );
+            reply->key_id = key->id;
+            reply->access = get_handle_access( current->process, reply->hkey );
             release_object( key );
         }
         release_object( parent );
@@ -2165,6 +3153,7 @@ DECL_HANDLER(enum_key)
     if ((key = get_hkey_obj( req->hkey,
                              req->index == -1 ? KEY_QUERY_VALUE : KEY_ENUMERATE_SUB_KEYS )))
     {
+        get_key_generation( key, &reply->gen_slot, &reply->generation );
         enum_key( key, req->index, req->info_class, reply );
         release_object( key );
     }
@@ -2203,6 +3192,7 @@ DECL_HANDLER(get_key_value)
     reply->total = 0;
     if ((key = get_hkey_obj( req->hkey, KEY_QUERY_VALUE )))
     {
+        get_key_generation( key, &reply->gen_slot, &reply->generation );
         get_value( key, &name, &reply->type, &reply->total );
         release_object( key );
     }
@@ -2262,6 +3252,7 @@ DECL_HANDLER(load_registry)
         if ((key = create_key( parent, &name, NULL, 0, KEY_WOW64_64KEY, 0, sd, &dummy )))
         {
             load_registry( key, req->file );
+            bump_key_generation( key );
             release_object( key );
         }
         release_object( parent );
@@ -32,7 +32,13 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #include <sys/stat.h>
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 #include <sys/time.h>
 #include <sys/types.h>
 #ifdef HAVE_SYS_SOCKET_H
@@ -75,6 +81,18 @@
 #define SCM_RIGHTS 1
 #endif
 
+#ifdef __linux__
+#ifndef F_GET_SEALS
+#define F_GET_SEALS 1034
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK 0x0002
+#endif
+#ifndef F_SEAL_GROW
+#define F_SEAL_GROW 0x0004
+#endif
+#endif
+
 /* path names for server master Unix socket */
 static const char * const server_socket_name = "socket";   /* name of the socket file */
 static const char * const server_lock_name = "lock";       /* name of the server lock file */
@@ -132,6 +150,22 @@ char *server_dir = NULL;   /* server directory */
 int server_dir_fd = -1;    /* file descriptor for the server dir */
 int config_dir_fd = -1;    /* file descriptor for the config dir */
 
+static void shared_request_poll_event( struct fd *fd, int event );
+
+static const struct fd_ops shared_request_fd_ops =
+{
+    NULL,                        /* get_poll_events */
+    shared_request_poll_event,   /* poll_event */
+    NULL,                        /* flush */
+    NULL,                        /* get_fd_type */
+    NULL,                        /* ioctl */
+    NULL,                        /* queue_async */
+    NULL                         /* reselect_async */
+};
+
+C_ASSERT( sizeof(((struct shared_request_buffer *)0)->header) == sizeof(union generic_request) );
+C_ASSERT( sizeof(((struct shared_request_buffer *)0)->header) == sizeof(union generic_reply) );
+
 static struct master_socket *master_socket;  /* the master socket object */
 static struct timeout_user *master_timeout;
 
@@ -295,8 +329,24 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
+/* send a reply through the shared request buffer of the current thread */
+static void send_shared_reply( union generic_reply *reply )
+{
+    struct shared_request_buffer *buffer = current->shared_req;
+
+    memcpy( buffer->header, reply, sizeof(*reply) );
+    if (current->reply_size) memcpy( buffer + 1, current->reply_data, current->reply_size );
+    free( current->reply_data );
+    current->reply_data = NULL;
+
+    __atomic_store_n( &buffer->state, SHARED_REQUEST_DONE, __ATOMIC_SEQ_CST );
+#ifdef __linux__
+    syscall( __NR_futex, &buffer->state, 1 /* FUTEX_WAKE */, 1, NULL, 0, 0 );
+#endif
+}
+
 /* call a request handler */
-static void call_req_handler( struct thread *thread )
+static void call_req_handler( struct thread *thread, int shared )
 {
     union generic_reply reply;
     enum request req = thread->req.request_header.req;
@@ -315,10 +365,15 @@ static void call_req_handler( struct thread *thread )
 
     if (current)
     {
-        if (current->reply_fd)
+        reply.reply_header.error = current->error;
+        reply.reply_header.reply_size = current->reply_size;
+        if (shared)
+        {
+            if (debug_level) trace_reply( req, &reply );
+            send_shared_reply( &reply );
+        }
+        else if (current->reply_fd)
         {
-            reply.reply_header.error = current->error;
-            reply.reply_header.reply_size = current->reply_size;
             if (debug_level) trace_reply( req, &reply );
             send_reply( &reply );
         }
@@ -343,7 +398,7 @@ void read_request( struct thread *thread )
         if (!(thread->req_toread = thread->req.request_header.request_size))
         {
             /* no data, handle request at once */
-            call_req_handler( thread );
+            call_req_handler( thread, 0 );
             return;
         }
         if (!(thread->req_data = malloc( thread->req_toread )))
@@ -364,7 +419,7 @@ void read_request( struct thread *thread )
         if (ret <= 0) break;
         if (!(thread->req_toread -= ret))
         {
-            call_req_handler( thread );
+            call_req_handler( thread, 0 );
             free( thread->req_data );
             thread->req_data = NULL;
             return;
@@ -380,6 +435,195 @@ error:
         fatal_protocol_error( thread, "read: %s\n", strerror( errno ));
 }
 
+/* read a request from the shared request buffer of a thread */
+static void read_shared_request( struct thread *thread )
+{
+    struct shared_request_buffer *buffer = thread->shared_req;
+    data_size_t max_size = thread->shared_req_size - sizeof(*buffer);
+    unsigned __int64 count;
+    int ret;
+
+    if ((ret = read( get_unix_fd( thread->doorbell_fd ), &count, sizeof(count) )) != sizeof(count))
+    {
+        if (ret == -1 && (errno == EAGAIN || errno == EINTR)) return;
+        fatal_protocol_error( thread, "doorbell read: %s\n", ret == -1 ? strerror( errno ) : "short read" );
+        return;
+    }
+    if (__atomic_load_n( &buffer->state, __ATOMIC_SEQ_CST ) != SHARED_REQUEST_PENDING) return;
+
+    memcpy( &thread->req, buffer->header, sizeof(thread->req) );
+    if (thread->req.request_header.request_size > max_size ||
+        thread->req.request_header.reply_size > max_size)
+    {
+        fatal_protocol_error( thread, "shared request %d too large\n", thread->req.request_header.req );
+        return;
+    }
+
+    /* copy the data, the client can still write to the buffer behind our back */
+    if (thread->req.request_header.request_size)
+    {
+        if (!(thread->req_data = memdup( buffer + 1, thread->req.request_header.request_size )))
+        {
+            fatal_protocol_error( thread, "no memory for %u bytes request %d\n",
+                                  thread->req.request_header.request_size, thread->req.request_header.req );
+            return;
+        }
+    }
+    call_req_handler( thread, 1 );
+    free( thread->req_data );
+    thread->req_data = NULL;
+}
+
+/* handle an event on the doorbell of a shared request buffer */
+static void shared_request_poll_event( struct fd *fd, int event )
+{
+    struct thread *thread = get_fd_user( fd );
+
+    grab_object( thread );
+    if (event & (POLLERR | POLLHUP)) kill_thread( thread, 0 );
+    else if (event & POLLIN) read_shared_request( thread );
+    release_object( thread );
+}
+
+/* release the shared request buffer of a dead thread, waking up the client if needed */
+void free_shared_request_buffer( struct thread *thread )
+{
+    struct shared_request_buffer *buffer = thread->shared_req;
+
+    if (!buffer) return;
+    __atomic_store_n( &buffer->state, SHARED_REQUEST_CLOSED, __ATOMIC_SEQ_CST );
+#ifdef __linux__
+    syscall( __NR_futex, &buffer->state, 1 /* FUTEX_WAKE */, 1, NULL, 0, 0 );
+#endif
+    munmap( buffer, thread->shared_req_size );
+    release_object( thread->doorbell_fd );
+    thread->shared_req = NULL;
+    thread->shared_req_size = 0;
+    thread->doorbell_fd = NULL;
+}
+
+/* set up a request buffer shared with the server for the current thread */
+DECL_HANDLER(set_shared_request_buffer)
+{
+    int buffer_fd = thread_get_inflight_fd( current, req->buffer_fd );
+    int doorbell_fd = thread_get_inflight_fd( current, req->doorbell_fd );
+#ifdef __linux__
+    struct stat st;
+    void *ptr;
+    int seals;
+
+    /* the buffer must not be shrunk under our feet, or accessing it would crash the server */
+    if (buffer_fd == -1 || doorbell_fd == -1 || current->shared_req ||
+        req->size <= sizeof(struct shared_request_buffer) ||
+        fstat( buffer_fd, &st ) == -1 || st.st_size < req->size ||
+        (seals = fcntl( buffer_fd, F_GET_SEALS )) == -1 ||
+        (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW))
+        set_error( STATUS_INVALID_PARAMETER );
+    else if ((ptr = mmap( NULL, req->size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer_fd, 0 )) == MAP_FAILED)
+        file_set_error();
+    else
+    {
+        fcntl( doorbell_fd, F_SETFL, O_NONBLOCK );
+        if ((current->doorbell_fd = create_anonymous_fd( &shared_request_fd_ops, doorbell_fd, &current->obj, 0 )))
+        {
+            current->shared_req = ptr;
+            current->shared_req_size = req->size;
+            set_fd_events( current->doorbell_fd, POLLIN );
+        }
+        else munmap( ptr, req->size );
+        doorbell_fd = -1;  /* now owned by the fd object */
+    }
+#else
+    set_error( STATUS_NOT_SUPPORTED );
+#endif
+    if (buffer_fd != -1) close( buffer_fd );
+    if (doorbell_fd != -1) close( doorbell_fd );
+}
+
+/* process several independent requests at once */
+DECL_HANDLER(batch)
+{
+    union generic_request saved_req = current->req;
+    void *saved_data = current->req_data;
+    const char *ptr = get_req_data(), *end = ptr + get_req_data_size();
+    data_size_t pos = 0, max_size = get_reply_max_size();
+    unsigned int error = STATUS_SUCCESS;
+    char *replies = NULL;
+
+    if (max_size && !(replies = mem_alloc( max_size ))) return;
+
+    while (ptr < end)
+    {
+        union generic_reply sub_reply;
+        enum request req;
+        data_size_t size, reply_max;
+
+        if (end - ptr < sizeof(current->req))
+        {
+            error = STATUS_INVALID_PARAMETER;
+            break;
+        }
+        memcpy( &current->req, ptr, sizeof(current->req) );
+        req       = current->req.request_header.req;
+        size      = current->req.request_header.request_size;
+        reply_max = current->req.request_header.reply_size;
+        ptr += sizeof(current->req);
+
+        if (size > end - ptr || req >= REQ_NB_REQUESTS || req == REQ_batch || req == REQ_select)
+        {
+            error = STATUS_INVALID_PARAMETER;
+            break;
+        }
+        if (pos + sizeof(sub_reply) > max_size || reply_max > max_size - pos - sizeof(sub_reply))
+        {
+            error = STATUS_BUFFER_OVERFLOW;
+            break;
+        }
+
+        /* give each request its own copy, so that it can be freed if the thread gets killed */
+        if (size && !(current->req_data = memdup( ptr, size )))
+        {
+            error = STATUS_NO_MEMORY;
+            break;
+        }
+        if (!size) current->req_data = NULL;
+        current->reply_size = 0;
+        current->reply_data = NULL;
+        clear_error();
+        memset( &sub_reply, 0, sizeof(sub_reply) );
+
+        if (debug_level) trace_request();
+        req_handlers[req]( &current->req, &sub_reply );
+        if (!current)  /* thread got killed */
+        {
+            free( saved_data );
+            free( replies );
+            return;
+        }
+        free( current->req_data );
+
+        sub_reply.reply_header.error = current->error;
+        sub_reply.reply_header.reply_size = current->reply_size;
+        if (debug_level) trace_reply( req, &sub_reply );
+
+        memcpy( replies + pos, &sub_reply, sizeof(sub_reply) );
+        pos += sizeof(sub_reply);
+        if (current->reply_size)
+        {
+            memcpy( replies + pos, current->reply_data, current->reply_size );
+            pos += (current->reply_size + 7) & ~7;
+        }
+        free( current->reply_data );
+        ptr += (size + 7) & ~7;
+        reply->count++;
+    }
+
+    current->req = saved_req;
+    current->req_data = saved_data;
+    set_reply_data_ptr( replies, min( pos, max_size ));
+    set_error( error );
+}
+
 /* receive a file descriptor on the process socket */
 int receive_fd( struct process *process )
 {
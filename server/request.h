@@ -54,6 +54,7 @@ extern int receive_fd( struct process *process );
 extern int send_client_fd( struct process *process, int fd, obj_handle_t handle );
 extern void read_request( struct thread *thread );
 extern void write_reply( struct thread *thread );
+extern void free_shared_request_buffer( struct thread *thread );
 extern timeout_t monotonic_counter(void);
 extern void open_master_socket(void);
 extern void close_master_socket( timeout_t timeout );
@@ -126,6 +127,7 @@ DECL_HANDLER(get_startup_info);
 DECL_HANDLER(init_process_done);
 DECL_HANDLER(init_first_thread);
 DECL_HANDLER(init_thread);
+DECL_HANDLER(set_shared_request_buffer);
 DECL_HANDLER(terminate_process);
 DECL_HANDLER(terminate_thread);
 DECL_HANDLER(get_process_info);
@@ -167,6 +169,8 @@ DECL_HANDLER(alloc_file_handle);
 DECL_HANDLER(get_handle_unix_name);
 DECL_HANDLER(get_handle_fd);
 DECL_HANDLER(get_directory_cache_entry);
+DECL_HANDLER(get_directory_snapshot);
+DECL_HANDLER(set_directory_snapshot);
 DECL_HANDLER(flush);
 DECL_HANDLER(get_file_info);
 DECL_HANDLER(get_volume_info);
@@ -370,6 +374,8 @@ DECL_HANDLER(query_completion);
 DECL_HANDLER(set_completion_info);
 DECL_HANDLER(add_fd_completion);
 DECL_HANDLER(set_fd_completion_mode);
+DECL_HANDLER(create_wait_completion);
+DECL_HANDLER(cancel_wait_completion);
 DECL_HANDLER(set_fd_disp_info);
 DECL_HANDLER(set_fd_name_info);
 DECL_HANDLER(get_window_layered_info);
@@ -392,6 +398,7 @@ DECL_HANDLER(terminate_job);
 DECL_HANDLER(suspend_process);
 DECL_HANDLER(resume_process);
 DECL_HANDLER(get_next_thread);
+DECL_HANDLER(batch);
 
 #ifdef WANT_REQUEST_HANDLERS
 
@@ -405,6 +412,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_init_process_done,
     (req_handler)req_init_first_thread,
     (req_handler)req_init_thread,
+    (req_handler)req_set_shared_request_buffer,
     (req_handler)req_terminate_process,
     (req_handler)req_terminate_thread,
     (req_handler)req_get_process_info,
@@ -446,6 +454,8 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_get_handle_unix_name,
     (req_handler)req_get_handle_fd,
     (req_handler)req_get_directory_cache_entry,
+    (req_handler)req_get_directory_snapshot,
+    (req_handler)req_set_directory_snapshot,
     (req_handler)req_flush,
     (req_handler)req_get_file_info,
     (req_handler)req_get_volume_info,
@@ -649,6 +659,8 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_set_completion_info,
     (req_handler)req_add_fd_completion,
     (req_handler)req_set_fd_completion_mode,
+    (req_handler)req_create_wait_completion,
+    (req_handler)req_cancel_wait_completion,
     (req_handler)req_set_fd_disp_info,
     (req_handler)req_set_fd_name_info,
     (req_handler)req_get_window_layered_info,
@@ -671,6 +683,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_suspend_process,
     (req_handler)req_resume_process,
     (req_handler)req_get_next_thread,
+    (req_handler)req_batch,
 };
 
 C_ASSERT( sizeof(abstime_t) == 8 );
@@ -694,6 +707,7 @@ C_ASSERT( sizeof(luid_t) == 8 );
 C_ASSERT( sizeof(mem_size_t) == 8 );
 C_ASSERT( sizeof(mod_handle_t) == 8 );
 C_ASSERT( sizeof(obj_handle_t) == 4 );
+C_ASSERT( sizeof(object_id_t) == 8 );
 C_ASSERT( sizeof(process_id_t) == 4 );
 C_ASSERT( sizeof(rectangle_t) == 16 );
 C_ASSERT( sizeof(short int) == 2 );
@@ -762,6 +776,10 @@ C_ASSERT( FIELD_OFFSET(struct init_thread_reply, pid) == 8 );
 C_ASSERT( FIELD_OFFSET(struct init_thread_reply, tid) == 12 );
 C_ASSERT( FIELD_OFFSET(struct init_thread_reply, suspend) == 16 );
 C_ASSERT( sizeof(struct init_thread_reply) == 24 );
+C_ASSERT( FIELD_OFFSET(struct set_shared_request_buffer_request, buffer_fd) == 12 );
+C_ASSERT( FIELD_OFFSET(struct set_shared_request_buffer_request, doorbell_fd) == 16 );
+C_ASSERT( FIELD_OFFSET(struct set_shared_request_buffer_request, size) == 20 );
+C_ASSERT( sizeof(struct set_shared_request_buffer_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct terminate_process_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct terminate_process_request, exit_code) == 16 );
 C_ASSERT( sizeof(struct terminate_process_request) == 24 );
@@ -900,7 +918,9 @@ C_ASSERT( FIELD_OFFSET(struct create_event_request, manual_reset) == 16 );
 C_ASSERT( FIELD_OFFSET(struct create_event_request, initial_state) == 20 );
 C_ASSERT( sizeof(struct create_event_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct create_event_reply, handle) == 8 );
-C_ASSERT( sizeof(struct create_event_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_event_reply, inproc_sync) == 12 );
+C_ASSERT( FIELD_OFFSET(struct create_event_reply, access) == 16 );
+C_ASSERT( sizeof(struct create_event_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct event_op_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct event_op_request, op) == 16 );
 C_ASSERT( sizeof(struct event_op_request) == 24 );
@@ -916,7 +936,9 @@ C_ASSERT( FIELD_OFFSET(struct open_event_request, attributes) == 16 );
 C_ASSERT( FIELD_OFFSET(struct open_event_request, rootdir) == 20 );
 C_ASSERT( sizeof(struct open_event_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct open_event_reply, handle) == 8 );
-C_ASSERT( sizeof(struct open_event_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct open_event_reply, inproc_sync) == 12 );
+C_ASSERT( FIELD_OFFSET(struct open_event_reply, access) == 16 );
+C_ASSERT( sizeof(struct open_event_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct create_keyed_event_request, access) == 12 );
 C_ASSERT( sizeof(struct create_keyed_event_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct create_keyed_event_reply, handle) == 8 );
@@ -953,7 +975,9 @@ C_ASSERT( FIELD_OFFSET(struct create_semaphore_request, initial) == 16 );
 C_ASSERT( FIELD_OFFSET(struct create_semaphore_request, max) == 20 );
 C_ASSERT( sizeof(struct create_semaphore_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct create_semaphore_reply, handle) == 8 );
-C_ASSERT( sizeof(struct create_semaphore_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_semaphore_reply, inproc_sync) == 12 );
+C_ASSERT( FIELD_OFFSET(struct create_semaphore_reply, access) == 16 );
+C_ASSERT( sizeof(struct create_semaphore_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct release_semaphore_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct release_semaphore_request, count) == 16 );
 C_ASSERT( sizeof(struct release_semaphore_request) == 24 );
@@ -969,7 +993,9 @@ C_ASSERT( FIELD_OFFSET(struct open_semaphore_request, attributes) == 16 );
 C_ASSERT( FIELD_OFFSET(struct open_semaphore_request, rootdir) == 20 );
 C_ASSERT( sizeof(struct open_semaphore_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct open_semaphore_reply, handle) == 8 );
-C_ASSERT( sizeof(struct open_semaphore_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct open_semaphore_reply, inproc_sync) == 12 );
+C_ASSERT( FIELD_OFFSET(struct open_semaphore_reply, access) == 16 );
+C_ASSERT( sizeof(struct open_semaphore_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct create_file_request, access) == 12 );
 C_ASSERT( FIELD_OFFSET(struct create_file_request, sharing) == 16 );
 C_ASSERT( FIELD_OFFSET(struct create_file_request, create) == 20 );
@@ -1007,6 +1033,14 @@ C_ASSERT( FIELD_OFFSET(struct get_directory_cache_entry_request, handle) == 12 )
 C_ASSERT( sizeof(struct get_directory_cache_entry_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_directory_cache_entry_reply, entry) == 8 );
 C_ASSERT( sizeof(struct get_directory_cache_entry_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_directory_snapshot_request, handle) == 12 );
+C_ASSERT( sizeof(struct get_directory_snapshot_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_directory_snapshot_reply, total) == 8 );
+C_ASSERT( sizeof(struct get_directory_snapshot_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct set_directory_snapshot_request, handle) == 12 );
+C_ASSERT( FIELD_OFFSET(struct set_directory_snapshot_request, mtime) == 16 );
+C_ASSERT( FIELD_OFFSET(struct set_directory_snapshot_request, ctime) == 24 );
+C_ASSERT( sizeof(struct set_directory_snapshot_request) == 32 );
 C_ASSERT( FIELD_OFFSET(struct flush_request, async) == 16 );
 C_ASSERT( sizeof(struct flush_request) == 56 );
 C_ASSERT( FIELD_OFFSET(struct flush_reply, event) == 8 );
@@ -1176,13 +1210,17 @@ C_ASSERT( FIELD_OFFSET(struct create_key_request, options) == 16 );
 C_ASSERT( sizeof(struct create_key_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct create_key_reply, hkey) == 8 );
 C_ASSERT( FIELD_OFFSET(struct create_key_reply, created) == 12 );
-C_ASSERT( sizeof(struct create_key_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_key_reply, key_id) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_key_reply, access) == 24 );
+C_ASSERT( sizeof(struct create_key_reply) == 32 );
 C_ASSERT( FIELD_OFFSET(struct open_key_request, parent) == 12 );
 C_ASSERT( FIELD_OFFSET(struct open_key_request, access) == 16 );
 C_ASSERT( FIELD_OFFSET(struct open_key_request, attributes) == 20 );
 C_ASSERT( sizeof(struct open_key_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct open_key_reply, hkey) == 8 );
-C_ASSERT( sizeof(struct open_key_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct open_key_reply, access) == 12 );
+C_ASSERT( FIELD_OFFSET(struct open_key_reply, key_id) == 16 );
+C_ASSERT( sizeof(struct open_key_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct delete_key_request, hkey) == 12 );
 C_ASSERT( sizeof(struct delete_key_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct flush_key_request, hkey) == 12 );
@@ -1200,7 +1238,9 @@ C_ASSERT( FIELD_OFFSET(struct enum_key_reply, max_data) == 28 );
 C_ASSERT( FIELD_OFFSET(struct enum_key_reply, modif) == 32 );
 C_ASSERT( FIELD_OFFSET(struct enum_key_reply, total) == 40 );
 C_ASSERT( FIELD_OFFSET(struct enum_key_reply, namelen) == 44 );
-C_ASSERT( sizeof(struct enum_key_reply) == 48 );
+C_ASSERT( FIELD_OFFSET(struct enum_key_reply, gen_slot) == 48 );
+C_ASSERT( FIELD_OFFSET(struct enum_key_reply, generation) == 52 );
+C_ASSERT( sizeof(struct enum_key_reply) == 56 );
 C_ASSERT( FIELD_OFFSET(struct set_key_value_request, hkey) == 12 );
 C_ASSERT( FIELD_OFFSET(struct set_key_value_request, type) == 16 );
 C_ASSERT( FIELD_OFFSET(struct set_key_value_request, namelen) == 20 );
@@ -1209,7 +1249,9 @@ C_ASSERT( FIELD_OFFSET(struct get_key_value_request, hkey) == 12 );
 C_ASSERT( sizeof(struct get_key_value_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_key_value_reply, type) == 8 );
 C_ASSERT( FIELD_OFFSET(struct get_key_value_reply, total) == 12 );
-C_ASSERT( sizeof(struct get_key_value_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_key_value_reply, gen_slot) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_key_value_reply, generation) == 20 );
+C_ASSERT( sizeof(struct get_key_value_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct enum_key_value_request, hkey) == 12 );
 C_ASSERT( FIELD_OFFSET(struct enum_key_value_request, index) == 16 );
 C_ASSERT( FIELD_OFFSET(struct enum_key_value_request, info_class) == 20 );
@@ -2139,6 +2181,17 @@ C_ASSERT( sizeof(struct add_fd_completion_request) == 40 );
 C_ASSERT( FIELD_OFFSET(struct set_fd_completion_mode_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct set_fd_completion_mode_request, flags) == 16 );
 C_ASSERT( sizeof(struct set_fd_completion_mode_request) == 24 );
+C_ASSERT( FIELD_OFFSET(struct create_wait_completion_request, port) == 12 );
+C_ASSERT( FIELD_OFFSET(struct create_wait_completion_request, handle) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_wait_completion_request, ckey) == 24 );
+C_ASSERT( FIELD_OFFSET(struct create_wait_completion_request, cvalue) == 32 );
+C_ASSERT( sizeof(struct create_wait_completion_request) == 40 );
+C_ASSERT( FIELD_OFFSET(struct create_wait_completion_reply, wait) == 8 );
+C_ASSERT( sizeof(struct create_wait_completion_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct cancel_wait_completion_request, wait) == 12 );
+C_ASSERT( sizeof(struct cancel_wait_completion_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct cancel_wait_completion_reply, signaled) == 8 );
+C_ASSERT( sizeof(struct cancel_wait_completion_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct set_fd_disp_info_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct set_fd_disp_info_request, unlink) == 16 );
 C_ASSERT( sizeof(struct set_fd_disp_info_request) == 24 );
@@ -2236,6 +2289,9 @@ C_ASSERT( FIELD_OFFSET(struct get_next_thread_request, flags) == 28 );
 C_ASSERT( sizeof(struct get_next_thread_request) == 32 );
 C_ASSERT( FIELD_OFFSET(struct get_next_thread_reply, handle) == 8 );
 C_ASSERT( sizeof(struct get_next_thread_reply) == 16 );
+C_ASSERT( sizeof(struct batch_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct batch_reply, count) == 8 );
+C_ASSERT( sizeof(struct batch_reply) == 16 );
 
 #endif  /* WANT_REQUEST_HANDLERS */
 
@@ -55,12 +55,14 @@ struct semaphore
     struct object  obj;    /* object header */
     unsigned int   count;  /* current count */
     unsigned int   max;    /* maximum possible count */
+    unsigned int   inproc_sync; /* in-process sync slot publishing the count */
 };
 
 static void semaphore_dump( struct object *obj, int verbose );
 static int semaphore_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static int semaphore_signal( struct object *obj, unsigned int access );
+static void semaphore_destroy( struct object *obj );
 
 static const struct object_ops semaphore_ops =
 {
@@ -83,7 +85,7 @@ static const struct object_ops semaphore_ops =
     no_open_file,                  /* open_file */
     no_kernel_obj_list,            /* get_kernel_obj_list */
     no_close_handle,               /* close_handle */
-    no_destroy                     /* destroy */
+    semaphore_destroy              /* destroy */
 };
 
 
@@ -105,6 +107,7 @@ static struct semaphore *create_semaphore( struct object *root, const struct uni
             /* initialize it if it didn't already exist */
             sem->count = initial;
             sem->max   = max;
+            sem->inproc_sync = alloc_inproc_sync( INPROC_SYNC_SEMAPHORE, initial, max );
         }
     }
     return sem;
@@ -123,10 +126,12 @@ static int release_semaphore( struct semaphore *sem, unsigned int count,
     {
         /* there cannot be any thread to wake up if the count is != 0 */
         sem->count += count;
+        set_inproc_sync_state( sem->inproc_sync, sem->count );
     }
     else
     {
         sem->count = count;
+        set_inproc_sync_state( sem->inproc_sync, sem->count );
         wake_up( &sem->obj, count );
     }
     return 1;
@@ -152,6 +157,7 @@ static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *en
     assert( obj->ops == &semaphore_ops );
     assert( sem->count );
     sem->count--;
+    set_inproc_sync_state( sem->inproc_sync, sem->count );
 }
 
 static int semaphore_signal( struct object *obj, unsigned int access )
@@ -167,6 +173,13 @@ static int semaphore_signal( struct object *obj, unsigned int access )
     return release_semaphore( sem, 1, NULL );
 }
 
+static void semaphore_destroy( struct object *obj )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    free_inproc_sync( sem->inproc_sync );
+}
+
 /* create a semaphore */
 DECL_HANDLER(create_semaphore)
 {
@@ -185,6 +198,11 @@ DECL_HANDLER(create_semaphore)
         else
             reply->handle = alloc_handle_no_access_check( current->process, sem,
                                                           req->access, objattr->attributes );
+        if (reply->handle && sem->inproc_sync)
+        {
+            reply->inproc_sync = sem->inproc_sync;
+            reply->access = get_handle_access( current->process, reply->handle );
+        }
         release_object( sem );
     }
 
@@ -195,9 +213,17 @@ DECL_HANDLER(create_semaphore)
 DECL_HANDLER(open_semaphore)
 {
     struct unicode_str name = get_req_unicode_str();
+    struct semaphore *sem;
 
     reply->handle = open_object( current->process, req->rootdir, req->access,
                                  &semaphore_ops, &name, req->attributes );
+    if (reply->handle && (sem = (struct semaphore *)get_handle_obj( current->process, reply->handle,
+                                                                    0, &semaphore_ops )))
+    {
+        reply->inproc_sync = sem->inproc_sync;
+        reply->access = get_handle_access( current->process, reply->handle );
+        release_object( sem );
+    }
 }
 
 /* release a semaphore */
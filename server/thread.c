@@ -68,6 +68,7 @@ struct thread_wait
     abstime_t               when;
     struct timeout_user    *user;
     int                     status;     /* status to return (unless STATUS_PENDING) */
+    struct wait_completion *completion; /* completion to post instead of waking the thread */
     struct wait_queue_entry queues[1];
 };
 
@@ -151,6 +152,46 @@ static const struct object_ops context_ops =
 };
 
 
+/* wait posting a completion to a port once an object becomes signaled */
+
+struct wait_completion
+{
+    struct object       obj;        /* object header */
+    struct completion  *port;       /* completion port to post to */
+    apc_param_t         ckey;       /* completion key */
+    apc_param_t         cvalue;     /* completion value */
+    struct thread_wait *wait;       /* pending wait, NULL once signaled or cancelled */
+    int                 signaled;   /* has the completion been posted? */
+};
+
+static void dump_wait_completion( struct object *obj, int verbose );
+static void wait_completion_destroy( struct object *obj );
+
+static const struct object_ops wait_completion_ops =
+{
+    sizeof(struct wait_completion), /* size */
+    &no_type,                   /* type */
+    dump_wait_completion,       /* dump */
+    no_add_queue,               /* add_queue */
+    NULL,                       /* remove_queue */
+    NULL,                       /* signaled */
+    NULL,                       /* satisfied */
+    no_signal,                  /* signal */
+    no_get_fd,                  /* get_fd */
+    default_map_access,         /* map_access */
+    default_get_sd,             /* get_sd */
+    default_set_sd,             /* set_sd */
+    no_get_full_name,           /* get_full_name */
+    no_lookup_name,             /* lookup_name */
+    no_link_name,               /* link_name */
+    NULL,                       /* unlink_name */
+    no_open_file,               /* open_file */
+    no_kernel_obj_list,         /* get_kernel_obj_list */
+    no_close_handle,            /* close_handle */
+    wait_completion_destroy     /* destroy */
+};
+
+
 /* thread operations */
 
 static const WCHAR thread_name[] = {'T','h','r','e','a','d'};
@@ -233,6 +274,9 @@ static inline void init_thread_structure( struct thread *thread )
     thread->request_fd      = NULL;
     thread->reply_fd        = NULL;
     thread->wait_fd         = NULL;
+    thread->doorbell_fd     = NULL;
+    thread->shared_req      = NULL;
+    thread->shared_req_size = 0;
     thread->state           = RUNNING;
     thread->exit_code       = 0;
     thread->priority        = 0;
@@ -272,6 +316,96 @@ static void dump_context( struct object *obj, int verbose )
 }
 
 
+static void dump_wait_completion( struct object *obj, int verbose )
+{
+    struct wait_completion *wait = (struct wait_completion *)obj;
+    assert( obj->ops == &wait_completion_ops );
+
+    fprintf( stderr, "Wait completion port=%p signaled=%d\n", wait->port, wait->signaled );
+}
+
+/* remove a wait completion from the object wait queue */
+static void end_wait_completion( struct wait_completion *wait )
+{
+    struct thread_wait *thread_wait = wait->wait;
+    struct wait_queue_entry *entry;
+
+    if (!thread_wait) return;
+    entry = thread_wait->queues;
+    entry->obj->ops->remove_queue( entry->obj, entry );
+    release_object( thread_wait->thread );
+    free( thread_wait );
+    wait->wait = NULL;
+}
+
+static void wait_completion_destroy( struct object *obj )
+{
+    struct wait_completion *wait = (struct wait_completion *)obj;
+
+    assert( obj->ops == &wait_completion_ops );
+    end_wait_completion( wait );
+    release_object( wait->port );
+}
+
+/* post the completion if the object is signaled; return 1 if it was */
+static int check_wait_completion( struct wait_completion *wait )
+{
+    struct thread_wait *thread_wait = wait->wait;
+    struct wait_queue_entry *entry = thread_wait->queues;
+    unsigned int status;
+
+    if (!entry->obj->ops->signaled( entry->obj, entry )) return 0;
+
+    thread_wait->status = STATUS_WAIT_0;
+    entry->obj->ops->satisfied( entry->obj, entry );
+    status = thread_wait->status;
+    if (thread_wait->abandoned) status += STATUS_ABANDONED_WAIT_0;
+
+    wait->signaled = 1;
+    end_wait_completion( wait );
+    add_completion( wait->port, wait->ckey, wait->cvalue, status, 0 );
+    return 1;
+}
+
+/* create a wait that posts a completion to the port once the object is signaled */
+static struct wait_completion *create_wait_completion( struct completion *port, struct object *obj,
+                                                       apc_param_t ckey, apc_param_t cvalue )
+{
+    struct wait_completion *wait;
+    struct thread_wait *thread_wait;
+
+    if (!(wait = alloc_object( &wait_completion_ops ))) return NULL;
+    wait->port     = (struct completion *)grab_object( port );
+    wait->ckey     = ckey;
+    wait->cvalue   = cvalue;
+    wait->wait     = NULL;
+    wait->signaled = 0;
+
+    if (!(thread_wait = mem_alloc( sizeof(*thread_wait) )))
+    {
+        release_object( wait );
+        return NULL;
+    }
+    memset( thread_wait, 0, sizeof(*thread_wait) );
+    thread_wait->thread     = (struct thread *)grab_object( current );
+    thread_wait->count      = 1;
+    thread_wait->select     = SELECT_WAIT;
+    thread_wait->when       = TIMEOUT_INFINITE;
+    thread_wait->completion = wait;
+    thread_wait->queues[0].wait = thread_wait;
+
+    if (!obj->ops->add_queue( obj, &thread_wait->queues[0] ))
+    {
+        release_object( thread_wait->thread );
+        free( thread_wait );
+        release_object( wait );
+        return NULL;
+    }
+    wait->wait = thread_wait;
+    check_wait_completion( wait );
+    return wait;
+}
+
 static int context_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct context *context = (struct context *)obj;
@@ -406,6 +540,7 @@ static void cleanup_thread( struct thread *thread )
     }
     clear_apc_queue( &thread->system_apc );
     clear_apc_queue( &thread->user_apc );
+    free_shared_request_buffer( thread );
     free( thread->req_data );
     free( thread->reply_data );
     if (thread->request_fd) release_object( thread->request_fd );
@@ -784,6 +919,7 @@ static int wait_on( const select_op_t *select_op, unsigned int count, struct obj
     wait->user    = NULL;
     wait->when = when;
     wait->abandoned = 0;
+    wait->completion = NULL;
     current->wait = wait;
 
     for (i = 0, entry = wait->queues; i < count; i++, entry++)
@@ -1056,7 +1192,9 @@ void wake_up( struct object *obj, int max )
     LIST_FOR_EACH( ptr, &obj->wait_queue )
     {
         struct wait_queue_entry *entry = LIST_ENTRY( ptr, struct wait_queue_entry, entry );
-        if (!(ret = wake_thread( get_wait_queue_thread( entry )))) continue;
+        if (entry->wait->completion) ret = check_wait_completion( entry->wait->completion );
+        else ret = wake_thread( get_wait_queue_thread( entry ));
+        if (!ret) continue;
         if (ret > 0 && max && !--max) break;
         /* restart at the head of the list since a wake up can change the object wait queue */
         ptr = &obj->wait_queue;
@@ -1960,3 +2098,40 @@ DECL_HANDLER(get_next_thread)
     set_error( STATUS_NO_MORE_ENTRIES );
     release_object( process );
 }
+
+/* post a completion to a port once an object becomes signaled */
+DECL_HANDLER(create_wait_completion)
+{
+    struct completion *port;
+    struct object *obj;
+    struct wait_completion *wait;
+
+    if (!(port = get_completion_obj( current->process, req->port, IO_COMPLETION_MODIFY_STATE ))) return;
+
+    if ((obj = get_handle_obj( current->process, req->handle, SYNCHRONIZE, NULL )))
+    {
+        /* a mutex would be acquired on behalf of the requesting thread, which isn't the one
+         * running the callback; the client has to wait for it in a thread of its own */
+        if (obj->ops->type == &mutex_type) set_error( STATUS_OBJECT_TYPE_MISMATCH );
+        else if ((wait = create_wait_completion( port, obj, req->ckey, req->cvalue )))
+        {
+            reply->wait = alloc_handle( current->process, wait, 0, 0 );
+            release_object( wait );
+        }
+        release_object( obj );
+    }
+    release_object( port );
+}
+
+/* cancel a wait created by create_wait_completion */
+DECL_HANDLER(cancel_wait_completion)
+{
+    struct wait_completion *wait;
+
+    if (!(wait = (struct wait_completion *)get_handle_obj( current->process, req->wait, 0, &wait_completion_ops )))
+        return;
+
+    end_wait_completion( wait );
+    reply->signaled = wait->signaled;
+    release_object( wait );
+}
@@ -70,6 +70,9 @@ struct thread
     struct fd             *request_fd;    /* fd for receiving client requests */
     struct fd             *reply_fd;      /* fd to send a reply to a client */
     struct fd             *wait_fd;       /* fd to use to wake a sleeping client */
+    struct fd             *doorbell_fd;   /* eventfd signalled for requests in the shared buffer */
+    struct shared_request_buffer *shared_req; /* request buffer shared with the client */
+    data_size_t            shared_req_size; /* size of the shared request buffer */
     enum run_state         state;         /* running state */
     int                    exit_code;     /* thread exit code */
     int                    unix_pid;      /* Unix pid of client */
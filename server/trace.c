@@ -1516,6 +1516,13 @@ static void dump_init_thread_reply( const struct init_thread_reply *req )
     fprintf( stderr, ", suspend=%d", req->suspend );
 }
 
+static void dump_set_shared_request_buffer_request( const struct set_shared_request_buffer_request *req )
+{
+    fprintf( stderr, " buffer_fd=%d", req->buffer_fd );
+    fprintf( stderr, ", doorbell_fd=%d", req->doorbell_fd );
+    fprintf( stderr, ", size=%u", req->size );
+}
+
 static void dump_terminate_process_request( const struct terminate_process_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
@@ -1783,6 +1790,8 @@ static void dump_create_event_request( const struct create_event_request *req )
 static void dump_create_event_reply( const struct create_event_reply *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", inproc_sync=%08x", req->inproc_sync );
+    fprintf( stderr, ", access=%08x", req->access );
 }
 
 static void dump_event_op_request( const struct event_op_request *req )
@@ -1818,6 +1827,8 @@ static void dump_open_event_request( const struct open_event_request *req )
 static void dump_open_event_reply( const struct open_event_reply *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", inproc_sync=%08x", req->inproc_sync );
+    fprintf( stderr, ", access=%08x", req->access );
 }
 
 static void dump_create_keyed_event_request( const struct create_keyed_event_request *req )
@@ -1902,6 +1913,8 @@ static void dump_create_semaphore_request( const struct create_semaphore_request
 static void dump_create_semaphore_reply( const struct create_semaphore_reply *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", inproc_sync=%08x", req->inproc_sync );
+    fprintf( stderr, ", access=%08x", req->access );
 }
 
 static void dump_release_semaphore_request( const struct release_semaphore_request *req )
@@ -1937,6 +1950,8 @@ static void dump_open_semaphore_request( const struct open_semaphore_request *re
 static void dump_open_semaphore_reply( const struct open_semaphore_reply *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", inproc_sync=%08x", req->inproc_sync );
+    fprintf( stderr, ", access=%08x", req->access );
 }
 
 static void dump_create_file_request( const struct create_file_request *req )
@@ -2017,6 +2032,25 @@ static void dump_get_directory_cache_entry_reply( const struct get_directory_cac
     dump_varargs_ints( ", free=", cur_size );
 }
 
+static void dump_get_directory_snapshot_request( const struct get_directory_snapshot_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
+static void dump_get_directory_snapshot_reply( const struct get_directory_snapshot_reply *req )
+{
+    fprintf( stderr, " total=%u", req->total );
+    dump_varargs_bytes( ", data=", cur_size );
+}
+
+static void dump_set_directory_snapshot_request( const struct set_directory_snapshot_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    dump_timeout( ", mtime=", &req->mtime );
+    dump_timeout( ", ctime=", &req->ctime );
+    dump_varargs_bytes( ", data=", cur_size );
+}
+
 static void dump_flush_request( const struct flush_request *req )
 {
     dump_async_data( " async=", &req->async );
@@ -2367,6 +2401,8 @@ static void dump_create_key_reply( const struct create_key_reply *req )
 {
     fprintf( stderr, " hkey=%04x", req->hkey );
     fprintf( stderr, ", created=%d", req->created );
+    dump_uint64( ", key_id=", &req->key_id );
+    fprintf( stderr, ", access=%08x", req->access );
 }
 
 static void dump_open_key_request( const struct open_key_request *req )
@@ -2380,6 +2416,8 @@ static void dump_open_key_request( const struct open_key_request *req )
 static void dump_open_key_reply( const struct open_key_reply *req )
 {
     fprintf( stderr, " hkey=%04x", req->hkey );
+    fprintf( stderr, ", access=%08x", req->access );
+    dump_uint64( ", key_id=", &req->key_id );
 }
 
 static void dump_delete_key_request( const struct delete_key_request *req )
@@ -2410,6 +2448,8 @@ static void dump_enum_key_reply( const struct enum_key_reply *req )
     dump_timeout( ", modif=", &req->modif );
     fprintf( stderr, ", total=%u", req->total );
     fprintf( stderr, ", namelen=%u", req->namelen );
+    fprintf( stderr, ", gen_slot=%08x", req->gen_slot );
+    fprintf( stderr, ", generation=%08x", req->generation );
     dump_varargs_unicode_str( ", name=", min(cur_size,req->namelen) );
     dump_varargs_unicode_str( ", class=", cur_size );
 }
@@ -2433,6 +2473,8 @@ static void dump_get_key_value_reply( const struct get_key_value_reply *req )
 {
     fprintf( stderr, " type=%d", req->type );
     fprintf( stderr, ", total=%u", req->total );
+    fprintf( stderr, ", gen_slot=%08x", req->gen_slot );
+    fprintf( stderr, ", generation=%08x", req->generation );
     dump_varargs_bytes( ", data=", cur_size );
 }
 
@@ -4316,6 +4358,29 @@ static void dump_set_fd_completion_mode_request( const struct set_fd_completion_
     fprintf( stderr, ", flags=%08x", req->flags );
 }
 
+static void dump_create_wait_completion_request( const struct create_wait_completion_request *req )
+{
+    fprintf( stderr, " port=%04x", req->port );
+    fprintf( stderr, ", handle=%04x", req->handle );
+    dump_uint64( ", ckey=", &req->ckey );
+    dump_uint64( ", cvalue=", &req->cvalue );
+}
+
+static void dump_create_wait_completion_reply( const struct create_wait_completion_reply *req )
+{
+    fprintf( stderr, " wait=%04x", req->wait );
+}
+
+static void dump_cancel_wait_completion_request( const struct cancel_wait_completion_request *req )
+{
+    fprintf( stderr, " wait=%04x", req->wait );
+}
+
+static void dump_cancel_wait_completion_reply( const struct cancel_wait_completion_reply *req )
+{
+    fprintf( stderr, " signaled=%d", req->signaled );
+}
+
 static void dump_set_fd_disp_info_request( const struct set_fd_disp_info_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
@@ -4517,6 +4582,17 @@ static void dump_get_next_thread_reply( const struct get_next_thread_reply *req
     fprintf( stderr, " handle=%04x", req->handle );
 }
 
+static void dump_batch_request( const struct batch_request *req )
+{
+    dump_varargs_bytes( " requests=", cur_size );
+}
+
+static void dump_batch_reply( const struct batch_reply *req )
+{
+    fprintf( stderr, " count=%08x", req->count );
+    dump_varargs_bytes( ", replies=", cur_size );
+}
+
 static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_new_process_request,
     (dump_func)dump_get_new_process_info_request,
@@ -4525,6 +4601,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_init_process_done_request,
     (dump_func)dump_init_first_thread_request,
     (dump_func)dump_init_thread_request,
+    (dump_func)dump_set_shared_request_buffer_request,
     (dump_func)dump_terminate_process_request,
     (dump_func)dump_terminate_thread_request,
     (dump_func)dump_get_process_info_request,
@@ -4566,6 +4643,8 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_handle_unix_name_request,
     (dump_func)dump_get_handle_fd_request,
     (dump_func)dump_get_directory_cache_entry_request,
+    (dump_func)dump_get_directory_snapshot_request,
+    (dump_func)dump_set_directory_snapshot_request,
     (dump_func)dump_flush_request,
     (dump_func)dump_get_file_info_request,
     (dump_func)dump_get_volume_info_request,
@@ -4769,6 +4848,8 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_set_completion_info_request,
     (dump_func)dump_add_fd_completion_request,
     (dump_func)dump_set_fd_completion_mode_request,
+    (dump_func)dump_create_wait_completion_request,
+    (dump_func)dump_cancel_wait_completion_request,
     (dump_func)dump_set_fd_disp_info_request,
     (dump_func)dump_set_fd_name_info_request,
     (dump_func)dump_get_window_layered_info_request,
@@ -4791,6 +4872,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_suspend_process_request,
     (dump_func)dump_resume_process_request,
     (dump_func)dump_get_next_thread_request,
+    (dump_func)dump_batch_request,
 };
 
 static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
@@ -4801,6 +4883,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_init_process_done_reply,
     (dump_func)dump_init_first_thread_reply,
     (dump_func)dump_init_thread_reply,
+    NULL,
     (dump_func)dump_terminate_process_reply,
     (dump_func)dump_terminate_thread_reply,
     (dump_func)dump_get_process_info_reply,
@@ -4842,6 +4925,8 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_handle_unix_name_reply,
     (dump_func)dump_get_handle_fd_reply,
     (dump_func)dump_get_directory_cache_entry_reply,
+    (dump_func)dump_get_directory_snapshot_reply,
+    NULL,
     (dump_func)dump_flush_reply,
     (dump_func)dump_get_file_info_reply,
     (dump_func)dump_get_volume_info_reply,
@@ -5045,6 +5130,8 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     NULL,
     NULL,
+    (dump_func)dump_create_wait_completion_reply,
+    (dump_func)dump_cancel_wait_completion_reply,
     NULL,
     NULL,
     (dump_func)dump_get_window_layered_info_reply,
@@ -5067,6 +5154,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     NULL,
     (dump_func)dump_get_next_thread_reply,
+    (dump_func)dump_batch_reply,
 };
 
 static const char * const req_names[REQ_NB_REQUESTS] = {
@@ -5077,6 +5165,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "init_process_done",
     "init_first_thread",
     "init_thread",
+    "set_shared_request_buffer",
     "terminate_process",
     "terminate_thread",
     "get_process_info",
@@ -5118,6 +5207,8 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "get_handle_unix_name",
     "get_handle_fd",
     "get_directory_cache_entry",
+    "get_directory_snapshot",
+    "set_directory_snapshot",
     "flush",
     "get_file_info",
     "get_volume_info",
@@ -5321,6 +5412,8 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "set_completion_info",
     "add_fd_completion",
     "set_fd_completion_mode",
+    "create_wait_completion",
+    "cancel_wait_completion",
     "set_fd_disp_info",
     "set_fd_name_info",
     "get_window_layered_info",
@@ -5343,6 +5436,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "suspend_process",
     "resume_process",
     "get_next_thread",
+    "batch",
 };
 
 static const struct